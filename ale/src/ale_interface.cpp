@@ -274,6 +274,13 @@ void ALEInterface::getScreenRGB(std::vector<unsigned char>& output_rgb_buffer){
   theOSystem->colourPalette().applyPaletteRGB(output_rgb_buffer, ale_screen_data, screen_size * 3);
 }
 
+// Writes the current game screen in grayscale, area-averaged down to
+// height x width, to output_buffer, which must hold height * width bytes
+void ALEInterface::getDownsampledScreenGrayscale(unsigned char *output_buffer,
+                                                 int height, int width) {
+  environment->getDownsampledScreenGrayscale(output_buffer, height, width);
+}
+
 // Returns the current RAM content
 const ALERAM& ALEInterface::getRAM() {
   return environment->getRAM();
@@ -116,6 +116,10 @@ public:
   //followed by the green colours and then the blue colours
   void getScreenRGB(std::vector<unsigned char>& output_rgb_buffer);
 
+  // Writes the current game screen in grayscale, area-averaged down to
+  // height x width, to output_buffer, which must hold height * width bytes
+  void getDownsampledScreenGrayscale(unsigned char *output_buffer, int height, int width);
+
   // Returns the current RAM content
   const ALERAM &getRAM();
 
@@ -4,6 +4,7 @@ MODULE_OBJS := \
 	src/environment/ale_state.o \
 	src/environment/stella_environment.o \
 	src/environment/phosphor_blend.o \
+	src/environment/screen_downsampler.o \
 	
 MODULE_DIRS += \
 	src/environment
@@ -0,0 +1,128 @@
+/* *****************************************************************************
+ * A.L.E (Arcade Learning Environment)
+ * Copyright (c) 2009-2013 by Yavar Naddaf, Joel Veness, Marc G. Bellemare and
+ *   the Reinforcement Learning and Artificial Intelligence Laboratory
+ * Released under the GNU General Public License; see License.txt for details.
+ *
+ * Based on: Stella  --  "An Atari 2600 VCS Emulator"
+ * Copyright (c) 1995-2007 by Bradford W. Mott and the Stella team
+ *
+ * *****************************************************************************
+ *  screen_downsampler.cpp
+ *
+ *  Converts the screen to grayscale and shrinks it by area averaging in one
+ *  pass, writing the observation into a caller-provided buffer.
+ *
+ **************************************************************************** */
+
+#include "screen_downsampler.hpp"
+#include <algorithm>
+#include <cmath>
+
+// Weights of each axis are fixed point numbers with this many fraction bits
+static const int kWeightBits = 8;
+static const uInt32 kOne = 1 << kWeightBits;
+
+ScreenDownsampler::ScreenDownsampler(const ColourPalette &palette,
+                                     int src_height, int src_width,
+                                     int dst_height, int dst_width):
+  m_src_height(src_height),
+  m_src_width(src_width),
+  m_dst_height(dst_height),
+  m_dst_width(dst_width),
+  m_gray(src_height * src_width),
+  m_tall_row(src_width) {
+
+  assert(dst_height > 0 && dst_height <= src_height);
+  assert(dst_width > 0 && dst_width <= src_width);
+
+  // Same luminance as the grayscale palette; odd values are not colours
+  for (int v = 0; v < 256; v++) {
+    int r, g, b;
+    palette.getRGB(v & 0xFE, r, g, b);
+    m_luminance[v] = (uInt8) round(r * 0.2989 + g * 0.5870 + b * 0.1140);
+  }
+
+  makeFilter(src_height, dst_height, m_rows);
+  makeFilter(src_width, dst_width, m_columns);
+}
+
+void ScreenDownsampler::makeFilter(int src_size, int dst_size, Filter &filter) {
+  const double scale = (double) src_size / dst_size;
+
+  // Output i averages the sources overlapping [i * scale, (i + 1) * scale)
+  filter.taps = 0;
+  for (int i = 0; i < dst_size; i++) {
+    int first = (int) floor(i * scale);
+    int last = std::min((int) ceil((i + 1) * scale), src_size);
+    filter.taps = std::max(filter.taps, last - first);
+  }
+
+  filter.first.resize(dst_size);
+  filter.weights.assign(dst_size * filter.taps, 0);
+  for (int i = 0; i < dst_size; i++) {
+    const double start = i * scale;
+    const double end = (i + 1) * scale;
+    // Every output reads taps sources, so keep them inside the screen
+    const int first = std::min((int) floor(start), src_size - filter.taps);
+    filter.first[i] = first;
+
+    uInt16 *weights = &filter.weights[i * filter.taps];
+    uInt32 sum = 0;
+    int largest = 0;
+    for (int t = 0; t < filter.taps; t++) {
+      const int k = first + t;
+      const double overlap = std::min(k + 1.0, end) - std::max((double) k, start);
+      if (overlap > 0) {
+        weights[t] = (uInt16) round(overlap / scale * kOne);
+        sum += weights[t];
+        if (weights[t] > weights[largest]) largest = t;
+      }
+    }
+    // Rounding must not brighten or darken the output
+    weights[largest] += kOne - sum;
+  }
+}
+
+void ScreenDownsampler::process(const ALEScreen &screen, uInt8 *output) {
+  assert((int) screen.height() == m_src_height);
+  assert((int) screen.width() == m_src_width);
+
+  const int row_taps = m_rows.taps;
+  const int column_taps = m_columns.taps;
+
+  // The screen through the palette
+  const pixel_t *src = screen.getArray();
+  uInt8 *gray = &m_gray[0];
+  for (int k = 0; k < m_src_height * m_src_width; k++) {
+    gray[k] = m_luminance[src[k]];
+  }
+
+  for (int i = 0; i < m_dst_height; i++) {
+    // Vertical pass over whole rows, which the compiler vectorizes.  With
+    // weights of at most kOne the sums fit in 16 bits.
+    uInt16 *tall = &m_tall_row[0];
+    std::fill(m_tall_row.begin(), m_tall_row.end(), 0);
+    const uInt16 *row_weights = &m_rows.weights[i * row_taps];
+    for (int t = 0; t < row_taps; t++) {
+      const uInt16 w = row_weights[t];
+      if (w == 0) continue;
+      const uInt8 *src_row = gray + (m_rows.first[i] + t) * m_src_width;
+      for (int c = 0; c < m_src_width; c++) {
+        tall[c] += w * src_row[c];
+      }
+    }
+
+    // Horizontal pass
+    uInt8 *dst = output + i * m_dst_width;
+    for (int j = 0; j < m_dst_width; j++) {
+      const uInt16 *column = tall + m_columns.first[j];
+      const uInt16 *column_weights = &m_columns.weights[j * column_taps];
+      uInt32 sum = 0;
+      for (int t = 0; t < column_taps; t++) {
+        sum += (uInt32) column_weights[t] * column[t];
+      }
+      dst[j] = (uInt8) ((sum + (kOne * kOne / 2)) >> (2 * kWeightBits));
+    }
+  }
+}
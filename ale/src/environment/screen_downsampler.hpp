@@ -0,0 +1,58 @@
+/* *****************************************************************************
+ * A.L.E (Arcade Learning Environment)
+ * Copyright (c) 2009-2013 by Yavar Naddaf, Joel Veness, Marc G. Bellemare and
+ *   the Reinforcement Learning and Artificial Intelligence Laboratory
+ * Released under the GNU General Public License; see License.txt for details.
+ *
+ * Based on: Stella  --  "An Atari 2600 VCS Emulator"
+ * Copyright (c) 1995-2007 by Bradford W. Mott and the Stella team
+ *
+ * *****************************************************************************
+ *  screen_downsampler.hpp
+ *
+ *  Converts the screen to grayscale and shrinks it by area averaging in one
+ *  pass, writing the observation into a caller-provided buffer.
+ *
+ **************************************************************************** */
+
+#ifndef __SCREEN_DOWNSAMPLER_HPP__
+#define __SCREEN_DOWNSAMPLER_HPP__
+
+#include <cassert>
+#include <vector>
+#include "../common/ColourPalette.hpp"
+#include "ale_screen.hpp"
+
+class ScreenDownsampler {
+  public:
+    ScreenDownsampler(const ColourPalette &palette, int src_height, int src_width,
+                      int dst_height, int dst_width);
+
+    /** Writes dst_height x dst_width grayscale pixels, row by row, to output */
+    void process(const ALEScreen &screen, uInt8 *output);
+
+    int dstHeight() const { return m_dst_height; }
+    int dstWidth() const { return m_dst_width; }
+
+  private:
+    /** Area-averaging filter along one axis, weights in fixed point */
+    struct Filter {
+      int taps;                  // Largest number of sources of an output
+      std::vector<int> first;    // First source of each output
+      std::vector<uInt16> weights; // taps weights per output, summing to kOne
+    };
+
+    static void makeFilter(int src_size, int dst_size, Filter &filter);
+
+  private:
+    int m_src_height, m_src_width;
+    int m_dst_height, m_dst_width;
+
+    uInt8 m_luminance[256]; // Grayscale of every palette entry
+    Filter m_rows, m_columns;
+
+    std::vector<uInt8> m_gray;       // The screen in grayscale
+    std::vector<uInt16> m_tall_row;  // One output row filtered vertically only
+};
+
+#endif // __SCREEN_DOWNSAMPLER_HPP__
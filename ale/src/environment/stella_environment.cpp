@@ -25,6 +25,8 @@ StellaEnvironment::StellaEnvironment(OSystem* osystem, RomSettings* settings):
   m_phosphor_blend(osystem),  
   m_screen(m_osystem->console().mediaSource().height(),
         m_osystem->console().mediaSource().width()),
+  m_screen_stale(true),
+  m_ram_stale(true),
   m_player_a_action(PLAYER_A_NOOP),
   m_player_b_action(PLAYER_B_NOOP) {
 
@@ -160,7 +162,7 @@ reward_t StellaEnvironment::act(Action player_a_action, Action player_b_action)
 
     // Similarly record screen as needed
     if (m_screen_exporter.get() != NULL)
-        m_screen_exporter->saveNext(m_screen);
+        m_screen_exporter->saveNext(getScreen());
 
     // Use the stored actions, which may or may not have changed this frame
     sum_rewards += oneStepAct(m_player_a_action, m_player_b_action);
@@ -219,9 +221,10 @@ void StellaEnvironment::emulate(Action player_a_action, Action player_b_action,
     }
   }
 
-  // Parse screen and RAM into their respective data structures
-  processScreen();
-  processRAM();
+  // Screen and RAM are parsed into their respective data structures when next asked
+  //  for, so that frames skipped over by act() are never copied
+  m_screen_stale = true;
+  m_ram_stale = true;
 }
 
 /** Accessor methods for the environment state. */
@@ -233,6 +236,22 @@ const ALEState& StellaEnvironment::getState() const {
   return m_state;
 }
 
+const ALEScreen &StellaEnvironment::getScreen() {
+  if (m_screen_stale) {
+    processScreen();
+    m_screen_stale = false;
+  }
+  return m_screen;
+}
+
+const ALERAM &StellaEnvironment::getRAM() {
+  if (m_ram_stale) {
+    processRAM();
+    m_ram_stale = false;
+  }
+  return m_ram;
+}
+
 void StellaEnvironment::processScreen() {
   if (m_colour_averaging) {
     // Perform phosphor averaging; the blender stores its result in the given screen
@@ -245,6 +264,16 @@ void StellaEnvironment::processScreen() {
   }
 }
 
+void StellaEnvironment::getDownsampledScreenGrayscale(uInt8 *output_buffer,
+                                                      int height, int width) {
+  if (m_downsampler.get() == NULL ||
+      m_downsampler->dstHeight() != height || m_downsampler->dstWidth() != width) {
+    m_downsampler.reset(new ScreenDownsampler(m_osystem->colourPalette(),
+      m_screen.height(), m_screen.width(), height, width));
+  }
+  m_downsampler->process(getScreen(), output_buffer);
+}
+
 void StellaEnvironment::processRAM() {
   // Copy RAM over
   for (size_t i = 0; i < m_ram.size(); i++)
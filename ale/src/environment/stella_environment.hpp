@@ -22,6 +22,7 @@
 #include "ale_screen.hpp"
 #include "ale_ram.hpp"
 #include "phosphor_blend.hpp"
+#include "screen_downsampler.hpp"
 #include "../emucore/OSystem.hxx"
 #include "../emucore/Event.hxx"
 #include "../games/RomSettings.hpp"
@@ -71,9 +72,14 @@ class StellaEnvironment {
     void setState(const ALEState & state);
     const ALEState &getState() const;
 
-    /** Returns the current screen after processing (e.g. colour averaging) */
-    const ALEScreen &getScreen() const { return m_screen; }
-    const ALERAM &getRAM() const { return m_ram; }
+    /** Returns the current screen after processing (e.g. colour averaging). Screen and
+      *  RAM are only copied out of the emulator when first asked for after emulating. */
+    const ALEScreen &getScreen();
+    const ALERAM &getRAM();
+
+    /** Writes the current screen in grayscale, area-averaged down to height x width,
+      *  to output_buffer, which must hold height * width bytes. */
+    void getDownsampledScreenGrayscale(uInt8 *output_buffer, int height, int width);
 
     int getFrameNumber() const { return m_state.getFrameNumber(); }
     int getEpisodeFrameNumber() const { return m_state.getEpisodeFrameNumber(); }
@@ -105,6 +111,8 @@ class StellaEnvironment {
     ALEState m_state; // Current environment state    
     ALEScreen m_screen; // The current ALE screen (possibly colour-averaged)
     ALERAM m_ram; // The current ALE RAM
+    bool m_screen_stale; // Whether the emulator has run since m_screen was processed
+    bool m_ram_stale; // Whether the emulator has run since m_ram was copied
 
     bool m_use_paddles;  // Whether this game uses paddles
     
@@ -115,6 +123,7 @@ class StellaEnvironment {
     size_t m_frame_skip; // How many frames to emulate per act()
     float m_repeat_action_probability; // Stochasticity of the environment
     std::auto_ptr<ScreenExporter> m_screen_exporter; // Automatic screen recorder
+    std::auto_ptr<ScreenDownsampler> m_downsampler; // Made for the last requested size
 
     // The last actions taken by our players
     Action m_player_a_action, m_player_b_action;
@@ -71,8 +71,9 @@ function(caffe_pickup_caffe_sources root)
   file(GLOB test_srcs    ${root}/src/caffe/test/test_*.cpp)
   file(GLOB_RECURSE hdrs ${root}/include/caffe/*.h*)
   file(GLOB_RECURSE srcs ${root}/src/caffe/*.cpp)
+  file(GLOB bench_srcs   ${root}/src/caffe/bench/*.cpp)
   list(REMOVE_ITEM  hdrs ${test_hdrs})
-  list(REMOVE_ITEM  srcs ${test_srcs})
+  list(REMOVE_ITEM  srcs ${test_srcs} ${bench_srcs})
 
   # adding headers to make the visible in some IDEs (Qt, VS, Xcode)
   list(APPEND srcs ${hdrs} ${PROJECT_BINARY_DIR}/caffe_config.h)
@@ -263,6 +263,15 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Keep the data in the given SyncedMemory, which must hold as many
+   *        elements as the Blob has ever held and may be shared with other
+   *        Blob%s -- used by Net to let activations that are never live at
+   *        the same time share memory.
+   *
+   * Growing the Blob beyond that gives it memory of its own again.
+   */
+  void set_data_memory(const shared_ptr<SyncedMemory>& memory);
 
   bool ShapeEquals(const BlobProto& other);
 
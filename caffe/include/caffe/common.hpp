@@ -89,6 +89,9 @@ using std::string;
 using std::stringstream;
 using std::vector;
 
+class HostAllocator;
+class ThreadPool;
+
 // A global initialization function that you should call in your main function.
 // Currently it initializes google flags and google logging.
 void GlobalInit(int* pargc, char*** pargv);
@@ -154,6 +157,24 @@ class Caffe {
   inline static void set_solver_count(int val) { Get().solver_count_ = val; }
   inline static bool root_solver() { return Get().root_solver_; }
   inline static void set_root_solver(bool val) { Get().root_solver_ = val; }
+  // The threads CPU kernels split their loops over, or NULL to run them on
+  // the calling thread alone. Threads started by InternalThread share the
+  // pool of the thread that started them.
+  inline static const shared_ptr<ThreadPool>& thread_pool() {
+    return Get().thread_pool_;
+  }
+  inline static void set_thread_pool(const shared_ptr<ThreadPool>& pool) {
+    Get().thread_pool_ = pool;
+  }
+  // Sets the number of threads of the CPU kernels, this one included.
+  static void set_cpu_threads(const int num_threads);
+  // The allocator of host memory in CPU mode, HostAllocator::Default() unless
+  // set otherwise. Threads started by InternalThread share the allocator of
+  // the thread that started them.
+  inline static const shared_ptr<HostAllocator>& host_allocator() {
+    return Get().host_allocator_;
+  }
+  static void set_host_allocator(const shared_ptr<HostAllocator>& allocator);
 
  protected:
 #ifndef CPU_ONLY
@@ -165,6 +186,8 @@ class Caffe {
   Brew mode_;
   int solver_count_;
   bool root_solver_;
+  shared_ptr<ThreadPool> thread_pool_;
+  shared_ptr<HostAllocator> host_allocator_;
 
  private:
   // The private constructor to avoid duplicate instantiation.
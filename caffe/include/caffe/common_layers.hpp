@@ -330,7 +330,8 @@ class FlattenLayer : public Layer<Dtype> {
 
 /**
  * @brief Also known as a "fully-connected" layer, computes an inner product
- *        with a set of learned weights, and (optionally) adds biases.
+ *        with a set of learned weights, and (optionally) adds biases and
+ *        applies a ReLU in one pass.
  *
  * TODO(dox): thorough documentation for Forward, Backward, and proto params.
  */
@@ -358,11 +359,20 @@ class InnerProductLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  /// @brief Collects the indices of the nonzero entries of top_diff into
+  ///        top_diff_nonzeros_ and returns whether they are few enough for
+  ///        the backward pass to visit them one by one instead of running
+  ///        dense GEMMs, as with a loss on one output per sample.
+  bool SparseTopDiff(const Dtype* top_diff);
+
   int M_;
   int K_;
   int N_;
   bool bias_term_;
+  bool relu_;
+  Dtype relu_negative_slope_;
   Blob<Dtype> bias_multiplier_;
+  vector<int> top_diff_nonzeros_;
 };
 
 /**
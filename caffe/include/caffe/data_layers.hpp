@@ -303,6 +303,47 @@ class MemoryDataLayer : public BaseDataLayer<Dtype> {
   bool has_new_data_;
 };
 
+/**
+ * @brief Provides bytes, such as raw image frames, to the Net from memory.
+ *
+ * The top has the shape given by memory_data_param but holds one byte per
+ * element, packed from the start of its memory, in place of Dtype values.
+ * It can therefore only feed layers that read bytes, i.e. a Convolution with
+ * byte_input, which widens the bytes itself so that no Dtype copy of the
+ * input is ever made.
+ */
+template <typename Dtype>
+class ByteMemoryDataLayer : public BaseDataLayer<Dtype> {
+ public:
+  explicit ByteMemoryDataLayer(const LayerParameter& param)
+      : BaseDataLayer<Dtype>(param), data_(NULL) {}
+  virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "ByteMemoryData"; }
+  virtual inline int ExactNumBottomBlobs() const { return 0; }
+  virtual inline int ExactNumTopBlobs() const { return 1; }
+
+  // Reads batches from the n items at data, which must stay valid until
+  // they have been consumed.
+  void Reset(const uint8_t* data, int n);
+  void set_batch_size(int new_size);
+
+  int batch_size() { return batch_size_; }
+  int channels() { return channels_; }
+  int height() { return height_; }
+  int width() { return width_; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  int batch_size_, channels_, height_, width_, size_;
+  const uint8_t* data_;
+  int n_;
+  size_t pos_;
+};
+
 /**
  * @brief Provides data to the Net from windows of images files, specified
  *        by a window data file.
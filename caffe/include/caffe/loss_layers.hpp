@@ -768,6 +768,60 @@ class SoftmaxWithLossLayer : public LossLayer<Dtype> {
   int softmax_axis_, outer_num_, inner_num_;
 };
 
+/**
+ * @brief Computes the temporal-difference loss of Q-learning on the action
+ *        taken in each sample, @f$
+ *          E = \frac{1}{N} \sum\limits_{n=1}^N w_n
+ *              \ell \left( \hat{q}_{n,a_n} - t_n \right) @f$, where
+ *        @f$ \ell(d) = \frac{1}{2} d^2 @f$, or the Huber loss
+ *        @f$ \ell(d) = \delta \left( |d| - \frac{1}{2} \delta \right) @f$
+ *        for @f$ |d| > \delta @f$ if huber_delta @f$ \delta @f$ is set.
+ *
+ * This stands in for masking the Q values of the actions not taken and an
+ * EuclideanLossLayer against a mostly-zero target, reading only
+ * @f$ 3N @f$ inputs instead of two @f$ N \times A @f$ ones.
+ *
+ * @param bottom input Blob vector (length 2)
+ *   -# @f$ (N \times A \times 1 \times 1) @f$
+ *      the predicted Q values @f$ \hat{q} @f$ of the @f$ A @f$ actions
+ *   -# @f$ (N \times 3 \times 1 \times 1) @f$
+ *      the action @f$ a_n \in [0, 1, ..., A - 1] @f$ taken in each sample,
+ *      its target value @f$ t_n @f$ and its weight @f$ w_n @f$
+ * @param top output Blob vector (length 1)
+ *   -# @f$ (1 \times 1 \times 1 \times 1) @f$
+ *      the computed loss @f$ E @f$
+ */
+template <typename Dtype>
+class TDLossLayer : public LossLayer<Dtype> {
+ public:
+  explicit TDLossLayer(const LayerParameter& param)
+      : LossLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "TDLoss"; }
+
+ protected:
+  /// @copydoc TDLossLayer
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  /**
+   * @brief Computes the TD error gradient w.r.t. the predicted Q values.
+   *
+   * Only the entry of the action taken in each sample gets a gradient,
+   * @f$ \frac{\lambda}{N} w_n \ell'(\hat{q}_{n,a_n} - t_n) @f$; the rest of
+   * the diff is zeroed. The second input gets no gradient.
+   */
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  /// The Huber threshold, or 0 for the squared loss.
+  Dtype huber_delta_;
+};
+
 }  // namespace caffe
 
 #endif  // CAFFE_LOSS_LAYERS_HPP_
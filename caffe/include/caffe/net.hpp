@@ -104,6 +104,12 @@ class Net {
    *        additional memory) the pre-trained layers from another Net.
    */
   void ShareTrainedLayersWith(const Net* other);
+  /**
+   * @brief For an already initialized net, copies the learnable parameters of
+   *        another Net with the same parameter layout blob by blob, without
+   *        going through a NetParameter.
+   */
+  void CopyParamsFrom(const Net& other);
   // For an already initialized net, CopyTrainedLayersFrom() copies the already
   // trained layers from another net parameter instance.
   /**
@@ -200,6 +206,40 @@ class Net {
   const shared_ptr<Layer<Dtype> > layer_by_name(const string& layer_name) const;
 
   void set_debug_info(const bool value) { debug_info_ = value; }
+  /// @brief Whether the net only runs forward passes, sharing the memory of
+  ///        its activations
+  bool inference_only() const { return inference_only_; }
+
+  /// @brief Called with the index of each layer around its Forward or
+  ///        Backward, for instrumentation such as NetProfiler
+  class Callback {
+   public:
+    virtual ~Callback() {}
+
+   protected:
+    virtual void run(int layer) = 0;
+
+    template <typename T>
+    friend class Net;
+  };
+  const vector<Callback*>& before_forward() const { return before_forward_; }
+  void add_before_forward(Callback* value) {
+    before_forward_.push_back(value);
+  }
+  const vector<Callback*>& after_forward() const { return after_forward_; }
+  void add_after_forward(Callback* value) {
+    after_forward_.push_back(value);
+  }
+  const vector<Callback*>& before_backward() const { return before_backward_; }
+  void add_before_backward(Callback* value) {
+    before_backward_.push_back(value);
+  }
+  const vector<Callback*>& after_backward() const { return after_backward_; }
+  void add_after_backward(Callback* value) {
+    after_backward_.push_back(value);
+  }
+  /// @brief Unregister a callback from every list it was added to
+  void RemoveCallback(Callback* value);
 
   // Helpers for Init.
   /**
@@ -226,6 +266,10 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /// @brief Let the activations of an inference_only net that are never
+  ///        live at the same time share buffers.
+  void ShareActivationMemory();
+
   /// @brief Helper for displaying debug info in Forward about input Blobs.
   void InputDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Forward.
@@ -239,6 +283,8 @@ class Net {
   string name_;
   /// @brief The phase: TRAIN or TEST
   Phase phase_;
+  /// @brief Whether the net only runs forward passes
+  bool inference_only_;
   /// @brief Individual layers in the net
   vector<shared_ptr<Layer<Dtype> > > layers_;
   vector<string> layer_names_;
@@ -294,6 +340,11 @@ class Net {
   bool debug_info_;
   /// The root net that actually holds the shared layers in data parallelism
   const Net* const root_net_;
+  /// Instrumentation run around each layer
+  vector<Callback*> before_forward_;
+  vector<Callback*> after_forward_;
+  vector<Callback*> before_backward_;
+  vector<Callback*> after_backward_;
   DISABLE_COPY_AND_ASSIGN(Net);
 };
 
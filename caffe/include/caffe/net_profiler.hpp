@@ -0,0 +1,114 @@
+#ifndef CAFFE_NET_PROFILER_HPP_
+#define CAFFE_NET_PROFILER_HPP_
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/benchmark.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Times every layer of a Net while it runs, through the Net
+ *        callbacks.
+ *
+ * Keeps the durations of the last window forward and backward passes of each
+ * layer, together with estimates of the FLOPs and bytes of those passes, and
+ * can append each pass to a Chrome trace_event file (chrome://tracing,
+ * Perfetto). The net must outlive the profiler, and only one thread at a time
+ * may run it.
+ */
+template <typename Dtype>
+class NetProfiler {
+ public:
+  struct LayerStats {
+    string name;
+    string type;
+    // Passes within the window, their mean and their longest duration
+    int forward_count;
+    double forward_ms;
+    double forward_max_ms;
+    int backward_count;
+    double backward_ms;
+    double backward_max_ms;
+    // Estimated cost of the last pass
+    double forward_flops;
+    double forward_bytes;
+    double backward_flops;
+    double backward_bytes;
+  };
+
+  explicit NetProfiler(Net<Dtype>* net, const int window = 100);
+  ~NetProfiler();
+
+  /** Appends every layer pass from now on to a JSON trace_event file. */
+  void StartTrace(const string& path);
+
+  vector<LayerStats> Stats() const;
+  /** A table of Stats with the share of each layer and its throughput. */
+  string Report() const;
+  void Reset();
+
+  /**
+   * Estimates the FLOPs and the bytes read and written of a forward pass of
+   * a layer: multiply-adds of the weighted layers, one operation per output
+   * for the others. Backward passes take about twice as much.
+   */
+  static void EstimateForwardCost(Layer<Dtype>* layer,
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top,
+      double* flops, double* bytes);
+
+ private:
+  class LayerCallback : public Net<Dtype>::Callback {
+   public:
+    LayerCallback(NetProfiler* profiler, const bool backward, const bool after)
+        : profiler_(profiler), backward_(backward), after_(after) {}
+
+   protected:
+    virtual void run(int layer);
+
+   private:
+    NetProfiler* profiler_;
+    const bool backward_;
+    const bool after_;
+  };
+
+  // The window of passes of one layer in one direction
+  struct Durations {
+    Durations() : next(0), flops(0), bytes(0) {}
+    vector<double> ms;
+    int next;
+    double flops;
+    double bytes;
+  };
+
+  void Begin(const int layer);
+  void End(const int layer, const bool backward);
+
+  Net<Dtype>* const net_;
+  const int window_;
+  LayerCallback before_forward_;
+  LayerCallback after_forward_;
+  LayerCallback before_backward_;
+  LayerCallback after_backward_;
+
+  Timer timer_;
+  boost::posix_time::ptime begin_time_;
+  const boost::posix_time::ptime epoch_;
+  vector<Durations> forward_;
+  vector<Durations> backward_;
+
+  std::ofstream trace_;
+  bool trace_empty_;
+
+  DISABLE_COPY_AND_ASSIGN(NetProfiler);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_NET_PROFILER_HPP_
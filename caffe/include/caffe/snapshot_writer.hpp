@@ -0,0 +1,77 @@
+#ifndef CAFFE_SNAPSHOT_WRITER_HPP_
+#define CAFFE_SNAPSHOT_WRITER_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Writes solver snapshots in binary proto format on a thread of its
+ *        own.
+ *
+ * Stage copies the parameters of the net and the solver history into
+ * staging blobs and returns, leaving the serialization and the writing to
+ * the thread. Each file is written under a temporary name, synced to disk
+ * and renamed into place, the solver state last, so that a crash never
+ * leaves a partial snapshot behind. One snapshot is in flight at a time.
+ */
+template <typename Dtype>
+class SnapshotWriter : public InternalThread {
+ public:
+  /** The net must keep the layers and parameter shapes it has now. */
+  explicit SnapshotWriter(const Net<Dtype>& net);
+  virtual ~SnapshotWriter();
+
+  /**
+   * Copies the parameters of the net and the history into the staging blobs,
+   * and queues them for writing to model_filename and, with state and its
+   * learned_net and history set from them, to state_filename. The previous
+   * snapshot must have been written.
+   */
+  void Stage(const Net<Dtype>& net,
+      const vector<shared_ptr<Blob<Dtype> > >& history, const bool write_diff,
+      const SolverState& state, const string& model_filename,
+      const string& state_filename);
+
+  /** Whether a staged snapshot is still being written. */
+  bool busy() const;
+  /** Returns once the staged snapshot, if any, has been written. */
+  void Wait();
+
+ protected:
+  virtual void InternalThreadEntry();
+
+ private:
+  void Write();
+
+  // The layers of the net without their blobs
+  NetParameter net_param_;
+  // The staged parameters of each layer, and the staged history
+  vector<vector<shared_ptr<Blob<Dtype> > > > params_;
+  vector<shared_ptr<Blob<Dtype> > > history_;
+  bool write_diff_;
+  SolverState state_;
+  string model_filename_;
+  string state_filename_;
+
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+  shared_ptr<sync> sync_;
+  bool pending_;
+
+  DISABLE_COPY_AND_ASSIGN(SnapshotWriter);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_SNAPSHOT_WRITER_HPP_
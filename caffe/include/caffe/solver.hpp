@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "caffe/net.hpp"
+#include "caffe/snapshot_writer.hpp"
 
 namespace caffe {
 
@@ -83,6 +84,13 @@ class Solver {
   }
 
   void CheckSnapshotWritePermissions();
+  // Returns once the asynchronous snapshots, a deferred one included, have
+  // been written.
+  void WaitForSnapshot();
+  // Writes the learned net and the solver state, in binary proto format and
+  // whatever the snapshot settings, to the given files and syncs them to
+  // disk. Restore(state_filename) resumes from them.
+  void SnapshotTo(const string& model_filename, const string& state_filename);
 
  protected:
   // Make and apply the update value for the current iteration.
@@ -92,6 +100,14 @@ class Solver {
   // function that produces a SolverState protocol buffer that needs to be
   // written to disk together with the learned net.
   void Snapshot();
+  // Stages a snapshot for the snapshot writer, or defers it while the writer
+  // is busy.
+  void SnapshotAsync();
+  // The solver state blobs an asynchronous snapshot writes, or NULL if the
+  // solver cannot snapshot asynchronously.
+  virtual const vector<shared_ptr<Blob<Dtype> > >* SnapshotHistory() {
+    return NULL;
+  }
   string SnapshotFilename(const string extension);
   string SnapshotToBinaryProto();
   string SnapshotToHDF5();
@@ -121,6 +137,11 @@ class Solver {
   // True iff a request to stop early was received.
   bool requested_early_exit_;
 
+  // Writes the asynchronous snapshots, created by the first one
+  shared_ptr<SnapshotWriter<Dtype> > snapshot_writer_;
+  // True iff a snapshot is to be taken as soon as the writer is done.
+  bool snapshot_deferred_;
+
   DISABLE_COPY_AND_ASSIGN(Solver);
 };
 
@@ -170,7 +191,20 @@ class SGDSolver : public Solver<Dtype> {
   virtual void Regularize(int param_id);
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
   virtual void ClipGradients();
+  // The factor ClipGradients scales the gradients by, 1 to leave them be
+  Dtype GetClipScale();
+  // The L2 and L1 weight decay Regularize adds to the gradient of a param
+  void GetWeightDecay(int param_id, Dtype* l2_decay, Dtype* l1_decay);
+  // Solvers with a fused update apply it to each param in CPU mode in one
+  // pass, in place of clipping, Normalize, Regularize, ComputeUpdateValue
+  // and Net::Update; diff_scale combines the clipping and normalization.
+  virtual bool has_fused_update() const { return false; }
+  virtual void ComputeFusedUpdate(int param_id, Dtype rate,
+      Dtype diff_scale) {}
   virtual void SnapshotSolverState(const string& model_filename);
+  virtual const vector<shared_ptr<Blob<Dtype> > >* SnapshotHistory() {
+    return &history_;
+  }
   virtual void SnapshotSolverStateToBinaryProto(const string& model_filename);
   virtual void SnapshotSolverStateToHDF5(const string& model_filename);
   virtual void RestoreSolverStateFromHDF5(const string& state_file);
@@ -227,6 +261,8 @@ class RMSPropSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual bool has_fused_update() const { return true; }
+  virtual void ComputeFusedUpdate(int param_id, Dtype rate, Dtype diff_scale);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with RMSProp.";
@@ -250,6 +286,8 @@ class AdaDeltaSolver : public SGDSolver<Dtype> {
  protected:
   void AdaDeltaPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual bool has_fused_update() const { return true; }
+  virtual void ComputeFusedUpdate(int param_id, Dtype rate, Dtype diff_scale);
 
   DISABLE_COPY_AND_ASSIGN(AdaDeltaSolver);
 };
@@ -273,6 +311,8 @@ class AdamSolver : public SGDSolver<Dtype> {
  protected:
   void AdamPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual bool has_fused_update() const { return true; }
+  virtual void ComputeFusedUpdate(int param_id, Dtype rate, Dtype diff_scale);
 
   DISABLE_COPY_AND_ASSIGN(AdamSolver);
 };
@@ -4,6 +4,7 @@
 #include <cstdlib>
 
 #include "caffe/common.hpp"
+#include "caffe/util/host_allocator.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -13,7 +14,10 @@ namespace caffe {
 // The improvement in performance seems negligible in the single GPU case,
 // but might be more significant for parallel training. Most importantly,
 // it improved stability for large models on many GPUs.
-inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda) {
+// Otherwise it comes from the host allocator of Caffe, which is kept in
+// *allocator so the memory goes back to it from whichever thread frees it.
+inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda,
+    shared_ptr<HostAllocator>* allocator) {
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
     CUDA_CHECK(cudaMallocHost(ptr, size));
@@ -21,19 +25,20 @@ inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda) {
     return;
   }
 #endif
-  *ptr = malloc(size);
+  *allocator = Caffe::host_allocator();
+  *ptr = (*allocator)->Allocate(size);
   *use_cuda = false;
-  CHECK(*ptr) << "host allocation of size " << size << " failed";
 }
 
-inline void CaffeFreeHost(void* ptr, bool use_cuda) {
+inline void CaffeFreeHost(void* ptr, size_t size, bool use_cuda,
+    HostAllocator* allocator) {
 #ifndef CPU_ONLY
   if (use_cuda) {
     CUDA_CHECK(cudaFreeHost(ptr));
     return;
   }
 #endif
-  free(ptr);
+  allocator->Free(ptr, size);
 }
 
 
@@ -77,6 +82,7 @@ class SyncedMemory {
   SyncedHead head_;
   bool own_cpu_data_;
   bool cpu_malloc_use_cuda_;
+  shared_ptr<HostAllocator> cpu_allocator_;
   bool own_gpu_data_;
   int gpu_device_;
 
@@ -0,0 +1,49 @@
+#ifndef _CAFFE_UTIL_DIRECT_CONV_HPP_
+#define _CAFFE_UTIL_DIRECT_CONV_HPP_
+
+#include <cstddef>
+
+namespace caffe {
+
+// Shape of one image of a 2D convolution without padding or groups.
+struct DirectConvShape {
+  int channels;
+  int height;
+  int width;
+  int num_output;
+  int height_out;
+  int width_out;
+  int kernel_h;
+  int kernel_w;
+  int stride_h;
+  int stride_w;
+};
+
+// Direct convolution of num NCHW images on the CPU. The kernels keep a block
+// of channels of a few outputs in SIMD registers, with the widest vectors the
+// CPU supports, instead of unrolling the input with im2col. workspace must
+// hold direct_conv_workspace_size elements.
+template <typename Dtype>
+size_t direct_conv_workspace_size(const DirectConvShape& shape);
+
+template <typename Dtype>
+void direct_conv_forward_cpu(const DirectConvShape& shape, const Dtype* input,
+    const Dtype* weights, Dtype* output, const int num, Dtype* workspace);
+
+// Accumulates the weight gradient into weight_diff.
+template <typename Dtype>
+void direct_conv_backward_weights_cpu(const DirectConvShape& shape,
+    const Dtype* input, const Dtype* output_diff, Dtype* weight_diff,
+    const int num, Dtype* workspace);
+
+template <typename Dtype>
+void direct_conv_backward_data_cpu(const DirectConvShape& shape,
+    const Dtype* output_diff, const Dtype* weights, Dtype* input_diff,
+    const int num, Dtype* workspace);
+
+// Name of the instruction set the kernels use on this CPU.
+const char* direct_conv_instruction_set();
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_DIRECT_CONV_HPP_
@@ -0,0 +1,110 @@
+#ifndef CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+#define CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+
+#include <cstddef>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+// Alignment of every host allocation, enough for the widest SIMD loads.
+const size_t kHostAlignment = 64;
+// Size of a transparent huge page, the alignment of huge page backed blocks.
+const size_t kHugePageSize = 2 << 20;
+
+/**
+ * @brief Allocates the host memory of SyncedMemory in CPU mode.
+ *
+ * Every block is aligned to kHostAlignment. This one takes each block from
+ * the system and gives it back when freed; subclasses change that by
+ * overriding AllocateBlock and FreeBlock. The statistics are kept here, and
+ * all methods may be called from any thread.
+ */
+class HostAllocator {
+ public:
+  struct Stats {
+    Stats() : live_bytes(0), peak_bytes(0), cached_bytes(0),
+        allocations(0), reuses(0) {}
+    // Bytes requested by the blocks not freed yet
+    size_t live_bytes;
+    // The most live_bytes has been
+    size_t peak_bytes;
+    // Freed bytes the allocator keeps for reuse
+    size_t cached_bytes;
+    // Blocks allocated, and those of them served from the cache
+    size_t allocations;
+    size_t reuses;
+  };
+
+  HostAllocator();
+  virtual ~HostAllocator() {}
+
+  void* Allocate(size_t size);
+  /** Frees a block of Allocate(size). */
+  void Free(void* ptr, size_t size);
+  Stats stats() const;
+
+  /** Gives the cached blocks back to the system. */
+  virtual void Trim() {}
+
+  /**
+   * The allocator Caffe starts every thread with: a PooledHostAllocator
+   * shared by the whole process.
+   */
+  static const shared_ptr<HostAllocator>& Default();
+
+ protected:
+  /** Returns a block of size bytes, setting *reused if it was cached. */
+  virtual void* AllocateBlock(size_t size, bool* reused);
+  virtual void FreeBlock(void* ptr, size_t size);
+  virtual size_t cached_bytes() const { return 0; }
+
+ private:
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+
+  shared_ptr<sync> sync_;
+  Stats stats_;
+
+  DISABLE_COPY_AND_ASSIGN(HostAllocator);
+};
+
+/**
+ * @brief A HostAllocator that caches freed blocks by size class.
+ *
+ * Sizes are rounded up to four classes per power of two, multiples of
+ * kHostAlignment, so at most a quarter of a large block is wasted. A freed
+ * block waits in the list of its class for the next allocation of that
+ * class. Blocks beyond max_cached_bytes go back to the system. With
+ * huge_pages, blocks of at least kHugePageSize are aligned to it and advised
+ * to the kernel as transparent huge pages, where the system supports them.
+ */
+class PooledHostAllocator : public HostAllocator {
+ public:
+  PooledHostAllocator(size_t max_cached_bytes, bool huge_pages);
+  virtual ~PooledHostAllocator();
+
+  virtual void Trim();
+
+  /** The size of the blocks of the class of size. */
+  static size_t ClassSize(size_t size);
+
+ protected:
+  virtual void* AllocateBlock(size_t size, bool* reused);
+  virtual void FreeBlock(void* ptr, size_t size);
+  virtual size_t cached_bytes() const;
+
+ private:
+  class Pool;
+
+  const size_t max_cached_bytes_;
+  const bool huge_pages_;
+  shared_ptr<Pool> pool_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HOST_ALLOCATOR_HPP_
@@ -1,6 +1,8 @@
 #ifndef _CAFFE_UTIL_IM2COL_HPP_
 #define _CAFFE_UTIL_IM2COL_HPP_
 
+#include <stdint.h>
+
 namespace caffe {
 
 template <typename Dtype>
@@ -27,6 +29,28 @@ void col2im_cpu(const Dtype* data_col, const int channels,
     const int pad_h, const int pad_w, const int stride_h,
     const int stride_w, Dtype* data_im);
 
+// The batch versions lay out num images side by side: every row of data_col
+// holds the columns of image 0, then those of image 1, and so on.
+template <typename Dtype>
+void im2col_batch_cpu(const Dtype* data_im, const int num, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, Dtype* data_col);
+
+// Unrolls images of bytes, which are widened to scale * byte + shift.
+template <typename Dtype>
+void im2col_batch_cpu(const uint8_t* data_im, const Dtype scale,
+    const Dtype shift, const int num, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, Dtype* data_col);
+
+template <typename Dtype>
+void col2im_batch_cpu(const Dtype* data_col, const int num, const int channels,
+    const int height, const int width, const int patch_h, const int patch_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, Dtype* data_im);
+
 template <typename Dtype>
 void im2col_nd_gpu(const Dtype* data_im, const int num_spatial_axes,
     const int col_size, const int* im_shape, const int* col_shape,
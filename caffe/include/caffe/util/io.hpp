@@ -1,6 +1,7 @@
 #ifndef CAFFE_UTIL_IO_H_
 #define CAFFE_UTIL_IO_H_
 
+#include <boost/function.hpp>
 #include <unistd.h>
 #include <string>
 
@@ -81,6 +82,21 @@ inline void WriteProtoToBinaryFile(
   WriteProtoToBinaryFile(proto, filename.c_str());
 }
 
+// Syncs directory to disk, which makes the files created, renamed or removed
+// in it durable.
+void SyncDirectory(const string& directory);
+
+// Calls writer with a descriptor of filename.tmp, then syncs the file to
+// disk, renames it to filename and syncs the directory, so that filename is
+// either left as it was or holds everything written, even after a crash.
+// writer returns false if it failed.
+void WriteFileDurably(const string& filename,
+    const boost::function<bool(int)>& writer);
+
+// Writes proto with WriteFileDurably.
+void WriteProtoToBinaryFileDurably(const Message& proto,
+    const string& filename);
+
 bool ReadFileToDatum(const string& filename, const int label, Datum* datum);
 
 inline bool ReadFileToDatum(const string& filename, Datum* datum) {
@@ -145,6 +145,53 @@ DEFINE_CAFFE_CPU_UNARY_FUNC(fabs, y[i] = std::fabs(x[i]));
 template <typename Dtype>
 void caffe_cpu_scale(const int n, const Dtype alpha, const Dtype *x, Dtype* y);
 
+// Adds bias[c], or nothing if bias is NULL, to the inner values of each
+// channel c of the num items of data and applies a ReLU with the given
+// negative slope, in one pass over data.
+template <typename Dtype>
+void caffe_cpu_bias_relu(const int num, const int channels, const int inner,
+    const Dtype* bias, const Dtype negative_slope, Dtype* data);
+
+// Backward of caffe_cpu_bias_relu from its output data: scales diff in place
+// by the slope of the ReLU and adds the sum of the scaled diff of each
+// channel to bias_diff, unless it is NULL.
+template <typename Dtype>
+void caffe_cpu_bias_relu_backward(const int num, const int channels,
+    const int inner, const Dtype* data, const Dtype negative_slope,
+    Dtype* diff, Dtype* bias_diff);
+
+// Solver updates in one pass over the n values of a parameter: the gradient
+// g = diff_scale * diff + l2_decay * data + l1_decay * sign(data) updates the
+// histories, and the resulting update is left in diff and subtracted from
+// data, as Net::Update would.
+
+// RMSProp: history = rms_decay * history + (1 - rms_decay) * g^2 and
+// update = rate * g / (sqrt(history) + delta).
+template <typename Dtype>
+void caffe_cpu_rmsprop_update(const int n, const Dtype diff_scale,
+    const Dtype l2_decay, const Dtype l1_decay, const Dtype rms_decay,
+    const Dtype delta, const Dtype rate, Dtype* data, Dtype* diff,
+    Dtype* history);
+
+// AdaDelta: grad_history = momentum * grad_history + (1 - momentum) * g^2,
+// u = g * sqrt((update_history + delta) / (grad_history + delta)),
+// update_history = momentum * update_history + (1 - momentum) * u^2 and
+// update = rate * u.
+template <typename Dtype>
+void caffe_cpu_adadelta_update(const int n, const Dtype diff_scale,
+    const Dtype l2_decay, const Dtype l1_decay, const Dtype momentum,
+    const Dtype delta, const Dtype rate, Dtype* data, Dtype* diff,
+    Dtype* grad_history, Dtype* update_history);
+
+// Adam: m = beta1 * m + (1 - beta1) * g, v = beta2 * v + (1 - beta2) * g^2
+// and update = rate * m / (sqrt(v) + eps_hat), where rate includes the bias
+// correction.
+template <typename Dtype>
+void caffe_cpu_adam_update(const int n, const Dtype diff_scale,
+    const Dtype l2_decay, const Dtype l1_decay, const Dtype beta1,
+    const Dtype beta2, const Dtype eps_hat, const Dtype rate, Dtype* data,
+    Dtype* diff, Dtype* m, Dtype* v);
+
 #ifndef CPU_ONLY  // GPU
 
 // Decaf gpu gemm provides an interface that is almost the same as the cpu
@@ -253,6 +300,16 @@ void caffe_gpu_fabs(const int n, const Dtype* x, Dtype* y);
 template <typename Dtype>
 void caffe_gpu_scale(const int n, const Dtype alpha, const Dtype *x, Dtype* y);
 
+template <typename Dtype>
+void caffe_gpu_bias_relu(const int num, const int channels, const int inner,
+    const Dtype* bias, const Dtype negative_slope, Dtype* data);
+
+// Scales diff in place by the slope of the ReLU whose output is data; the
+// bias gradient is left to the caller.
+template <typename Dtype>
+void caffe_gpu_relu_backward(const int n, const Dtype* data,
+    const Dtype negative_slope, Dtype* diff);
+
 #define DEFINE_AND_INSTANTIATE_GPU_UNARY_FUNC(name, operation) \
 template<typename Dtype> \
 __global__ void name##_kernel(const int n, const Dtype* x, Dtype* y) { \
@@ -0,0 +1,81 @@
+#ifndef CAFFE_UTIL_THREAD_POOL_HPP_
+#define CAFFE_UTIL_THREAD_POOL_HPP_
+
+#include <boost/function.hpp>
+#include <boost/ref.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+/**
+ Forward declare boost::thread instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class thread; }
+
+namespace caffe {
+
+// Elements an element-wise loop must have per thread to be worth splitting.
+const int kParallelGrain = 1 << 15;
+
+/**
+ * Threads that run the CPU kernels' loops together with the calling thread.
+ * The pool runs one loop at a time: a thread calling For while another loop
+ * is running runs its own loop serially instead of waiting.
+ *
+ * The loop bodies run on threads without a Caffe context, so they must not
+ * call Caffe::Get(), which rules out the math_functions wrappers.
+ */
+class ThreadPool {
+ public:
+  /** Starts num_threads - 1 threads; the calling thread is the last one. */
+  explicit ThreadPool(const int num_threads);
+  ~ThreadPool();
+
+  int num_threads() const { return num_threads_; }
+
+  /**
+   * Calls body(begin, end) on disjoint ranges covering [0, n), of at least
+   * grain items each, and returns once all of them are done.
+   */
+  void For(const int n, const int grain,
+      const boost::function<void(int, int)>& body);
+
+ private:
+  class State;
+
+  void WorkerEntry(const int index);
+
+  const int num_threads_;
+  shared_ptr<State> state_;
+  vector<shared_ptr<boost::thread> > threads_;
+
+  DISABLE_COPY_AND_ASSIGN(ThreadPool);
+};
+
+/**
+ * Runs body(begin, end) over [0, n) on the thread pool of Caffe, or serially
+ * without one or with fewer than 2 * grain items.
+ */
+template <typename Body>
+void caffe_parallel_for(const int n, const int grain, const Body& body) {
+  ThreadPool* pool = Caffe::thread_pool().get();
+  if (pool == NULL || n < 2 * grain) {
+    if (n > 0) {
+      body(0, n);
+    }
+    return;
+  }
+  pool->For(n, grain, boost::cref(body));
+}
+
+/** The grain of a loop whose items each touch cost elements. */
+inline int caffe_parallel_grain(const int cost) {
+  return std::max(1, kParallelGrain / std::max(1, cost));
+}
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_THREAD_POOL_HPP_
@@ -13,6 +13,7 @@
 #include "caffe/loss_layers.hpp"
 #include "caffe/neuron_layers.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/direct_conv.hpp"
 
 namespace caffe {
 
@@ -33,19 +34,38 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   virtual inline int MinBottomBlobs() const { return 1; }
   virtual inline int MinTopBlobs() const { return 1; }
   virtual inline bool EqualNumBottomTopBlobs() const { return true; }
+  /// @brief Byte input has no gradient.
+  virtual inline bool AllowForceBackward(const int bottom_index) const {
+    return !byte_input_;
+  }
 
  protected:
   // Helper functions that abstract away the column buffer and gemm arguments.
-  // The last argument in forward_cpu_gemm is so that we can skip the im2col if
-  // we just called weight_cpu_gemm with the same input.
+  // The skip_im2col arguments are so that we can skip the im2col if we just
+  // called weight_cpu_gemm with the same input, or unrolled byte input with
+  // byte_im2col_cpu.
   void forward_cpu_gemm(const Dtype* input, const Dtype* weights,
       Dtype* output, bool skip_im2col = false);
   void forward_cpu_bias(Dtype* output, const Dtype* bias);
   void backward_cpu_gemm(const Dtype* input, const Dtype* weights,
       Dtype* output);
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
-      weights);
+      weights, bool skip_im2col = false);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
+  // Batched versions of the gemm helpers for num <= cpu_batch_ consecutive
+  // images, which share one im2col buffer and one gemm per group. The last
+  // argument in backward_cpu_gemm_batch skips gathering output if we just
+  // called weight_cpu_gemm_batch with the same output.
+  void forward_cpu_gemm_batch(const Dtype* input, const Dtype* weights,
+      Dtype* output, const int num, bool skip_im2col = false);
+  void backward_cpu_gemm_batch(const Dtype* output, const Dtype* weights,
+      Dtype* input, const int num, bool skip_gather = false);
+  void weight_cpu_gemm_batch(const Dtype* input, const Dtype* output,
+      Dtype* weights, const int num, bool skip_im2col = false);
+  // Unrolls num consecutive images of byte input into the column buffer, in
+  // the layout of the batched helpers, which for one image is that of the
+  // others.
+  void byte_im2col_cpu(const uint8_t* input, const int num);
 
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -96,6 +116,17 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   bool bias_term_;
   bool is_1x1_;
   bool force_nd_im2col_;
+  /// @brief Whether the bottom holds bytes, read as
+  ///        input_scale_ * byte + input_shift_.
+  bool byte_input_;
+  Dtype input_scale_;
+  Dtype input_shift_;
+  /// @brief Whether a ReLU is applied to the output with the bias.
+  bool relu_;
+  Dtype relu_negative_slope_;
+  /// @brief The number of images the batched CPU helpers may take; 1 when
+  ///        they are not available.
+  int cpu_batch_;
 
  private:
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
@@ -125,6 +156,26 @@ class BaseConvolutionLayer : public Layer<Dtype> {
           pad_.cpu_data(), stride_.cpu_data(), data);
     }
   }
+  inline void conv_im2col_batch_cpu(const Dtype* data, const int num,
+      Dtype* col_buff) {
+    im2col_batch_cpu(data, num, conv_in_channels_,
+        conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
+        kernel_shape_.cpu_data()[0], kernel_shape_.cpu_data()[1],
+        pad_.cpu_data()[0], pad_.cpu_data()[1],
+        stride_.cpu_data()[0], stride_.cpu_data()[1], col_buff);
+  }
+  inline void conv_col2im_batch_cpu(const Dtype* col_buff, const int num,
+      Dtype* data) {
+    col2im_batch_cpu(col_buff, num, conv_in_channels_,
+        conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
+        kernel_shape_.cpu_data()[0], kernel_shape_.cpu_data()[1],
+        pad_.cpu_data()[0], pad_.cpu_data()[1],
+        stride_.cpu_data()[0], stride_.cpu_data()[1], data);
+  }
+  // Move output between the per-image layout and the channel-major layout
+  // of the batched gemms.
+  void gather_batch_output_cpu(const Dtype* output, const int num);
+  void scatter_batch_output_cpu(Dtype* output, const int num);
 #ifndef CPU_ONLY
   inline void conv_im2col_gpu(const Dtype* data, Dtype* col_buff) {
     if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
@@ -166,6 +217,7 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   int output_offset_;
 
   Blob<Dtype> col_buffer_;
+  Blob<Dtype> batch_output_buffer_;
   Blob<Dtype> bias_multiplier_;
 };
 
@@ -213,8 +265,12 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
    *  first group and input channels 3-4 and output channels 5-8 into the second
    *  group.
    *  - bias_term (\b optional, default true). Whether to have a bias.
-   *  - engine: convolution has CAFFE (matrix multiplication) and CUDNN (library
-   *    kernels + stream parallelism) engines.
+   *  - engine: convolution has CAFFE (matrix multiplication), CUDNN (library
+   *    kernels + stream parallelism) and DIRECT (SIMD kernels on the CPU)
+   *    engines.
+   *  - byte_input (\b optional, default false). Whether the bottom holds
+   *  bytes, e.g. raw frames from a ByteMemoryDataLayer, which are read as
+   *  input_scale * byte + input_shift while being unrolled by im2col.
    */
   explicit ConvolutionLayer(const LayerParameter& param)
       : BaseConvolutionLayer<Dtype>(param) {}
@@ -232,6 +288,12 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual inline bool reverse_dimensions() { return false; }
   virtual void compute_output_shape();
+
+#ifndef CPU_ONLY
+  /// @brief Widens the byte input on the GPU, which has no byte im2col.
+  const Dtype* widened_input_gpu(const Blob<Dtype>& bottom);
+#endif
+  Blob<Dtype> widened_input_;
 };
 
 /**
@@ -269,6 +331,36 @@ class DeconvolutionLayer : public BaseConvolutionLayer<Dtype> {
   virtual void compute_output_shape();
 };
 
+/**
+ * @brief Direct CPU implementation of ConvolutionLayer.
+ *        Falls back to ConvolutionLayer for the GPU, padding, groups, byte
+ *        input and N-D convolution.
+ *
+ *   Instead of unrolling the input with im2col, the kernels keep a block of
+ *   output channels of a few neighbouring outputs in SIMD registers and
+ *   broadcast each input value against them (see util/direct_conv.hpp).
+ *   This avoids the im2col buffer and its memory traffic, which dominate the
+ *   small strided convolutions of Atari networks.
+ */
+template <typename Dtype>
+class DirectConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit DirectConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param), direct_(false) {}
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  bool direct_;
+  DirectConvShape shape_;
+  Blob<Dtype> workspace_;
+};
+
 #ifdef USE_CUDNN
 /*
  * @brief cuDNN implementation of ConvolutionLayer.
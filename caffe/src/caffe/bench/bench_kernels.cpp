@@ -0,0 +1,436 @@
+// Benchmarks the CPU kernels behind the DQN nets over sweeps of shapes and
+// thread counts, and checks the results against a baseline.
+//
+//     bench_kernels [-shapes <file>] [-threads 1,2,4] [-filter gemm]
+//                   [-save_baseline <file>] [-baseline <file>]
+//                   [-threshold 0.1]
+//
+// Each line of a shapes file names a kernel and its shape; # starts a
+// comment. Without -shapes the DQN shapes of kDefaultShapes are run.
+//
+//     im2col <channels> <height> <width> <kernel> <stride> [<num>]
+//     gemm <M> <N> <K>
+//     relu_forward <count>        relu_backward <count>
+//     eltwise_sum <count>         eltwise_prod <count>   eltwise_max <count>
+//     rmsprop <count>             adadelta <count>       adam <count>
+//
+// A baseline file holds one "<benchmark> <ns/op>" line per benchmark. With
+// -baseline, the run fails when a benchmark takes more than threshold times
+// longer than its baseline.
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "boost/algorithm/string.hpp"
+#include "boost/lexical_cast.hpp"
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/common_layers.hpp"
+#include "caffe/neuron_layers.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/im2col.hpp"
+#include "caffe/util/math_functions.hpp"
+
+using caffe::Blob;
+using caffe::Caffe;
+using caffe::shared_ptr;
+using caffe::string;
+using caffe::vector;
+
+DEFINE_string(shapes, "",
+    "Optional; the file of kernel shapes to run instead of the DQN ones.");
+DEFINE_string(threads, "1",
+    "Optional; the numbers of CPU threads to run each kernel with, "
+    "separated by ','.");
+DEFINE_string(filter, "",
+    "Optional; run only the benchmarks whose name contains this.");
+DEFINE_int32(min_time_ms, 200,
+    "Optional; the least time to spend running each benchmark.");
+DEFINE_int32(repeats, 5,
+    "Optional; the number of samples taken of each benchmark, of which the "
+    "fastest is reported.");
+DEFINE_string(baseline, "",
+    "Optional; the baseline file to check the results against.");
+DEFINE_double(threshold, 0.1,
+    "Optional; the slowdown over the baseline, as a fraction, beyond which a "
+    "benchmark fails.");
+DEFINE_string(save_baseline, "",
+    "Optional; the file to write the results to as a baseline.");
+
+// The shapes of the DQN of models/fast_dqn.prototxt at a minibatch of 32:
+// 4x84x84 frames, conv1 32x8x8/4, conv2 64x4x4/2, ip1 256 and ip2 18 outputs.
+const char* kDefaultShapes =
+    "im2col 4 84 84 8 4\n"
+    "im2col 4 84 84 8 4 32\n"
+    "im2col 32 20 20 4 2 32\n"
+    // conv1 and conv2 over the whole minibatch, ip1 and ip2
+    "gemm 32 12800 256\n"
+    "gemm 64 2592 512\n"
+    "gemm 32 256 5184\n"
+    "gemm 32 18 256\n"
+    "gemm 256 256 256\n"
+    // The conv1, conv2 and ip1 activations
+    "relu_forward 409600\n"
+    "relu_backward 409600\n"
+    "relu_forward 165888\n"
+    "relu_backward 165888\n"
+    "relu_forward 8192\n"
+    "relu_backward 8192\n"
+    "eltwise_sum 409600\n"
+    "eltwise_prod 409600\n"
+    "eltwise_max 409600\n"
+    // The ip1 and conv2 parameters
+    "rmsprop 1327360\n"
+    "rmsprop 32832\n"
+    "adadelta 1327360\n"
+    "adadelta 32832\n"
+    "adam 1327360\n"
+    "adam 32832\n";
+
+// A kernel set up for one shape, run over and over
+class Kernel {
+ public:
+  Kernel() : flops_(0), bytes_(0) {}
+  virtual ~Kernel() {}
+  virtual void Run() = 0;
+
+  // Estimated work of one run: arithmetic operations, and bytes read or
+  // written
+  double flops() const { return flops_; }
+  double bytes() const { return bytes_; }
+
+ protected:
+  // Gives the blob uniform random values in [-1, 1)
+  static void Fill(Blob<float>* blob) {
+    caffe::caffe_rng_uniform<float>(blob->count(), -1, 1,
+                                    blob->mutable_cpu_data());
+    caffe::caffe_rng_uniform<float>(blob->count(), -1, 1,
+                                    blob->mutable_cpu_diff());
+  }
+
+  double flops_;
+  double bytes_;
+};
+
+class Im2colKernel : public Kernel {
+ public:
+  Im2colKernel(const int channels, const int height, const int width,
+               const int kernel, const int stride, const int num)
+      : channels_(channels), height_(height), width_(width), kernel_(kernel),
+        stride_(stride), num_(num) {
+    const int out_h = (height - kernel) / stride + 1;
+    const int out_w = (width - kernel) / stride + 1;
+    image_.Reshape(num, channels, height, width);
+    col_.Reshape(1, channels * kernel * kernel, num * out_h, out_w);
+    Fill(&image_);
+    bytes_ = (image_.count() + col_.count()) * sizeof(float);
+  }
+
+  virtual void Run() {
+    if (num_ == 1) {
+      caffe::im2col_cpu(image_.cpu_data(), channels_, height_, width_,
+          kernel_, kernel_, 0, 0, stride_, stride_, col_.mutable_cpu_data());
+    } else {
+      caffe::im2col_batch_cpu(image_.cpu_data(), num_, channels_, height_,
+          width_, kernel_, kernel_, 0, 0, stride_, stride_,
+          col_.mutable_cpu_data());
+    }
+  }
+
+ private:
+  const int channels_, height_, width_, kernel_, stride_, num_;
+  Blob<float> image_;
+  Blob<float> col_;
+};
+
+class GemmKernel : public Kernel {
+ public:
+  GemmKernel(const int M, const int N, const int K)
+      : M_(M), N_(N), K_(K), a_(1, 1, M, K), b_(1, 1, K, N), c_(1, 1, M, N) {
+    Fill(&a_);
+    Fill(&b_);
+    flops_ = 2.0 * M * N * K;
+    bytes_ = (a_.count() + b_.count() + c_.count()) * sizeof(float);
+  }
+
+  virtual void Run() {
+    caffe::caffe_cpu_gemm<float>(CblasNoTrans, CblasNoTrans, M_, N_, K_, 1,
+        a_.cpu_data(), b_.cpu_data(), 0, c_.mutable_cpu_data());
+  }
+
+ private:
+  const int M_, N_, K_;
+  Blob<float> a_;
+  Blob<float> b_;
+  Blob<float> c_;
+};
+
+// Runs the forward or backward pass of a layer from one bottom, or two for
+// Eltwise, to one top blob of count values
+class LayerKernel : public Kernel {
+ public:
+  LayerKernel(caffe::Layer<float>* layer, const int num_bottoms,
+              const int count, const bool backward)
+      : layer_(layer), top_(1, 1, 1, count), backward_(backward),
+        propagate_down_(num_bottoms, true) {
+    for (int i = 0; i < num_bottoms; ++i) {
+      bottoms_.push_back(shared_ptr<Blob<float> >(
+          new Blob<float>(1, 1, 1, count)));
+      Fill(bottoms_.back().get());
+      bottom_vec_.push_back(bottoms_.back().get());
+    }
+    top_vec_.push_back(&top_);
+    layer_->SetUp(bottom_vec_, top_vec_);
+    layer_->Forward(bottom_vec_, top_vec_);
+    Fill(&top_);
+    // One operation per output, reading the inputs and writing the output,
+    // or reading them and the output diff and writing the input diffs
+    flops_ = static_cast<double>(count) * num_bottoms;
+    bytes_ = static_cast<double>(count) * sizeof(float) *
+        (backward ? 2 * num_bottoms + 1 : num_bottoms + 1);
+  }
+
+  virtual void Run() {
+    if (backward_) {
+      layer_->Backward(top_vec_, propagate_down_, bottom_vec_);
+    } else {
+      layer_->Forward(bottom_vec_, top_vec_);
+    }
+  }
+
+ private:
+  shared_ptr<caffe::Layer<float> > layer_;
+  vector<shared_ptr<Blob<float> > > bottoms_;
+  Blob<float> top_;
+  vector<Blob<float>*> bottom_vec_;
+  vector<Blob<float>*> top_vec_;
+  const bool backward_;
+  const vector<bool> propagate_down_;
+};
+
+// The fused update of one parameter blob by a solver
+class UpdateKernel : public Kernel {
+ public:
+  UpdateKernel(const string& solver, const int count)
+      : solver_(solver), param_(1, 1, 1, count), history_(1, 1, 1, count),
+        gradient_(1, 1, 1, count) {
+    Fill(&param_);
+    caffe::caffe_set(count, 0.5f, history_.mutable_cpu_data());
+    caffe::caffe_set(count, 0.5f, history_.mutable_cpu_diff());
+    caffe::caffe_rng_uniform<float>(count, -1, 1,
+                                    gradient_.mutable_cpu_data());
+    // Operations per value, counting square roots and divisions as one
+    const int ops = solver == "rmsprop" ? 12 : solver == "adadelta" ? 18 : 16;
+    const int arrays = solver == "rmsprop" ? 3 : 4;
+    flops_ = static_cast<double>(count) * ops;
+    bytes_ = 2.0 * count * arrays * sizeof(float);
+  }
+
+  virtual void Run() {
+    const int n = param_.count();
+    // Keep the diff, which the update overwrites, as it was
+    caffe::caffe_copy(n, gradient_.cpu_data(), param_.mutable_cpu_diff());
+    if (solver_ == "rmsprop") {
+      caffe::caffe_cpu_rmsprop_update<float>(n, 1, 0.0005f, 0, 0.98f, 1e-8f,
+          0.01f, param_.mutable_cpu_data(), param_.mutable_cpu_diff(),
+          history_.mutable_cpu_data());
+    } else if (solver_ == "adadelta") {
+      caffe::caffe_cpu_adadelta_update<float>(n, 1, 0.0005f, 0, 0.95f, 1e-6f,
+          0.1f, param_.mutable_cpu_data(), param_.mutable_cpu_diff(),
+          history_.mutable_cpu_data(), history_.mutable_cpu_diff());
+    } else {
+      caffe::caffe_cpu_adam_update<float>(n, 1, 0.0005f, 0, 0.9f, 0.999f,
+          1e-8f, 0.001f, param_.mutable_cpu_data(), param_.mutable_cpu_diff(),
+          history_.mutable_cpu_data(), history_.mutable_cpu_diff());
+    }
+  }
+
+ private:
+  const string solver_;
+  Blob<float> param_;
+  // The histories, in the data and diff of history_
+  Blob<float> history_;
+  // The gradient fed to every update
+  Blob<float> gradient_;
+};
+
+Kernel* CreateKernel(const string& type, const vector<int>& args) {
+  if (type == "im2col") {
+    CHECK(args.size() == 5 || args.size() == 6) << "im2col takes channels, "
+        "height, width, kernel, stride and optionally num";
+    return new Im2colKernel(args[0], args[1], args[2], args[3], args[4],
+                            args.size() == 6 ? args[5] : 1);
+  }
+  if (type == "gemm") {
+    CHECK_EQ(args.size(), 3) << "gemm takes M, N and K";
+    return new GemmKernel(args[0], args[1], args[2]);
+  }
+  CHECK_EQ(args.size(), 1) << type << " takes a count";
+  caffe::LayerParameter param;
+  if (type == "relu_forward" || type == "relu_backward") {
+    return new LayerKernel(new caffe::ReLULayer<float>(param), 1, args[0],
+                           type == "relu_backward");
+  }
+  if (type == "eltwise_sum" || type == "eltwise_prod" ||
+      type == "eltwise_max") {
+    param.mutable_eltwise_param()->set_operation(
+        type == "eltwise_sum" ? caffe::EltwiseParameter_EltwiseOp_SUM :
+        type == "eltwise_prod" ? caffe::EltwiseParameter_EltwiseOp_PROD :
+        caffe::EltwiseParameter_EltwiseOp_MAX);
+    return new LayerKernel(new caffe::EltwiseLayer<float>(param), 2, args[0],
+                           false);
+  }
+  if (type == "rmsprop" || type == "adadelta" || type == "adam") {
+    return new UpdateKernel(type, args[0]);
+  }
+  LOG(FATAL) << "Unknown kernel " << type;
+  return NULL;
+}
+
+struct Shape {
+  string type;
+  vector<int> args;
+
+  string Name() const {
+    std::ostringstream name;
+    name << type << "/";
+    for (int i = 0; i < args.size(); ++i) {
+      name << (i ? "x" : "") << args[i];
+    }
+    return name.str();
+  }
+};
+
+vector<Shape> ParseShapes(std::istream& input) {
+  vector<Shape> shapes;
+  string line;
+  while (std::getline(input, line)) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream fields(line);
+    Shape shape;
+    if (!(fields >> shape.type)) {
+      continue;
+    }
+    int arg;
+    while (fields >> arg) {
+      shape.args.push_back(arg);
+    }
+    CHECK(fields.eof()) << "Bad shape: " << line;
+    shapes.push_back(shape);
+  }
+  return shapes;
+}
+
+// Returns the fastest of FLAGS_repeats samples of the time of one run, in
+// nanoseconds
+double TimeKernel(Kernel* kernel) {
+  caffe::CPUTimer timer;
+  // Warm up, and find how many runs take FLAGS_min_time_ms in all
+  timer.Start();
+  kernel->Run();
+  const double first_ms = std::max(timer.MicroSeconds() / 1000, 1e-3f);
+  const int runs = std::max(1, static_cast<int>(
+      FLAGS_min_time_ms / FLAGS_repeats / first_ms));
+  double best_ns = 0;
+  for (int r = 0; r < FLAGS_repeats; ++r) {
+    timer.Start();
+    for (int i = 0; i < runs; ++i) {
+      kernel->Run();
+    }
+    const double ns = timer.MicroSeconds() * 1000 / runs;
+    best_ns = r == 0 ? ns : std::min(best_ns, ns);
+  }
+  return best_ns;
+}
+
+std::map<string, double> ReadBaseline(const string& path) {
+  std::ifstream file(path.c_str());
+  CHECK(file) << "Cannot open " << path;
+  std::map<string, double> baseline;
+  string name;
+  double ns;
+  while (file >> name >> ns) {
+    baseline[name] = ns;
+  }
+  CHECK(file.eof()) << "Bad baseline " << path;
+  return baseline;
+}
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;
+  gflags::SetUsageMessage("benchmark the CPU kernels\n"
+      "usage: bench_kernels <args>");
+  caffe::GlobalInit(&argc, &argv);
+  Caffe::set_mode(Caffe::CPU);
+  CHECK_GT(FLAGS_repeats, 0);
+
+  vector<Shape> shapes;
+  if (FLAGS_shapes.size()) {
+    std::ifstream file(FLAGS_shapes.c_str());
+    CHECK(file) << "Cannot open " << FLAGS_shapes;
+    shapes = ParseShapes(file);
+  } else {
+    std::istringstream defaults(kDefaultShapes);
+    shapes = ParseShapes(defaults);
+  }
+  vector<string> thread_counts;
+  boost::split(thread_counts, FLAGS_threads, boost::is_any_of(","));
+  std::map<string, double> baseline;
+  if (FLAGS_baseline.size()) {
+    baseline = ReadBaseline(FLAGS_baseline);
+  }
+
+  std::ofstream save;
+  if (FLAGS_save_baseline.size()) {
+    save.open(FLAGS_save_baseline.c_str());
+    CHECK(save) << "Cannot open " << FLAGS_save_baseline;
+  }
+  printf("%-32s %12s %10s %10s %10s\n", "benchmark", "ns/op", "GFLOP/s",
+         "GB/s", "baseline");
+  int regressions = 0;
+  for (int t = 0; t < thread_counts.size(); ++t) {
+    const int threads = boost::lexical_cast<int>(thread_counts[t]);
+    Caffe::set_cpu_threads(threads);
+    for (int i = 0; i < shapes.size(); ++i) {
+      const string name = shapes[i].Name() + "/t" + thread_counts[t];
+      if (name.find(FLAGS_filter) == string::npos) {
+        continue;
+      }
+      shared_ptr<Kernel> kernel(CreateKernel(shapes[i].type, shapes[i].args));
+      const double ns = TimeKernel(kernel.get());
+      string change = "-";
+      const std::map<string, double>::const_iterator base =
+          baseline.find(name);
+      if (base != baseline.end()) {
+        const double ratio = ns / base->second;
+        change = boost::lexical_cast<string>(
+            static_cast<int>((ratio - 1) * 1000) / 10.0) + "%";
+        if (ratio > 1 + FLAGS_threshold) {
+          LOG(ERROR) << name << " regressed from " << base->second
+              << " to " << ns << " ns/op";
+          ++regressions;
+        }
+      }
+      printf("%-32s %12.0f %10.3f %10.3f %10s\n", name.c_str(), ns,
+             kernel->flops() / ns, kernel->bytes() / ns, change.c_str());
+      fflush(stdout);
+      if (save.is_open()) {
+        save << name << " " << ns << "\n";
+      }
+    }
+  }
+  if (regressions) {
+    LOG(ERROR) << regressions << " benchmarks regressed by more than "
+        << FLAGS_threshold * 100 << "%";
+    return 1;
+  }
+  return 0;
+}
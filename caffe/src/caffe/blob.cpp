@@ -138,6 +138,12 @@ void Blob<Dtype>::ShareData(const Blob& other) {
   data_ = other.data();
 }
 
+template <typename Dtype>
+void Blob<Dtype>::set_data_memory(const shared_ptr<SyncedMemory>& memory) {
+  CHECK_GE(memory->size(), capacity_ * sizeof(Dtype));
+  data_ = memory;
+}
+
 template <typename Dtype>
 void Blob<Dtype>::ShareDiff(const Blob& other) {
   CHECK_EQ(count_, other.count());
@@ -5,7 +5,9 @@
 #include <ctime>
 
 #include "caffe/common.hpp"
+#include "caffe/util/host_allocator.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -49,11 +51,26 @@ void GlobalInit(int* pargc, char*** pargv) {
   ::google::InstallFailureSignalHandler();
 }
 
+void Caffe::set_cpu_threads(const int num_threads) {
+  CHECK_GE(num_threads, 1);
+  if (num_threads == 1) {
+    Get().thread_pool_.reset();
+  } else {
+    Get().thread_pool_.reset(new ThreadPool(num_threads));
+  }
+}
+
+void Caffe::set_host_allocator(const shared_ptr<HostAllocator>& allocator) {
+  CHECK(allocator);
+  Get().host_allocator_ = allocator;
+}
+
 #ifdef CPU_ONLY  // CPU-only Caffe.
 
 Caffe::Caffe()
     : random_generator_(), mode_(Caffe::CPU),
-      solver_count_(1), root_solver_(true) { }
+      solver_count_(1), root_solver_(true),
+      host_allocator_(HostAllocator::Default()) { }
 
 Caffe::~Caffe() { }
 
@@ -97,7 +114,8 @@ void* Caffe::RNG::generator() {
 
 Caffe::Caffe()
     : cublas_handle_(NULL), curand_generator_(NULL), random_generator_(),
-    mode_(Caffe::CPU), solver_count_(1), root_solver_(true) {
+    mode_(Caffe::CPU), solver_count_(1), root_solver_(true),
+    host_allocator_(HostAllocator::Default()) {
   // Try to create a cublas handler, and report an error if failed (but we will
   // keep the program running as one might just want to run CPU code).
   if (cublasCreate(&cublas_handle_) != CUBLAS_STATUS_SUCCESS) {
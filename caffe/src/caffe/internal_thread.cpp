@@ -29,17 +29,21 @@ void InternalThread::StartInternalThread() {
   int rand_seed = caffe_rng_rand();
   int solver_count = Caffe::solver_count();
   bool root_solver = Caffe::root_solver();
+  shared_ptr<ThreadPool> thread_pool = Caffe::thread_pool();
+  shared_ptr<HostAllocator> host_allocator = Caffe::host_allocator();
 
   try {
     thread_.reset(new boost::thread(&InternalThread::entry, this, device, mode,
-          rand_seed, solver_count, root_solver));
+          rand_seed, solver_count, root_solver, thread_pool,
+          host_allocator));
   } catch (std::exception& e) {
     LOG(FATAL) << "Thread exception: " << e.what();
   }
 }
 
 void InternalThread::entry(int device, Caffe::Brew mode, int rand_seed,
-    int solver_count, bool root_solver) {
+    int solver_count, bool root_solver, shared_ptr<ThreadPool> thread_pool,
+    shared_ptr<HostAllocator> host_allocator) {
 #ifndef CPU_ONLY
   CUDA_CHECK(cudaSetDevice(device));
 #endif
@@ -47,6 +51,8 @@ void InternalThread::entry(int device, Caffe::Brew mode, int rand_seed,
   Caffe::set_random_seed(rand_seed);
   Caffe::set_solver_count(solver_count);
   Caffe::set_root_solver(root_solver);
+  Caffe::set_thread_pool(thread_pool);
+  Caffe::set_host_allocator(host_allocator);
 
   InternalThreadEntry();
 }
@@ -27,8 +27,20 @@ shared_ptr<Layer<Dtype> > GetConvolutionLayer(
     engine = ConvolutionParameter_Engine_CUDNN;
 #endif
   }
+#ifdef USE_CUDNN
+  if (engine == ConvolutionParameter_Engine_CUDNN &&
+      (param.convolution_param().byte_input() ||
+       param.convolution_param().relu())) {
+    LOG(INFO) << "CUDNN does not support byte input or a fused ReLU. "
+              << "Using Caffe's own convolution layer.";
+    engine = ConvolutionParameter_Engine_CAFFE;
+  }
+#endif
   if (engine == ConvolutionParameter_Engine_CAFFE) {
     return shared_ptr<Layer<Dtype> >(new ConvolutionLayer<Dtype>(param));
+  } else if (engine == ConvolutionParameter_Engine_DIRECT) {
+    return shared_ptr<Layer<Dtype> >(
+        new DirectConvolutionLayer<Dtype>(param));
 #ifdef USE_CUDNN
   } else if (engine == ConvolutionParameter_Engine_CUDNN) {
     return shared_ptr<Layer<Dtype> >(new CuDNNConvolutionLayer<Dtype>(param));
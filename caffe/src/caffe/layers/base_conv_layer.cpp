@@ -101,6 +101,29 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
         kernel_shape_data[i] == 1 && stride_data[i] == 1 && pad_data[i] == 0;
     if (!is_1x1_) { break; }
   }
+  // Byte input is widened while being unrolled, so it is always unrolled.
+  byte_input_ = conv_param.byte_input();
+  input_scale_ = conv_param.input_scale();
+  input_shift_ = conv_param.input_shift();
+  if (byte_input_) {
+    CHECK(!reverse_dimensions()) << "byte_input is only for convolution.";
+    CHECK_EQ(num_spatial_axes_, 2)
+        << "byte_input is only for 2D convolution.";
+    CHECK(!force_nd_im2col_)
+        << "byte_input can't be used with force_nd_im2col.";
+    is_1x1_ = false;
+  } else {
+    CHECK(!conv_param.has_input_scale() && !conv_param.has_input_shift())
+        << "input_scale and input_shift only apply to byte_input.";
+  }
+  relu_ = conv_param.relu();
+  relu_negative_slope_ = conv_param.relu_negative_slope();
+  if (relu_) {
+    CHECK(!reverse_dimensions()) << "relu is only for convolution.";
+  } else {
+    CHECK(!conv_param.has_relu_negative_slope())
+        << "relu_negative_slope only applies to relu.";
+  }
   // Configure output channels and groups.
   channels_ = bottom[0]->shape(channel_axis_);
   num_output_ = this->layer_param_.convolution_param().num_output();
@@ -225,7 +248,29 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       col_buffer_shape_.push_back(output_shape_[i]);
     }
   }
-  col_buffer_.Reshape(col_buffer_shape_);
+  // On the CPU, 2D convolutions may instead im2col several images into one
+  // wider buffer, so that each group takes one large gemm rather than one
+  // small gemm per image, as long as the buffers fit the workspace limit.
+  cpu_batch_ = 1;
+  if (Caffe::mode() == Caffe::CPU && !reverse_dimensions() && !is_1x1_ &&
+      !force_nd_im2col_ && num_spatial_axes_ == 2) {
+    const uint64_t image_bytes = sizeof(Dtype) * conv_out_spatial_dim_ *
+        (kernel_dim_ * group_ + conv_out_channels_);
+    const uint64_t limit =
+        this->layer_param_.convolution_param().cpu_workspace_limit();
+    cpu_batch_ = std::max<uint64_t>(1,
+        std::min<uint64_t>(num_, limit / image_bytes));
+  }
+  if (cpu_batch_ > 1) {
+    vector<int> batch_col_buffer_shape(col_buffer_shape_);
+    batch_col_buffer_shape[0] *= cpu_batch_;
+    col_buffer_.Reshape(batch_col_buffer_shape);
+    vector<int> batch_output_shape(1,
+        cpu_batch_ * conv_out_channels_ * conv_out_spatial_dim_);
+    batch_output_buffer_.Reshape(batch_output_shape);
+  } else {
+    col_buffer_.Reshape(col_buffer_shape_);
+  }
   bottom_dim_ = bottom[0]->count(channel_axis_);
   top_dim_ = top[0]->count(channel_axis_);
   num_kernels_im2col_ = conv_in_channels_ * conv_out_spatial_dim_;
@@ -286,10 +331,12 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
-    const Dtype* output, Dtype* weights) {
+    const Dtype* output, Dtype* weights, bool skip_im2col) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
-    conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+    if (!skip_im2col) {
+      conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+    }
     col_buff = col_buffer_.cpu_data();
   }
   for (int g = 0; g < group_; ++g) {
@@ -307,6 +354,102 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_bias(Dtype* bias,
       input, bias_multiplier_.cpu_data(), 1., bias);
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::gather_batch_output_cpu(const Dtype* output,
+    const int num) {
+  Dtype* batch_output = batch_output_buffer_.mutable_cpu_data();
+  for (int n = 0; n < num; ++n) {
+    for (int c = 0; c < conv_out_channels_; ++c) {
+      caffe_copy(conv_out_spatial_dim_,
+          output + n * top_dim_ + c * conv_out_spatial_dim_,
+          batch_output + (c * num + n) * conv_out_spatial_dim_);
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::scatter_batch_output_cpu(Dtype* output,
+    const int num) {
+  const Dtype* batch_output = batch_output_buffer_.cpu_data();
+  for (int n = 0; n < num; ++n) {
+    for (int c = 0; c < conv_out_channels_; ++c) {
+      caffe_copy(conv_out_spatial_dim_,
+          batch_output + (c * num + n) * conv_out_spatial_dim_,
+          output + n * top_dim_ + c * conv_out_spatial_dim_);
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_batch(const Dtype* input,
+    const Dtype* weights, Dtype* output, const int num, bool skip_im2col) {
+  CHECK_LE(num, cpu_batch_);
+  if (!skip_im2col) {
+    conv_im2col_batch_cpu(input, num, col_buffer_.mutable_cpu_data());
+  }
+  const Dtype* col_buff = col_buffer_.cpu_data();
+  Dtype* batch_output = batch_output_buffer_.mutable_cpu_data();
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
+        group_, num * conv_out_spatial_dim_, kernel_dim_,
+        (Dtype)1., weights + weight_offset_ * g,
+        col_buff + col_offset_ * num * g,
+        (Dtype)0., batch_output + output_offset_ * num * g);
+  }
+  scatter_batch_output_cpu(output, num);
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::backward_cpu_gemm_batch(const Dtype* output,
+    const Dtype* weights, Dtype* input, const int num, bool skip_gather) {
+  CHECK_LE(num, cpu_batch_);
+  if (!skip_gather) {
+    gather_batch_output_cpu(output, num);
+  }
+  const Dtype* batch_output = batch_output_buffer_.cpu_data();
+  Dtype* col_buff = col_buffer_.mutable_cpu_data();
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, kernel_dim_,
+        num * conv_out_spatial_dim_, conv_out_channels_ / group_,
+        (Dtype)1., weights + weight_offset_ * g,
+        batch_output + output_offset_ * num * g,
+        (Dtype)0., col_buff + col_offset_ * num * g);
+  }
+  conv_col2im_batch_cpu(col_buff, num, input);
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::weight_cpu_gemm_batch(const Dtype* input,
+    const Dtype* output, Dtype* weights, const int num, bool skip_im2col) {
+  CHECK_LE(num, cpu_batch_);
+  gather_batch_output_cpu(output, num);
+  if (!skip_im2col) {
+    conv_im2col_batch_cpu(input, num, col_buffer_.mutable_cpu_data());
+  }
+  const Dtype* col_buff = col_buffer_.cpu_data();
+  const Dtype* batch_output = batch_output_buffer_.cpu_data();
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_channels_ / group_,
+        kernel_dim_, num * conv_out_spatial_dim_,
+        (Dtype)1., batch_output + output_offset_ * num * g,
+        col_buff + col_offset_ * num * g,
+        (Dtype)1., weights + weight_offset_ * g);
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::byte_im2col_cpu(const uint8_t* input,
+    const int num) {
+  CHECK(byte_input_);
+  CHECK_LE(num, cpu_batch_);
+  im2col_batch_cpu(input, input_scale_, input_shift_, num, conv_in_channels_,
+      conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
+      kernel_shape_.cpu_data()[0], kernel_shape_.cpu_data()[1],
+      pad_.cpu_data()[0], pad_.cpu_data()[1],
+      stride_.cpu_data()[0], stride_.cpu_data()[1],
+      col_buffer_.mutable_cpu_data());
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
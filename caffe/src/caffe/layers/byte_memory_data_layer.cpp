@@ -0,0 +1,57 @@
+#include <cstring>
+#include <vector>
+
+#include "caffe/data_layers.hpp"
+#include "caffe/layer.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void ByteMemoryDataLayer<Dtype>::DataLayerSetUp(
+     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  batch_size_ = this->layer_param_.memory_data_param().batch_size();
+  channels_ = this->layer_param_.memory_data_param().channels();
+  height_ = this->layer_param_.memory_data_param().height();
+  width_ = this->layer_param_.memory_data_param().width();
+  size_ = channels_ * height_ * width_;
+  CHECK_GT(batch_size_ * size_, 0) <<
+      "batch_size, channels, height, and width must be specified and"
+      " positive in memory_data_param";
+  CHECK(!this->layer_param_.has_transform_param()) <<
+      this->type() << " does not transform data";
+  top[0]->Reshape(batch_size_, channels_, height_, width_);
+  data_ = NULL;
+}
+
+template <typename Dtype>
+void ByteMemoryDataLayer<Dtype>::Reset(const uint8_t* data, int n) {
+  CHECK(data);
+  CHECK_EQ(n % batch_size_, 0) << "n must be a multiple of batch size";
+  data_ = data;
+  n_ = n;
+  pos_ = 0;
+}
+
+template <typename Dtype>
+void ByteMemoryDataLayer<Dtype>::set_batch_size(int new_size) {
+  batch_size_ = new_size;
+}
+
+template <typename Dtype>
+void ByteMemoryDataLayer<Dtype>::Forward_cpu(
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  CHECK(data_) << "ByteMemoryDataLayer needs to be initalized by calling Reset";
+  top[0]->Reshape(batch_size_, channels_, height_, width_);
+  // The bytes are copied rather than handed to the top like MemoryDataLayer
+  // does, because the top's memory is taken to be count() Dtypes long, e.g.
+  // when it is synced to the GPU.
+  // NOLINT_NEXT_LINE(caffe/alt_fn)
+  memcpy(top[0]->mutable_cpu_data(), data_ + pos_ * size_,
+      batch_size_ * size_);
+  pos_ = (pos_ + batch_size_) % n_;
+}
+
+INSTANTIATE_CLASS(ByteMemoryDataLayer);
+REGISTER_LAYER_CLASS(ByteMemoryData);
+
+}  // namespace caffe
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "caffe/filler.hpp"
@@ -29,13 +30,29 @@ void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* weight = this->blobs_[0]->cpu_data();
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
+    const uint8_t* bottom_bytes = reinterpret_cast<const uint8_t*>(bottom_data);
     Dtype* top_data = top[i]->mutable_cpu_data();
-    for (int n = 0; n < this->num_; ++n) {
-      this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
-          top_data + n * this->top_dim_);
-      if (this->bias_term_) {
+    for (int n = 0; n < this->num_; n += this->cpu_batch_) {
+      const int batch = std::min(this->cpu_batch_, this->num_ - n);
+      if (this->byte_input_) {
+        this->byte_im2col_cpu(bottom_bytes + n * this->bottom_dim_, batch);
+      }
+      if (batch > 1) {
+        this->forward_cpu_gemm_batch(bottom_data + n * this->bottom_dim_,
+            weight, top_data + n * this->top_dim_, batch, this->byte_input_);
+      } else {
+        this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
+            top_data + n * this->top_dim_, this->byte_input_);
+      }
+      if (this->relu_) {
+        caffe_cpu_bias_relu(batch, this->num_output_, this->out_spatial_dim_,
+            this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL,
+            this->relu_negative_slope_, top_data + n * this->top_dim_);
+      } else if (this->bias_term_) {
         const Dtype* bias = this->blobs_[1]->cpu_data();
-        this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
+        for (int m = n; m < n + batch; ++m) {
+          this->forward_cpu_bias(top_data + m * this->top_dim_, bias);
+        }
       }
     }
   }
@@ -47,22 +64,52 @@ void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   const Dtype* weight = this->blobs_[0]->cpu_data();
   Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
   for (int i = 0; i < top.size(); ++i) {
-    const Dtype* top_diff = top[i]->cpu_diff();
     const Dtype* bottom_data = bottom[i]->cpu_data();
-    Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
+    const uint8_t* bottom_bytes = reinterpret_cast<const uint8_t*>(bottom_data);
+    CHECK(!this->byte_input_ || !propagate_down[i])
+        << "Byte input has no gradient.";
+    Dtype* bottom_diff = propagate_down[i] ? bottom[i]->mutable_cpu_diff() :
+        NULL;
+    const bool bias_grad = this->bias_term_ && this->param_propagate_down_[1];
+    if (this->relu_) {
+      // Mask the top diff in place, as an in-place ReLU layer would, and
+      // take the bias gradient in the same pass.
+      caffe_cpu_bias_relu_backward(this->num_, this->num_output_,
+          this->out_spatial_dim_, top[i]->cpu_data(),
+          this->relu_negative_slope_, top[i]->mutable_cpu_diff(),
+          bias_grad ? this->blobs_[1]->mutable_cpu_diff() : NULL);
+    }
+    const Dtype* top_diff = top[i]->cpu_diff();
     // Bias gradient, if necessary.
-    if (this->bias_term_ && this->param_propagate_down_[1]) {
+    if (bias_grad && !this->relu_) {
       Dtype* bias_diff = this->blobs_[1]->mutable_cpu_diff();
       for (int n = 0; n < this->num_; ++n) {
         this->backward_cpu_bias(bias_diff, top_diff + n * this->top_dim_);
       }
     }
     if (this->param_propagate_down_[0] || propagate_down[i]) {
-      for (int n = 0; n < this->num_; ++n) {
+      for (int n = 0; n < this->num_; n += this->cpu_batch_) {
+        const int batch = std::min(this->cpu_batch_, this->num_ - n);
+        if (this->byte_input_) {
+          this->byte_im2col_cpu(bottom_bytes + n * this->bottom_dim_, batch);
+        }
+        if (batch > 1) {
+          if (this->param_propagate_down_[0]) {
+            this->weight_cpu_gemm_batch(bottom_data + n * this->bottom_dim_,
+                top_diff + n * this->top_dim_, weight_diff, batch,
+                this->byte_input_);
+          }
+          if (propagate_down[i]) {
+            this->backward_cpu_gemm_batch(top_diff + n * this->top_dim_,
+                weight, bottom_diff + n * this->bottom_dim_, batch,
+                this->param_propagate_down_[0]);
+          }
+          continue;
+        }
         // gradient w.r.t. weight. Note that we will accumulate diffs.
         if (this->param_propagate_down_[0]) {
           this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
-              top_diff + n * this->top_dim_, weight_diff);
+              top_diff + n * this->top_dim_, weight_diff, this->byte_input_);
         }
         // gradient w.r.t. bottom data, if necessary.
         if (propagate_down[i]) {
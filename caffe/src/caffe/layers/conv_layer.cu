@@ -8,21 +8,50 @@
 
 namespace caffe {
 
+template <typename Dtype>
+__global__ void WidenBytes(const int n, const uint8_t* in, const Dtype scale,
+    const Dtype shift, Dtype* out) {
+  CUDA_KERNEL_LOOP(index, n) {
+    out[index] = scale * in[index] + shift;
+  }
+}
+
+template <typename Dtype>
+const Dtype* ConvolutionLayer<Dtype>::widened_input_gpu(
+    const Blob<Dtype>& bottom) {
+  widened_input_.ReshapeLike(bottom);
+  const int count = bottom.count();
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  WidenBytes<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
+      count, reinterpret_cast<const uint8_t*>(bottom.gpu_data()),
+      this->input_scale_, this->input_shift_,
+      widened_input_.mutable_gpu_data());
+  CUDA_POST_KERNEL_CHECK;
+  return widened_input_.gpu_data();
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* weight = this->blobs_[0]->gpu_data();
   for (int i = 0; i < bottom.size(); ++i) {
-    const Dtype* bottom_data = bottom[i]->gpu_data();
+    const Dtype* bottom_data = this->byte_input_ ?
+        widened_input_gpu(*bottom[i]) : bottom[i]->gpu_data();
     Dtype* top_data = top[i]->mutable_gpu_data();
     for (int n = 0; n < this->num_; ++n) {
       this->forward_gpu_gemm(bottom_data + n * this->bottom_dim_, weight,
           top_data + n * this->top_dim_);
-      if (this->bias_term_) {
+      if (this->bias_term_ && !this->relu_) {
         const Dtype* bias = this->blobs_[1]->gpu_data();
         this->forward_gpu_bias(top_data + n * this->top_dim_, bias);
       }
     }
+    if (this->relu_) {
+      caffe_gpu_bias_relu(this->num_, this->num_output_,
+          this->out_spatial_dim_,
+          this->bias_term_ ? this->blobs_[1]->gpu_data() : NULL,
+          this->relu_negative_slope_, top_data);
+    }
   }
 }
 
@@ -32,6 +61,10 @@ void ConvolutionLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
   const Dtype* weight = this->blobs_[0]->gpu_data();
   Dtype* weight_diff = this->blobs_[0]->mutable_gpu_diff();
   for (int i = 0; i < top.size(); ++i) {
+    if (this->relu_) {
+      caffe_gpu_relu_backward(top[i]->count(), top[i]->gpu_data(),
+          this->relu_negative_slope_, top[i]->mutable_gpu_diff());
+    }
     const Dtype* top_diff = top[i]->gpu_diff();
     // Bias gradient, if necessary.
     if (this->bias_term_ && this->param_propagate_down_[1]) {
@@ -41,8 +74,12 @@ void ConvolutionLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
       }
     }
     if (this->param_propagate_down_[0] || propagate_down[i]) {
-      const Dtype* bottom_data = bottom[i]->gpu_data();
-      Dtype* bottom_diff = bottom[i]->mutable_gpu_diff();
+      CHECK(!this->byte_input_ || !propagate_down[i])
+          << "Byte input has no gradient.";
+      const Dtype* bottom_data = this->byte_input_ ?
+          widened_input_gpu(*bottom[i]) : bottom[i]->gpu_data();
+      Dtype* bottom_diff = propagate_down[i] ?
+          bottom[i]->mutable_gpu_diff() : NULL;
       for (int n = 0; n < this->num_; ++n) {
         // gradient w.r.t. weight. Note that we will accumulate diffs.
         if (this->param_propagate_down_[0]) {
@@ -0,0 +1,107 @@
+#include <vector>
+
+#include "caffe/layer.hpp"
+#include "caffe/util/direct_conv.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/vision_layers.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::Reshape(bottom, top);
+  direct_ = this->num_spatial_axes_ == 2 && this->group_ == 1 &&
+      !this->force_nd_im2col_ && !this->byte_input_;
+  for (int i = 0; i < this->num_spatial_axes_; ++i) {
+    direct_ = direct_ && this->pad_.cpu_data()[i] == 0;
+  }
+  if (!direct_) {
+    return;
+  }
+  const int* input_shape = this->conv_input_shape_.cpu_data();
+  const int* kernel_shape = this->kernel_shape_.cpu_data();
+  const int* stride = this->stride_.cpu_data();
+  shape_.channels = input_shape[0];
+  shape_.height = input_shape[1];
+  shape_.width = input_shape[2];
+  shape_.num_output = this->num_output_;
+  shape_.height_out = this->output_shape_[0];
+  shape_.width_out = this->output_shape_[1];
+  shape_.kernel_h = kernel_shape[0];
+  shape_.kernel_w = kernel_shape[1];
+  shape_.stride_h = stride[0];
+  shape_.stride_w = stride[1];
+  workspace_.Reshape(1, 1, 1, direct_conv_workspace_size<Dtype>(shape_));
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::Forward_cpu(
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!direct_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  Dtype* workspace = workspace_.mutable_cpu_data();
+  for (int i = 0; i < bottom.size(); ++i) {
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    direct_conv_forward_cpu(shape_, bottom[i]->cpu_data(), weight, top_data,
+        this->num_, workspace);
+    if (this->relu_) {
+      caffe_cpu_bias_relu(this->num_, this->num_output_,
+          this->out_spatial_dim_,
+          this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL,
+          this->relu_negative_slope_, top_data);
+    } else if (this->bias_term_) {
+      const Dtype* bias = this->blobs_[1]->cpu_data();
+      for (int n = 0; n < this->num_; ++n) {
+        this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::Backward_cpu(
+      const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+      const vector<Blob<Dtype>*>& bottom) {
+  if (!direct_) {
+    ConvolutionLayer<Dtype>::Backward_cpu(top, propagate_down, bottom);
+    return;
+  }
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  Dtype* workspace = workspace_.mutable_cpu_data();
+  for (int i = 0; i < top.size(); ++i) {
+    const bool bias_grad = this->bias_term_ && this->param_propagate_down_[1];
+    if (this->relu_) {
+      caffe_cpu_bias_relu_backward(this->num_, this->num_output_,
+          this->out_spatial_dim_, top[i]->cpu_data(),
+          this->relu_negative_slope_, top[i]->mutable_cpu_diff(),
+          bias_grad ? this->blobs_[1]->mutable_cpu_diff() : NULL);
+    }
+    const Dtype* top_diff = top[i]->cpu_diff();
+    // Bias gradient, if necessary.
+    if (bias_grad && !this->relu_) {
+      Dtype* bias_diff = this->blobs_[1]->mutable_cpu_diff();
+      for (int n = 0; n < this->num_; ++n) {
+        this->backward_cpu_bias(bias_diff, top_diff + n * this->top_dim_);
+      }
+    }
+    // gradient w.r.t. weight. Note that we will accumulate diffs.
+    if (this->param_propagate_down_[0]) {
+      direct_conv_backward_weights_cpu(shape_, bottom[i]->cpu_data(),
+          top_diff, this->blobs_[0]->mutable_cpu_diff(), this->num_,
+          workspace);
+    }
+    // gradient w.r.t. bottom data, if necessary.
+    if (propagate_down[i]) {
+      direct_conv_backward_data_cpu(shape_, top_diff, weight,
+          bottom[i]->mutable_cpu_diff(), this->num_, workspace);
+    }
+  }
+}
+
+INSTANTIATE_CLASS(DirectConvolutionLayer);
+
+}  // namespace caffe
@@ -3,10 +3,63 @@
 
 #include "caffe/layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
 
+namespace {
+
+template <typename Dtype>
+struct MaxForwardTask {
+  const vector<const Dtype*>* bottom_data;
+  Dtype* top_data;
+  int* mask;
+  void operator()(const int begin, const int end) const {
+    // bottom 0 & 1
+    const Dtype* bottom_data_a = (*bottom_data)[0];
+    const Dtype* bottom_data_b = (*bottom_data)[1];
+    for (int idx = begin; idx < end; ++idx) {
+      if (bottom_data_a[idx] > bottom_data_b[idx]) {
+        top_data[idx] = bottom_data_a[idx];  // maxval
+        mask[idx] = 0;  // maxid
+      } else {
+        top_data[idx] = bottom_data_b[idx];  // maxval
+        mask[idx] = 1;  // maxid
+      }
+    }
+    // bottom 2++
+    for (int blob_idx = 2; blob_idx < bottom_data->size(); ++blob_idx) {
+      bottom_data_b = (*bottom_data)[blob_idx];
+      for (int idx = begin; idx < end; ++idx) {
+        if (bottom_data_b[idx] > top_data[idx]) {
+          top_data[idx] = bottom_data_b[idx];  // maxval
+          mask[idx] = blob_idx;  // maxid
+        }
+      }
+    }
+  }
+};
+
+template <typename Dtype>
+struct MaxBackwardTask {
+  const int* mask;
+  int blob_idx;
+  const Dtype* top_diff;
+  Dtype* bottom_diff;
+  void operator()(const int begin, const int end) const {
+    for (int index = begin; index < end; ++index) {
+      Dtype gradient = 0;
+      if (mask[index] == blob_idx) {
+        gradient += top_diff[index];
+      }
+      bottom_diff[index] = gradient;
+    }
+  }
+};
+
+}  // namespace
+
 template <typename Dtype>
 void EltwiseLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -45,9 +98,6 @@ void EltwiseLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void EltwiseLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  int* mask = NULL;
-  const Dtype* bottom_data_a = NULL;
-  const Dtype* bottom_data_b = NULL;
   const int count = top[0]->count();
   Dtype* top_data = top[0]->mutable_cpu_data();
   switch (op_) {
@@ -64,34 +114,19 @@ void EltwiseLayer<Dtype>::Forward_cpu(
       caffe_axpy(count, coeffs_[i], bottom[i]->cpu_data(), top_data);
     }
     break;
-  case EltwiseParameter_EltwiseOp_MAX:
+  case EltwiseParameter_EltwiseOp_MAX: {
     // Initialize
-    mask = max_idx_.mutable_cpu_data();
+    int* mask = max_idx_.mutable_cpu_data();
     caffe_set(count, -1, mask);
     caffe_set(count, Dtype(-FLT_MAX), top_data);
-    // bottom 0 & 1
-    bottom_data_a = bottom[0]->cpu_data();
-    bottom_data_b = bottom[1]->cpu_data();
-    for (int idx = 0; idx < count; ++idx) {
-      if (bottom_data_a[idx] > bottom_data_b[idx]) {
-        top_data[idx] = bottom_data_a[idx];  // maxval
-        mask[idx] = 0;  // maxid
-      } else {
-        top_data[idx] = bottom_data_b[idx];  // maxval
-        mask[idx] = 1;  // maxid
-      }
-    }
-    // bottom 2++
-    for (int blob_idx = 2; blob_idx < bottom.size(); ++blob_idx) {
-      bottom_data_b = bottom[blob_idx]->cpu_data();
-      for (int idx = 0; idx < count; ++idx) {
-        if (bottom_data_b[idx] > top_data[idx]) {
-          top_data[idx] = bottom_data_b[idx];  // maxval
-          mask[idx] = blob_idx;  // maxid
-        }
-      }
+    vector<const Dtype*> bottom_data(bottom.size());
+    for (int i = 0; i < bottom.size(); ++i) {
+      bottom_data[i] = bottom[i]->cpu_data();
     }
+    MaxForwardTask<Dtype> task = { &bottom_data, top_data, mask };
+    caffe_parallel_for(count, kParallelGrain, task);
     break;
+  }
   default:
     LOG(FATAL) << "Unknown elementwise operation.";
   }
@@ -100,7 +135,6 @@ void EltwiseLayer<Dtype>::Forward_cpu(
 template <typename Dtype>
 void EltwiseLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  const int* mask = NULL;
   const int count = top[0]->count();
   const Dtype* top_data = top[0]->cpu_data();
   const Dtype* top_diff = top[0]->cpu_diff();
@@ -134,16 +168,12 @@ void EltwiseLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
           caffe_cpu_scale(count, coeffs_[i], top_diff, bottom_diff);
         }
         break;
-      case EltwiseParameter_EltwiseOp_MAX:
-        mask = max_idx_.cpu_data();
-        for (int index = 0; index < count; ++index) {
-          Dtype gradient = 0;
-          if (mask[index] == i) {
-            gradient += top_diff[index];
-          }
-          bottom_diff[index] = gradient;
-        }
+      case EltwiseParameter_EltwiseOp_MAX: {
+        MaxBackwardTask<Dtype> task = { max_idx_.cpu_data(), i, top_diff,
+            bottom_diff };
+        caffe_parallel_for(count, kParallelGrain, task);
         break;
+      }
       default:
         LOG(FATAL) << "Unknown elementwise operation.";
       }
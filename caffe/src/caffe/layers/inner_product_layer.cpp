@@ -14,6 +14,12 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const int num_output = this->layer_param_.inner_product_param().num_output();
   bias_term_ = this->layer_param_.inner_product_param().bias_term();
+  relu_ = this->layer_param_.inner_product_param().relu();
+  relu_negative_slope_ =
+      this->layer_param_.inner_product_param().relu_negative_slope();
+  CHECK(relu_ ||
+      !this->layer_param_.inner_product_param().has_relu_negative_slope())
+      << "relu_negative_slope only applies to relu.";
   N_ = num_output;
   const int axis = bottom[0]->CanonicalAxisIndex(
       this->layer_param_.inner_product_param().axis());
@@ -85,17 +91,76 @@ void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* weight = this->blobs_[0]->cpu_data();
   caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, N_, K_, (Dtype)1.,
       bottom_data, weight, (Dtype)0., top_data);
-  if (bias_term_) {
+  if (relu_) {
+    caffe_cpu_bias_relu(M_, N_, 1,
+        bias_term_ ? this->blobs_[1]->cpu_data() : NULL,
+        relu_negative_slope_, top_data);
+  } else if (bias_term_) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
         bias_multiplier_.cpu_data(),
         this->blobs_[1]->cpu_data(), (Dtype)1., top_data);
   }
 }
 
+template <typename Dtype>
+bool InnerProductLayer<Dtype>::SparseTopDiff(const Dtype* top_diff) {
+  // Past a quarter of the entries the GEMMs are faster
+  const int max_nonzeros = M_ * N_ / 4;
+  top_diff_nonzeros_.clear();
+  for (int i = 0; i < M_ * N_; ++i) {
+    if (top_diff[i] != 0) {
+      if (static_cast<int>(top_diff_nonzeros_.size()) == max_nonzeros) {
+        return false;
+      }
+      top_diff_nonzeros_.push_back(i);
+    }
+  }
+  return true;
+}
+
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
+  const bool bias_grad = bias_term_ && this->param_propagate_down_[1];
+  if (relu_) {
+    // Mask the top diff in place, as an in-place ReLU layer would, and take
+    // the bias gradient in the same pass.
+    caffe_cpu_bias_relu_backward(M_, N_, 1, top[0]->cpu_data(),
+        relu_negative_slope_, top[0]->mutable_cpu_diff(),
+        bias_grad ? this->blobs_[1]->mutable_cpu_diff() : NULL);
+  }
+  if (SparseTopDiff(top[0]->cpu_diff())) {
+    // Each nonzero top diff updates one row of the weight gradient and
+    // one row of the bottom gradient.
+    const Dtype* top_diff = top[0]->cpu_diff();
+    const Dtype* bottom_data = bottom[0]->cpu_data();
+    const Dtype* weight = this->blobs_[0]->cpu_data();
+    Dtype* weight_diff = this->param_propagate_down_[0] ?
+        this->blobs_[0]->mutable_cpu_diff() : NULL;
+    Dtype* bias_diff = bias_grad && !relu_ ?
+        this->blobs_[1]->mutable_cpu_diff() : NULL;
+    Dtype* bottom_diff = propagate_down[0] ?
+        bottom[0]->mutable_cpu_diff() : NULL;
+    if (bottom_diff) {
+      caffe_set(M_ * K_, Dtype(0), bottom_diff);
+    }
+    for (int i = 0; i < top_diff_nonzeros_.size(); ++i) {
+      const int m = top_diff_nonzeros_[i] / N_;
+      const int n = top_diff_nonzeros_[i] % N_;
+      const Dtype diff = top_diff[top_diff_nonzeros_[i]];
+      if (weight_diff) {
+        caffe_axpy(K_, diff, bottom_data + m * K_, weight_diff + n * K_);
+      }
+      if (bias_diff) {
+        bias_diff[n] += diff;
+      }
+      if (bottom_diff) {
+        caffe_axpy(K_, diff, weight + n * K_, bottom_diff + m * K_);
+      }
+    }
+    return;
+  }
   if (this->param_propagate_down_[0]) {
     const Dtype* top_diff = top[0]->cpu_diff();
     const Dtype* bottom_data = bottom[0]->cpu_data();
@@ -103,7 +168,7 @@ void InnerProductLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, N_, K_, M_, (Dtype)1.,
         top_diff, bottom_data, (Dtype)1., this->blobs_[0]->mutable_cpu_diff());
   }
-  if (bias_term_ && this->param_propagate_down_[1]) {
+  if (bias_grad && !relu_) {
     const Dtype* top_diff = top[0]->cpu_diff();
     // Gradient with respect to bias
     caffe_cpu_gemv<Dtype>(CblasTrans, M_, N_, (Dtype)1., top_diff,
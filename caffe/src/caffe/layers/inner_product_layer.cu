@@ -29,12 +29,20 @@ void InnerProductLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
                             bias_multiplier_.gpu_data(),
                             this->blobs_[1]->gpu_data(), (Dtype)1., top_data);
   }
+  if (relu_) {
+    caffe_gpu_bias_relu(M_, N_, 1, static_cast<const Dtype*>(NULL),
+        relu_negative_slope_, top_data);
+  }
 }
 
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
+  if (relu_) {
+    caffe_gpu_relu_backward(top[0]->count(), top[0]->gpu_data(),
+        relu_negative_slope_, top[0]->mutable_gpu_diff());
+  }
   if (this->param_propagate_down_[0]) {
     const Dtype* top_diff = top[0]->gpu_diff();
     const Dtype* bottom_data = bottom[0]->gpu_data();
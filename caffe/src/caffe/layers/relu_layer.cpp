@@ -2,10 +2,42 @@
 #include <vector>
 
 #include "caffe/layer.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
 
+namespace {
+
+template <typename Dtype>
+struct ReLUForwardTask {
+  const Dtype* bottom_data;
+  Dtype* top_data;
+  Dtype negative_slope;
+  void operator()(const int begin, const int end) const {
+    for (int i = begin; i < end; ++i) {
+      top_data[i] = std::max(bottom_data[i], Dtype(0))
+          + negative_slope * std::min(bottom_data[i], Dtype(0));
+    }
+  }
+};
+
+template <typename Dtype>
+struct ReLUBackwardTask {
+  const Dtype* bottom_data;
+  const Dtype* top_diff;
+  Dtype* bottom_diff;
+  Dtype negative_slope;
+  void operator()(const int begin, const int end) const {
+    for (int i = begin; i < end; ++i) {
+      bottom_diff[i] = top_diff[i] * ((bottom_data[i] > 0)
+          + negative_slope * (bottom_data[i] <= 0));
+    }
+  }
+};
+
+}  // namespace
+
 template <typename Dtype>
 void ReLULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
@@ -13,10 +45,8 @@ void ReLULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
   Dtype negative_slope = this->layer_param_.relu_param().negative_slope();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = std::max(bottom_data[i], Dtype(0))
-        + negative_slope * std::min(bottom_data[i], Dtype(0));
-  }
+  ReLUForwardTask<Dtype> task = { bottom_data, top_data, negative_slope };
+  caffe_parallel_for(count, kParallelGrain, task);
 }
 
 template <typename Dtype>
@@ -29,10 +59,9 @@ void ReLULayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
     const int count = bottom[0]->count();
     Dtype negative_slope = this->layer_param_.relu_param().negative_slope();
-    for (int i = 0; i < count; ++i) {
-      bottom_diff[i] = top_diff[i] * ((bottom_data[i] > 0)
-          + negative_slope * (bottom_data[i] <= 0));
-    }
+    ReLUBackwardTask<Dtype> task = { bottom_data, top_diff, bottom_diff,
+        negative_slope };
+    caffe_parallel_for(count, kParallelGrain, task);
   }
 }
 
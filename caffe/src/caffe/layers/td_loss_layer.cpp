@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "caffe/layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/vision_layers.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void TDLossLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  LossLayer<Dtype>::LayerSetUp(bottom, top);
+  huber_delta_ = this->layer_param_.td_loss_param().huber_delta();
+  CHECK_GE(huber_delta_, 0) << "huber_delta must not be negative.";
+}
+
+template <typename Dtype>
+void TDLossLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  LossLayer<Dtype>::Reshape(bottom, top);
+  CHECK_EQ(bottom[1]->count(1), 3)
+      << "Each sample needs its action, target and weight.";
+}
+
+template <typename Dtype>
+void TDLossLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  const Dtype* q_values = bottom[0]->cpu_data();
+  const Dtype* td = bottom[1]->cpu_data();
+  const int num = bottom[0]->num();
+  const int num_actions = bottom[0]->count(1);
+  Dtype loss = 0;
+  for (int n = 0; n < num; ++n) {
+    const int action = static_cast<int>(td[n * 3]);
+    DCHECK_GE(action, 0);
+    DCHECK_LT(action, num_actions);
+    const Dtype error = q_values[n * num_actions + action] - td[n * 3 + 1];
+    const Dtype abs_error = std::abs(error);
+    const Dtype l = huber_delta_ > 0 && abs_error > huber_delta_ ?
+        huber_delta_ * (abs_error - Dtype(0.5) * huber_delta_) :
+        Dtype(0.5) * error * error;
+    loss += td[n * 3 + 2] * l;
+  }
+  top[0]->mutable_cpu_data()[0] = loss / num;
+}
+
+template <typename Dtype>
+void TDLossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (propagate_down[1]) {
+    LOG(FATAL) << this->type()
+               << " Layer cannot backpropagate to the action inputs.";
+  }
+  if (propagate_down[0]) {
+    const Dtype* q_values = bottom[0]->cpu_data();
+    const Dtype* td = bottom[1]->cpu_data();
+    Dtype* q_diff = bottom[0]->mutable_cpu_diff();
+    const int num = bottom[0]->num();
+    const int num_actions = bottom[0]->count(1);
+    const Dtype scale = top[0]->cpu_diff()[0] / num;
+    caffe_set(bottom[0]->count(), Dtype(0), q_diff);
+    for (int n = 0; n < num; ++n) {
+      const int action = static_cast<int>(td[n * 3]);
+      Dtype error = q_values[n * num_actions + action] - td[n * 3 + 1];
+      if (huber_delta_ > 0) {
+        error = std::max(-huber_delta_, std::min(error, huber_delta_));
+      }
+      q_diff[n * num_actions + action] = scale * td[n * 3 + 2] * error;
+    }
+  }
+}
+
+INSTANTIATE_CLASS(TDLossLayer);
+REGISTER_LAYER_CLASS(TDLoss);
+
+}  // namespace caffe
@@ -42,6 +42,9 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
       << "root_net_ needs to be set for all non-root solvers";
   // Set phase from the state.
   phase_ = in_param.state().phase();
+  inference_only_ = in_param.inference_only();
+  CHECK(!inference_only_ || !in_param.force_backward())
+      << "An inference_only net can't force_backward.";
   // Filter layers based on their include/exclude rules and
   // the current NetState.
   NetParameter filtered_param;
@@ -182,7 +185,8 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     for (int param_id = 0; param_id < num_param_blobs; ++param_id) {
       const ParamSpec* param_spec = (param_id < param_size) ?
           &layer_param.param(param_id) : &default_param_spec;
-      const bool param_need_backward = param_spec->lr_mult() != 0;
+      const bool param_need_backward =
+          !inference_only_ && param_spec->lr_mult() != 0;
       need_backward |= param_need_backward;
       layers_[layer_id]->set_param_propagate_down(param_id,
                                                   param_need_backward);
@@ -293,12 +297,125 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   }
   ShareWeights();
   debug_info_ = param.debug_info();
+  if (inference_only_) {
+    ShareActivationMemory();
+  }
   if (Caffe::root_solver()) {
     LOG(INFO) << "Network initialization done.";
     LOG(INFO) << "Memory required for data: " << memory_used_ * sizeof(Dtype);
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::ShareActivationMemory() {
+  // Blobs that already share memory, as Split tops do with their bottom,
+  // are planned as one: they are live from the first to the last layer
+  // using any of them.
+  map<SyncedMemory*, int> memory_group;
+  vector<size_t> group_bytes;
+  vector<int> blob_group(blobs_.size(), -1);
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (blobs_[blob_id]->count() == 0) { continue; }
+    SyncedMemory* memory = blobs_[blob_id]->data().get();
+    if (memory_group.find(memory) == memory_group.end()) {
+      memory_group[memory] = group_bytes.size();
+      group_bytes.push_back(memory->size());
+    }
+    blob_group[blob_id] = memory_group[memory];
+  }
+  const int num_groups = group_bytes.size();
+  vector<int> first_use(num_groups, layers_.size());
+  vector<int> last_use(num_groups, -1);
+  // The inputs and outputs of the net keep their own memory, and so do the
+  // tops of data layers, which may point them at memory of their own.
+  vector<bool> pinned(num_groups, false);
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    const int group = blob_group[net_input_blob_indices_[i]];
+    if (group >= 0) { pinned[group] = true; }
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    const int group = blob_group[net_output_blob_indices_[i]];
+    if (group >= 0) { pinned[group] = true; }
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    vector<int> blob_ids(bottom_id_vecs_[layer_id]);
+    blob_ids.insert(blob_ids.end(), top_id_vecs_[layer_id].begin(),
+                    top_id_vecs_[layer_id].end());
+    for (int i = 0; i < blob_ids.size(); ++i) {
+      const int group = blob_group[blob_ids[i]];
+      if (group < 0) { continue; }
+      first_use[group] = std::min(first_use[group], layer_id);
+      last_use[group] = std::max(last_use[group], layer_id);
+      if (bottom_vecs_[layer_id].empty()) { pinned[group] = true; }
+    }
+  }
+  vector<vector<int> > groups_from(layers_.size());
+  vector<vector<int> > groups_until(layers_.size());
+  for (int group = 0; group < num_groups; ++group) {
+    if (pinned[group] || last_use[group] < 0) { continue; }
+    groups_from[first_use[group]].push_back(group);
+    groups_until[last_use[group]].push_back(group);
+  }
+  // Going through the layers, give each group the smallest free buffer it
+  // fits in, or else grow the largest free buffer, and free its buffer
+  // after its last layer.
+  vector<size_t> buffer_bytes;
+  vector<int> free_buffers;
+  vector<int> group_buffer(num_groups, -1);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int i = 0; i < groups_from[layer_id].size(); ++i) {
+      const int group = groups_from[layer_id][i];
+      const size_t bytes = group_bytes[group];
+      int best = -1;
+      for (int j = 0; j < free_buffers.size(); ++j) {
+        const size_t free_bytes = buffer_bytes[free_buffers[j]];
+        const size_t best_bytes =
+            best < 0 ? 0 : buffer_bytes[free_buffers[best]];
+        const bool better = free_bytes >= bytes ?
+            best_bytes < bytes || free_bytes < best_bytes :
+            best_bytes < bytes && free_bytes > best_bytes;
+        if (best < 0 || better) { best = j; }
+      }
+      if (best < 0) {
+        group_buffer[group] = buffer_bytes.size();
+        buffer_bytes.push_back(bytes);
+      } else {
+        group_buffer[group] = free_buffers[best];
+        free_buffers.erase(free_buffers.begin() + best);
+        buffer_bytes[group_buffer[group]] =
+            std::max(buffer_bytes[group_buffer[group]], bytes);
+      }
+    }
+    for (int i = 0; i < groups_until[layer_id].size(); ++i) {
+      free_buffers.push_back(group_buffer[groups_until[layer_id][i]]);
+    }
+  }
+  vector<shared_ptr<SyncedMemory> > buffers(buffer_bytes.size());
+  for (int i = 0; i < buffers.size(); ++i) {
+    buffers[i].reset(new SyncedMemory(buffer_bytes[i]));
+  }
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    const int group = blob_group[blob_id];
+    if (group >= 0 && group_buffer[group] >= 0) {
+      blobs_[blob_id]->set_data_memory(buffers[group_buffer[group]]);
+    }
+  }
+  size_t unshared_bytes = 0;
+  size_t shared_bytes = 0;
+  for (int group = 0; group < num_groups; ++group) {
+    unshared_bytes += group_bytes[group];
+    if (group_buffer[group] < 0) { shared_bytes += group_bytes[group]; }
+  }
+  for (int i = 0; i < buffer_bytes.size(); ++i) {
+    shared_bytes += buffer_bytes[i];
+  }
+  if (Caffe::root_solver()) {
+    LOG(INFO) << "Activation memory: " << unshared_bytes << " bytes, "
+              << shared_bytes << " bytes with " << buffers.size()
+              << " shared buffers";
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::FilterNet(const NetParameter& param,
     NetParameter* param_filtered) {
@@ -595,10 +712,16 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
     }
   }
   for (int i = start; i <= end; ++i) {
+    for (int c = 0; c < before_forward_.size(); ++c) {
+      before_forward_[c]->run(i);
+    }
     // LOG(ERROR) << "Forwarding " << layer_names_[i];
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
+    for (int c = 0; c < after_forward_.size(); ++c) {
+      after_forward_[c]->run(i);
+    }
   }
   return loss;
 }
@@ -660,13 +783,29 @@ void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_LT(start, layers_.size());
   for (int i = start; i >= end; --i) {
     if (layer_need_backward_[i]) {
+      for (int c = 0; c < before_backward_.size(); ++c) {
+        before_backward_[c]->run(i);
+      }
       layers_[i]->Backward(
           top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
       if (debug_info_) { BackwardDebugInfo(i); }
+      for (int c = 0; c < after_backward_.size(); ++c) {
+        after_backward_[c]->run(i);
+      }
     }
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::RemoveCallback(Callback* value) {
+  vector<Callback*>* lists[] = { &before_forward_, &after_forward_,
+      &before_backward_, &after_backward_ };
+  for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); ++i) {
+    lists[i]->erase(std::remove(lists[i]->begin(), lists[i]->end(), value),
+                    lists[i]->end());
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::InputDebugInfo(const int input_id) {
   const Blob<Dtype>& blob = *net_input_blobs_[input_id];
@@ -795,6 +934,20 @@ void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::CopyParamsFrom(const Net& other) {
+  const vector<Blob<Dtype>*>& source_params = other.learnable_params();
+  CHECK_EQ(learnable_params_.size(), source_params.size())
+      << "Incompatible number of learnable params";
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    CHECK(learnable_params_[i]->shape() == source_params[i]->shape())
+        << "Cannot copy learnable param " << i << "; shape mismatch.  "
+        << "Source param shape is " << source_params[i]->shape_string()
+        << "; target param shape is " << learnable_params_[i]->shape_string();
+    learnable_params_[i]->CopyFrom(*source_params[i]);
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::BackwardFrom(int start) {
   BackwardFromTo(start, 0);
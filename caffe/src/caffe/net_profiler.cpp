@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/net_profiler.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+NetProfiler<Dtype>::NetProfiler(Net<Dtype>* net, const int window)
+    : net_(net), window_(window),
+      before_forward_(this, false, false), after_forward_(this, false, true),
+      before_backward_(this, true, false), after_backward_(this, true, true),
+      epoch_(boost::posix_time::microsec_clock::local_time()),
+      forward_(net->layers().size()), backward_(net->layers().size()),
+      trace_empty_(true) {
+  CHECK_GT(window, 0);
+  net_->add_before_forward(&before_forward_);
+  net_->add_after_forward(&after_forward_);
+  net_->add_before_backward(&before_backward_);
+  net_->add_after_backward(&after_backward_);
+}
+
+template <typename Dtype>
+NetProfiler<Dtype>::~NetProfiler() {
+  net_->RemoveCallback(&before_forward_);
+  net_->RemoveCallback(&after_forward_);
+  net_->RemoveCallback(&before_backward_);
+  net_->RemoveCallback(&after_backward_);
+  if (trace_.is_open()) {
+    trace_ << "\n]\n";
+  }
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::StartTrace(const string& path) {
+  CHECK(!trace_.is_open()) << "Already tracing";
+  trace_.open(path.c_str());
+  CHECK(trace_) << "Cannot open " << path;
+  // JSON array format, which viewers accept without the closing bracket
+  // should the process be killed
+  trace_ << "[";
+  trace_empty_ = true;
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::LayerCallback::run(int layer) {
+  if (after_) {
+    profiler_->End(layer, backward_);
+  } else {
+    profiler_->Begin(layer);
+  }
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::Begin(const int layer) {
+  if (trace_.is_open()) {
+    begin_time_ = boost::posix_time::microsec_clock::local_time();
+  }
+  timer_.Start();
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::End(const int layer, const bool backward) {
+  timer_.Stop();
+  // MilliSeconds is whole milliseconds on the CPU
+  const double ms = timer_.MicroSeconds() / 1000;
+  Durations& durations = backward ? backward_[layer] : forward_[layer];
+  if (durations.ms.size() < window_) {
+    durations.ms.push_back(ms);
+  } else {
+    durations.ms[durations.next] = ms;
+  }
+  durations.next = (durations.next + 1) % window_;
+  // The shapes may change between passes
+  EstimateForwardCost(net_->layers()[layer].get(),
+      net_->bottom_vecs()[layer], net_->top_vecs()[layer], &durations.flops,
+      &durations.bytes);
+  if (backward) {
+    durations.flops *= 2;
+    durations.bytes *= 2;
+  }
+  if (trace_.is_open()) {
+    trace_ << (trace_empty_ ? "\n" : ",\n") << std::fixed
+        << std::setprecision(3)
+        << "{\"name\":\"" << net_->layer_names()[layer]
+        << "\",\"cat\":\"" << (backward ? "backward" : "forward")
+        << "\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":"
+        << (begin_time_ - epoch_).total_microseconds()
+        << ",\"dur\":" << ms * 1000 << ",\"args\":{\"type\":\""
+        << net_->layers()[layer]->type() << "\",\"flops\":"
+        << durations.flops << ",\"bytes\":" << durations.bytes << "}}";
+    trace_empty_ = false;
+    if (layer == 0) {
+      // Keep the file whole up to the last pass should the process be killed
+      trace_.flush();
+    }
+  }
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::EstimateForwardCost(Layer<Dtype>* layer,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top,
+    double* flops, double* bytes) {
+  double count = 0;
+  for (int i = 0; i < bottom.size(); ++i) {
+    count += bottom[i]->count();
+  }
+  double outputs = 0;
+  for (int i = 0; i < top.size(); ++i) {
+    outputs += top[i]->count();
+  }
+  count += outputs;
+  for (int i = 0; i < layer->blobs().size(); ++i) {
+    count += layer->blobs()[i]->count();
+  }
+  *bytes = count * sizeof(Dtype);
+  *flops = outputs;
+  const string type = layer->type();
+  if (!layer->blobs().empty() && !top.empty() && (type == "Convolution" ||
+      type == "InnerProduct" || type == "Deconvolution")) {
+    // Each output, or input for deconvolution, takes one multiply-add per
+    // weight of its output, or input, channel
+    const Blob<Dtype>& weights = *layer->blobs()[0];
+    const double weights_per_channel =
+        static_cast<double>(weights.count()) / weights.shape(0);
+    const double values =
+        type == "Deconvolution" ? bottom[0]->count() : top[0]->count();
+    *flops = 2 * values * weights_per_channel;
+  }
+}
+
+template <typename Dtype>
+vector<typename NetProfiler<Dtype>::LayerStats>
+NetProfiler<Dtype>::Stats() const {
+  vector<LayerStats> stats(net_->layers().size());
+  for (int i = 0; i < stats.size(); ++i) {
+    LayerStats& layer = stats[i];
+    layer.name = net_->layer_names()[i];
+    layer.type = net_->layers()[i]->type();
+    const Durations* durations[] = { &forward_[i], &backward_[i] };
+    int* counts[] = { &layer.forward_count, &layer.backward_count };
+    double* means[] = { &layer.forward_ms, &layer.backward_ms };
+    double* maxima[] = { &layer.forward_max_ms, &layer.backward_max_ms };
+    for (int d = 0; d < 2; ++d) {
+      const vector<double>& ms = durations[d]->ms;
+      *counts[d] = ms.size();
+      *means[d] = 0;
+      *maxima[d] = 0;
+      for (int j = 0; j < ms.size(); ++j) {
+        *means[d] += ms[j] / ms.size();
+        *maxima[d] = std::max(*maxima[d], ms[j]);
+      }
+    }
+    layer.forward_flops = forward_[i].flops;
+    layer.forward_bytes = forward_[i].bytes;
+    layer.backward_flops = backward_[i].flops;
+    layer.backward_bytes = backward_[i].bytes;
+  }
+  return stats;
+}
+
+template <typename Dtype>
+string NetProfiler<Dtype>::Report() const {
+  const vector<LayerStats> stats = Stats();
+  double total_ms = 0;
+  for (int i = 0; i < stats.size(); ++i) {
+    total_ms += stats[i].forward_ms + stats[i].backward_ms;
+  }
+  std::ostringstream report;
+  report << std::fixed << std::setprecision(3)
+      << "Layers of " << net_->name() << " over the last " << window_
+      << " passes (forward, backward: mean/max ms, share, GFLOP/s, GB/s)";
+  for (int i = 0; i < stats.size(); ++i) {
+    const LayerStats& layer = stats[i];
+    const double ms[] = { layer.forward_ms, layer.backward_ms };
+    const double max_ms[] = { layer.forward_max_ms, layer.backward_max_ms };
+    const int counts[] = { layer.forward_count, layer.backward_count };
+    const double flops[] = { layer.forward_flops, layer.backward_flops };
+    const double bytes[] = { layer.forward_bytes, layer.backward_bytes };
+    report << "\n  " << std::setw(20) << std::left << layer.name
+        << std::setw(18) << layer.type << std::right;
+    for (int d = 0; d < 2; ++d) {
+      if (counts[d] == 0) {
+        report << std::setw(46) << "-";
+        continue;
+      }
+      report << std::setprecision(3) << std::setw(10) << ms[d]
+          << std::setw(10) << max_ms[d] << std::setprecision(1)
+          << std::setw(7) << (total_ms > 0 ? 100 * ms[d] / total_ms : 0)
+          << "%" << std::setw(9)
+          << (ms[d] > 0 ? flops[d] / ms[d] / 1e6 : 0)
+          << std::setw(9) << (ms[d] > 0 ? bytes[d] / ms[d] / 1e6 : 0);
+    }
+  }
+  report << std::setprecision(3) << "\n  total " << total_ms << " ms";
+  return report.str();
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::Reset() {
+  forward_.assign(net_->layers().size(), Durations());
+  backward_.assign(net_->layers().size(), Durations());
+}
+
+INSTANTIATE_CLASS(NetProfiler);
+
+}  // namespace caffe
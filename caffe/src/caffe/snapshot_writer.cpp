@@ -0,0 +1,147 @@
+#include <boost/thread.hpp>
+
+#include <string>
+#include <vector>
+
+#include "caffe/snapshot_writer.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class SnapshotWriter<Dtype>::sync {
+ public:
+  mutable boost::mutex mutex_;
+  boost::condition_variable condition_;
+};
+
+template <typename Dtype>
+SnapshotWriter<Dtype>::SnapshotWriter(const Net<Dtype>& net)
+    : write_diff_(false), sync_(new sync()), pending_(false) {
+  // What Net::ToProto writes, minus the blobs, which are staged instead
+  net_param_.set_name(net.name());
+  for (int i = 0; i < net.input_blob_indices().size(); ++i) {
+    net_param_.add_input(net.blob_names()[net.input_blob_indices()[i]]);
+  }
+  params_.resize(net.layers().size());
+  for (int i = 0; i < net.layers().size(); ++i) {
+    LayerParameter* layer_param = net_param_.add_layer();
+    layer_param->CopyFrom(net.layers()[i]->layer_param());
+    layer_param->clear_blobs();
+    for (int j = 0; j < net.layers()[i]->blobs().size(); ++j) {
+      params_[i].push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    }
+  }
+  StartInternalThread();
+}
+
+template <typename Dtype>
+SnapshotWriter<Dtype>::~SnapshotWriter() {
+  Wait();
+  StopInternalThread();
+}
+
+// Copies the data, and the diff if asked to, into the staging blob
+template <typename Dtype>
+static void StageBlob(const Blob<Dtype>& source, const bool write_diff,
+    Blob<Dtype>* staged) {
+  staged->ReshapeLike(source);
+  caffe_copy(source.count(), source.cpu_data(), staged->mutable_cpu_data());
+  if (write_diff) {
+    caffe_copy(source.count(), source.cpu_diff(), staged->mutable_cpu_diff());
+  }
+}
+
+template <typename Dtype>
+void SnapshotWriter<Dtype>::Stage(const Net<Dtype>& net,
+    const vector<shared_ptr<Blob<Dtype> > >& history, const bool write_diff,
+    const SolverState& state, const string& model_filename,
+    const string& state_filename) {
+  CHECK(!busy()) << "The previous snapshot is still being written";
+  CHECK_EQ(net.layers().size(), params_.size());
+  for (int i = 0; i < params_.size(); ++i) {
+    const vector<shared_ptr<Blob<Dtype> > >& blobs = net.layers()[i]->blobs();
+    CHECK_EQ(blobs.size(), params_[i].size());
+    for (int j = 0; j < blobs.size(); ++j) {
+      StageBlob(*blobs[j], write_diff, params_[i][j].get());
+    }
+  }
+  history_.resize(history.size());
+  for (int i = 0; i < history.size(); ++i) {
+    if (!history_[i]) {
+      history_[i].reset(new Blob<Dtype>());
+    }
+    StageBlob(*history[i], false, history_[i].get());
+  }
+  write_diff_ = write_diff;
+  state_.CopyFrom(state);
+  model_filename_ = model_filename;
+  state_filename_ = state_filename;
+
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  pending_ = true;
+  lock.unlock();
+  sync_->condition_.notify_all();
+}
+
+template <typename Dtype>
+bool SnapshotWriter<Dtype>::busy() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return pending_;
+}
+
+template <typename Dtype>
+void SnapshotWriter<Dtype>::Wait() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (pending_) {
+    sync_->condition_.wait(lock);
+  }
+}
+
+template <typename Dtype>
+void SnapshotWriter<Dtype>::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      boost::mutex::scoped_lock lock(sync_->mutex_);
+      while (!pending_) {
+        sync_->condition_.wait(lock);
+      }
+      lock.unlock();
+      Write();
+      lock.lock();
+      pending_ = false;
+      lock.unlock();
+      sync_->condition_.notify_all();
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted while waiting for a snapshot, exit normally
+  }
+}
+
+template <typename Dtype>
+void SnapshotWriter<Dtype>::Write() {
+  LOG(INFO) << "Snapshotting to binary proto file " << model_filename_;
+  NetParameter net_param(net_param_);
+  for (int i = 0; i < params_.size(); ++i) {
+    LayerParameter* layer_param = net_param.mutable_layer(i);
+    for (int j = 0; j < params_[i].size(); ++j) {
+      params_[i][j]->ToProto(layer_param->add_blobs(), write_diff_);
+    }
+  }
+  WriteProtoToBinaryFileDurably(net_param, model_filename_);
+
+  LOG(INFO)
+    << "Snapshotting solver state to binary proto file " << state_filename_;
+  SolverState state(state_);
+  state.set_learned_net(model_filename_);
+  state.clear_history();
+  for (int i = 0; i < history_.size(); ++i) {
+    history_[i]->ToProto(state.add_history());
+  }
+  WriteProtoToBinaryFileDurably(state, state_filename_);
+}
+
+INSTANTIATE_CLASS(SnapshotWriter);
+
+}  // namespace caffe
@@ -34,14 +34,14 @@ SolverAction::Enum Solver<Dtype>::GetRequestedAction() {
 template <typename Dtype>
 Solver<Dtype>::Solver(const SolverParameter& param, const Solver* root_solver)
     : net_(), callbacks_(), root_solver_(root_solver),
-      requested_early_exit_(false) {
+      requested_early_exit_(false), snapshot_deferred_(false) {
   Init(param);
 }
 
 template <typename Dtype>
 Solver<Dtype>::Solver(const string& param_file, const Solver* root_solver)
     : net_(), callbacks_(), root_solver_(root_solver),
-      requested_early_exit_(false) {
+      requested_early_exit_(false), snapshot_deferred_(false) {
   SolverParameter param;
   ReadProtoFromTextFileOrDie(param_file, &param);
   Init(param);
@@ -56,6 +56,9 @@ void Solver<Dtype>::Init(const SolverParameter& param) {
   param_ = param;
   CHECK_GE(param_.average_loss(), 1) << "average_loss should be non-negative.";
   CheckSnapshotWritePermissions();
+  LOG_IF(WARNING, param_.snapshot_async() && param_.snapshot_format() !=
+      caffe::SolverParameter_SnapshotFormat_BINARYPROTO)
+      << "Only BINARYPROTO snapshots are written asynchronously.";
   if (Caffe::root_solver() && param_.random_seed() >= 0) {
     Caffe::set_random_seed(param_.random_seed());
   }
@@ -277,7 +280,7 @@ void Solver<Dtype>::Step(int iters) {
     if ((param_.snapshot()
          && iter_ % param_.snapshot() == 0
          && Caffe::root_solver()) ||
-         (request == SolverAction::SNAPSHOT)) {
+         (request == SolverAction::SNAPSHOT) || snapshot_deferred_) {
       Snapshot();
     }
     if (SolverAction::STOP == request) {
@@ -311,6 +314,7 @@ void Solver<Dtype>::Solve(const char* resume_file) {
       && (!param_.snapshot() || iter_ % param_.snapshot() != 0)) {
     Snapshot();
   }
+  WaitForSnapshot();
   if (requested_early_exit_) {
     LOG(INFO) << "Optimization stopped early.";
     return;
@@ -420,6 +424,12 @@ void Solver<Dtype>::Test(const int test_net_id) {
 template <typename Dtype>
 void Solver<Dtype>::Snapshot() {
   CHECK(Caffe::root_solver());
+  if (param_.snapshot_async() && SnapshotHistory() &&
+      param_.snapshot_format() ==
+      caffe::SolverParameter_SnapshotFormat_BINARYPROTO) {
+    SnapshotAsync();
+    return;
+  }
   string model_filename;
   switch (param_.snapshot_format()) {
   case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
@@ -435,6 +445,62 @@ void Solver<Dtype>::Snapshot() {
   SnapshotSolverState(model_filename);
 }
 
+template <typename Dtype>
+void Solver<Dtype>::SnapshotAsync() {
+  if (!snapshot_writer_) {
+    snapshot_writer_.reset(new SnapshotWriter<Dtype>(*net_));
+  }
+  if (snapshot_writer_->busy()) {
+    // Back off rather than stall training, and try again after the next
+    // iteration
+    LOG_IF(INFO, !snapshot_deferred_) << "Deferring the snapshot of iteration "
+        << iter_ << " until the previous one is written";
+    snapshot_deferred_ = true;
+    return;
+  }
+  snapshot_deferred_ = false;
+  SolverState state;
+  state.set_iter(iter_);
+  state.set_current_step(current_step_);
+  snapshot_writer_->Stage(*net_, *SnapshotHistory(), param_.snapshot_diff(),
+      state, SnapshotFilename(".caffemodel"),
+      SnapshotFilename(".solverstate"));
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WaitForSnapshot() {
+  if (!snapshot_writer_) {
+    return;
+  }
+  snapshot_writer_->Wait();
+  if (snapshot_deferred_) {
+    SnapshotAsync();
+    snapshot_writer_->Wait();
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::SnapshotTo(const string& model_filename,
+    const string& state_filename) {
+  CHECK(Caffe::root_solver());
+  const vector<shared_ptr<Blob<Dtype> > >* history = SnapshotHistory();
+  CHECK(history) << "This solver cannot snapshot to given files";
+  LOG(INFO) << "Snapshotting to binary proto file " << model_filename;
+  NetParameter net_param;
+  net_->ToProto(&net_param, param_.snapshot_diff());
+  WriteProtoToBinaryFileDurably(net_param, model_filename);
+  LOG(INFO)
+    << "Snapshotting solver state to binary proto file " << state_filename;
+  SolverState state;
+  state.set_iter(iter_);
+  state.set_current_step(current_step_);
+  state.set_learned_net(model_filename);
+  for (int i = 0; i < history->size(); ++i) {
+    (*history)[i]->ToProto(state.add_history());
+  }
+  WriteProtoToBinaryFileDurably(state, state_filename);
+}
+
 template <typename Dtype>
 void Solver<Dtype>::CheckSnapshotWritePermissions() {
   if (Caffe::root_solver() && param_.snapshot()) {
@@ -562,23 +628,30 @@ void SGDSolver<Dtype>::PreSolve() {
 }
 
 template <typename Dtype>
-void SGDSolver<Dtype>::ClipGradients() {
+Dtype SGDSolver<Dtype>::GetClipScale() {
   const Dtype clip_gradients = this->param_.clip_gradients();
-  if (clip_gradients < 0) { return; }
+  if (clip_gradients < 0) { return Dtype(1); }
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
   Dtype sumsq_diff = 0;
   for (int i = 0; i < net_params.size(); ++i) {
     sumsq_diff += net_params[i]->sumsq_diff();
   }
   const Dtype l2norm_diff = std::sqrt(sumsq_diff);
-  if (l2norm_diff > clip_gradients) {
-    Dtype scale_factor = clip_gradients / l2norm_diff;
-    LOG(INFO) << "Gradient clipping: scaling down gradients (L2 norm "
-        << l2norm_diff << " > " << clip_gradients << ") "
-        << "by scale factor " << scale_factor;
-    for (int i = 0; i < net_params.size(); ++i) {
-      net_params[i]->scale_diff(scale_factor);
-    }
+  if (l2norm_diff <= clip_gradients) { return Dtype(1); }
+  Dtype scale_factor = clip_gradients / l2norm_diff;
+  LOG(INFO) << "Gradient clipping: scaling down gradients (L2 norm "
+      << l2norm_diff << " > " << clip_gradients << ") "
+      << "by scale factor " << scale_factor;
+  return scale_factor;
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::ClipGradients() {
+  const Dtype scale_factor = GetClipScale();
+  if (scale_factor == Dtype(1)) { return; }
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  for (int i = 0; i < net_params.size(); ++i) {
+    net_params[i]->scale_diff(scale_factor);
   }
 }
 
@@ -589,6 +662,14 @@ void SGDSolver<Dtype>::ApplyUpdate() {
   if (this->param_.display() && this->iter_ % this->param_.display() == 0) {
     LOG(INFO) << "Iteration " << this->iter_ << ", lr = " << rate;
   }
+  if (Caffe::mode() == Caffe::CPU && has_fused_update()) {
+    const Dtype diff_scale = GetClipScale() / this->param_.iter_size();
+    for (int param_id = 0; param_id < this->net_->learnable_params().size();
+         ++param_id) {
+      ComputeFusedUpdate(param_id, rate, diff_scale);
+    }
+    return;
+  }
   ClipGradients();
   for (int param_id = 0; param_id < this->net_->learnable_params().size();
        ++param_id) {
@@ -687,6 +768,25 @@ void SGDSolver<Dtype>::Regularize(int param_id) {
   }
 }
 
+template <typename Dtype>
+void SGDSolver<Dtype>::GetWeightDecay(int param_id, Dtype* l2_decay,
+    Dtype* l1_decay) {
+  const Dtype local_decay = this->param_.weight_decay() *
+      this->net_->params_weight_decay()[param_id];
+  const string& regularization_type = this->param_.regularization_type();
+  *l2_decay = 0;
+  *l1_decay = 0;
+  if (!local_decay) {
+    return;
+  } else if (regularization_type == "L2") {
+    *l2_decay = local_decay;
+  } else if (regularization_type == "L1") {
+    *l1_decay = local_decay;
+  } else {
+    LOG(FATAL) << "Unknown regularization type: " << regularization_type;
+  }
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
@@ -1041,6 +1141,18 @@ void RMSPropSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void RMSPropSolver<Dtype>::ComputeFusedUpdate(int param_id, Dtype rate,
+    Dtype diff_scale) {
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  Dtype l2_decay, l1_decay;
+  this->GetWeightDecay(param_id, &l2_decay, &l1_decay);
+  caffe_cpu_rmsprop_update(param->count(), diff_scale, l2_decay, l1_decay,
+      Dtype(this->param_.rms_decay()), Dtype(this->param_.delta()),
+      rate * this->net_->params_lr()[param_id], param->mutable_cpu_data(),
+      param->mutable_cpu_diff(), this->history_[param_id]->mutable_cpu_data());
+}
+
 template <typename Dtype>
 void AdaDeltaSolver<Dtype>::AdaDeltaPreSolve() {
   // Add the extra history entries for AdaDelta after those from
@@ -1187,6 +1299,20 @@ void AdaDeltaSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdaDeltaSolver<Dtype>::ComputeFusedUpdate(int param_id, Dtype rate,
+    Dtype diff_scale) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  Blob<Dtype>* param = net_params[param_id];
+  Dtype l2_decay, l1_decay;
+  this->GetWeightDecay(param_id, &l2_decay, &l1_decay);
+  caffe_cpu_adadelta_update(param->count(), diff_scale, l2_decay, l1_decay,
+      Dtype(this->param_.momentum()), Dtype(this->param_.delta()),
+      rate * this->net_->params_lr()[param_id], param->mutable_cpu_data(),
+      param->mutable_cpu_diff(), this->history_[param_id]->mutable_cpu_data(),
+      this->history_[net_params.size() + param_id]->mutable_cpu_data());
+}
+
 template <typename Dtype>
 void AdamSolver<Dtype>::AdamPreSolve() {
   // Add the extra history entries for Adam after those from
@@ -1290,6 +1416,26 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdamSolver<Dtype>::ComputeFusedUpdate(int param_id, Dtype rate,
+    Dtype diff_scale) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  Blob<Dtype>* param = net_params[param_id];
+  Dtype l2_decay, l1_decay;
+  this->GetWeightDecay(param_id, &l2_decay, &l1_decay);
+  const Dtype beta1 = this->param_.momentum();
+  const Dtype beta2 = this->param_.momentum2();
+  const int t = this->iter_ + 1;
+  const Dtype correction = std::sqrt(Dtype(1) - pow(beta2, t)) /
+      (Dtype(1.) - pow(beta1, t));
+  caffe_cpu_adam_update(param->count(), diff_scale, l2_decay, l1_decay,
+      beta1, beta2, Dtype(this->param_.delta()),
+      rate * this->net_->params_lr()[param_id] * correction,
+      param->mutable_cpu_data(), param->mutable_cpu_diff(),
+      this->history_[param_id]->mutable_cpu_data(),
+      this->history_[net_params.size() + param_id]->mutable_cpu_data());
+}
+
 INSTANTIATE_CLASS(Solver);
 INSTANTIATE_CLASS(SGDSolver);
 INSTANTIATE_CLASS(NesterovSolver);
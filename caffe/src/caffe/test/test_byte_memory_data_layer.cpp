@@ -0,0 +1,105 @@
+#include <vector>
+
+#include "caffe/data_layers.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class ByteMemoryDataLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  ByteMemoryDataLayerTest()
+    : data_blob_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    batch_size_ = 8;
+    batches_ = 12;
+    channels_ = 4;
+    height_ = 7;
+    width_ = 11;
+    blob_top_vec_.push_back(data_blob_);
+    data_.resize(batches_ * batch_size_ * channels_ * height_ * width_);
+    for (int i = 0; i < data_.size(); ++i) {
+      data_[i] = caffe_rng_rand() % 256;
+    }
+    md_param_ = layer_param_.mutable_memory_data_param();
+    md_param_->set_batch_size(batch_size_);
+    md_param_->set_channels(channels_);
+    md_param_->set_height(height_);
+    md_param_->set_width(width_);
+  }
+
+  virtual ~ByteMemoryDataLayerTest() {
+    delete data_blob_;
+  }
+  int batch_size_;
+  int batches_;
+  int channels_;
+  int height_;
+  int width_;
+  vector<uint8_t> data_;
+  LayerParameter layer_param_;
+  MemoryDataParameter* md_param_;
+  // blob for the top of ByteMemoryDataLayer
+  Blob<Dtype>* const data_blob_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(ByteMemoryDataLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(ByteMemoryDataLayerTest, TestSetup) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  ByteMemoryDataLayer<Dtype> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->data_blob_->num(), this->batch_size_);
+  EXPECT_EQ(this->data_blob_->channels(), this->channels_);
+  EXPECT_EQ(this->data_blob_->height(), this->height_);
+  EXPECT_EQ(this->data_blob_->width(), this->width_);
+}
+
+// run through a few batches and check that the right bytes appear
+TYPED_TEST(ByteMemoryDataLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  ByteMemoryDataLayer<Dtype> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Reset(&this->data_[0], this->batches_ * this->batch_size_);
+  const int batch_bytes = this->data_blob_->count();
+  for (int i = 0; i < this->batches_ * 3; ++i) {
+    const int batch_num = i % this->batches_;
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    const uint8_t* top_bytes =
+        reinterpret_cast<const uint8_t*>(this->data_blob_->cpu_data());
+    for (int j = 0; j < batch_bytes; ++j) {
+      EXPECT_EQ(top_bytes[j], this->data_[batch_bytes * batch_num + j]);
+    }
+  }
+}
+
+TYPED_TEST(ByteMemoryDataLayerTest, TestSetBatchSize) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  ByteMemoryDataLayer<Dtype> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int new_batch_size = 3;
+  layer.set_batch_size(new_batch_size);
+  layer.Reset(&this->data_[0], new_batch_size * 2);
+  const int item_bytes = this->channels_ * this->height_ * this->width_;
+  for (int i = 0; i < 4; ++i) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(this->data_blob_->num(), new_batch_size);
+    const uint8_t* top_bytes =
+        reinterpret_cast<const uint8_t*>(this->data_blob_->cpu_data());
+    for (int j = 0; j < new_batch_size * item_bytes; ++j) {
+      EXPECT_EQ(top_bytes[j],
+                this->data_[(i % 2) * new_batch_size * item_bytes + j]);
+    }
+  }
+}
+
+}  // namespace caffe
@@ -5,7 +5,9 @@
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
+#include "caffe/data_layers.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/layer_factory.hpp"
 #include "caffe/vision_layers.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -608,6 +610,87 @@ TYPED_TEST(ConvolutionLayerTest, TestNDAgainst2D) {
   }
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestBatchedAgainstPerImage) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> bottom_shape(4);
+  bottom_shape[0] = 5;
+  bottom_shape[1] = 4;
+  bottom_shape[2] = 11;
+  bottom_shape[3] = 9;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  this->blob_bottom_->Reshape(bottom_shape);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(2);
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->add_pad(1);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  Blob<Dtype> weights;
+  Blob<Dtype> bias;
+  Blob<Dtype> top_diff;
+  {
+    ConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    top_diff.ReshapeLike(*this->blob_top_);
+    filler.Fill(&top_diff);
+    weights.CopyFrom(*layer.blobs()[0], false, true);
+    bias.CopyFrom(*layer.blobs()[1], false, true);
+  }
+  // The column and output buffers of one image: 6 x 5 outputs, each made
+  // of 4 x 3 x 3 inputs and giving 6 channels.
+  const uint64_t image_bytes = sizeof(Dtype) * 6 * 5 * (4 * 3 * 3 + 6);
+  // One image at a time, two images (leaving one alone), all images
+  const uint64_t limits[] = {0, 2 * image_bytes, 67108864};
+  vector<bool> propagate_down(1, true);
+  Blob<Dtype> results[3];
+  Blob<Dtype> bottom_diffs[3];
+  Blob<Dtype> weight_diffs[3];
+  Blob<Dtype> bias_diffs[3];
+  for (int i = 0; i < 3; ++i) {
+    convolution_param->set_cpu_workspace_limit(limits[i]);
+    ConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.blobs()[0]->CopyFrom(weights, false, false);
+    layer.blobs()[1]->CopyFrom(bias, false, false);
+    caffe_set(weights.count(), Dtype(0), layer.blobs()[0]->mutable_cpu_diff());
+    caffe_set(bias.count(), Dtype(0), layer.blobs()[1]->mutable_cpu_diff());
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    results[i].CopyFrom(*this->blob_top_, false, true);
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+               this->blob_top_->mutable_cpu_diff());
+    layer.Backward(this->blob_top_vec_, propagate_down,
+                   this->blob_bottom_vec_);
+    bottom_diffs[i].CopyFrom(*this->blob_bottom_, true, true);
+    weight_diffs[i].CopyFrom(*layer.blobs()[0], true, true);
+    bias_diffs[i].CopyFrom(*layer.blobs()[1], true, true);
+  }
+  const Dtype kErrorMargin = 1e-4;
+  for (int i = 1; i < 3; ++i) {
+    for (int j = 0; j < results[0].count(); ++j) {
+      EXPECT_NEAR(results[0].cpu_data()[j], results[i].cpu_data()[j],
+                  kErrorMargin);
+    }
+    for (int j = 0; j < bottom_diffs[0].count(); ++j) {
+      EXPECT_NEAR(bottom_diffs[0].cpu_diff()[j], bottom_diffs[i].cpu_diff()[j],
+                  kErrorMargin);
+    }
+    for (int j = 0; j < weight_diffs[0].count(); ++j) {
+      EXPECT_NEAR(weight_diffs[0].cpu_diff()[j], weight_diffs[i].cpu_diff()[j],
+                  kErrorMargin);
+    }
+    for (int j = 0; j < bias_diffs[0].count(); ++j) {
+      EXPECT_NEAR(bias_diffs[0].cpu_diff()[j], bias_diffs[i].cpu_diff()[j],
+                  kErrorMargin);
+    }
+  }
+}
+
 TYPED_TEST(ConvolutionLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -689,6 +772,365 @@ TYPED_TEST(ConvolutionLayerTest, TestGradientGroup) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestSimpleConvolutionDirect) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_vec_.push_back(this->blob_bottom_2_);
+  this->blob_top_vec_.push_back(this->blob_top_2_);
+  LayerParameter layer_param;
+  layer_param.set_type("Convolution");
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(4);
+  convolution_param->set_engine(ConvolutionParameter_Engine_DIRECT);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  shared_ptr<Layer<Dtype> > layer =
+      LayerRegistry<Dtype>::CreateLayer(layer_param);
+  EXPECT_TRUE(dynamic_cast<DirectConvolutionLayer<Dtype>*>(layer.get()));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Check against reference convolution.
+  const Dtype* top_data;
+  const Dtype* ref_top_data;
+  caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  top_data = this->blob_top_->cpu_data();
+  ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+  }
+  caffe_conv(this->blob_bottom_2_, convolution_param, layer->blobs(),
+      this->MakeReferenceTop(this->blob_top_2_));
+  top_data = this->blob_top_2_->cpu_data();
+  ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestDirectAgainstCaffe) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Strided kernels like those of the DQN, with output rows that are not a
+  // multiple of the pixel block and an odd number of outputs; the last one
+  // is padded and runs the fallback.
+  const int heights[] = {20, 11, 9};
+  const int widths[] = {20, 16, 9};
+  const int kernels[] = {8, 4, 3};
+  const int strides[] = {4, 2, 1};
+  const int pads[] = {0, 0, 1};
+  for (int c = 0; c < 3; ++c) {
+    vector<int> bottom_shape(4);
+    bottom_shape[0] = 3;
+    bottom_shape[1] = 4;
+    bottom_shape[2] = heights[c];
+    bottom_shape[3] = widths[c];
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    this->blob_bottom_->Reshape(bottom_shape);
+    filler.Fill(this->blob_bottom_);
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->set_num_output(5);
+    convolution_param->add_kernel_size(kernels[c]);
+    convolution_param->add_stride(strides[c]);
+    convolution_param->add_pad(pads[c]);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    Blob<Dtype> weights;
+    Blob<Dtype> bias;
+    Blob<Dtype> top_diff;
+    {
+      ConvolutionLayer<Dtype> layer(layer_param);
+      layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      top_diff.ReshapeLike(*this->blob_top_);
+      filler.Fill(&top_diff);
+      weights.CopyFrom(*layer.blobs()[0], false, true);
+      bias.CopyFrom(*layer.blobs()[1], false, true);
+    }
+    vector<bool> propagate_down(1, true);
+    Blob<Dtype> results[2];
+    Blob<Dtype> bottom_diffs[2];
+    Blob<Dtype> weight_diffs[2];
+    Blob<Dtype> bias_diffs[2];
+    for (int i = 0; i < 2; ++i) {
+      shared_ptr<Layer<Dtype> > layer(i == 0 ?
+          new ConvolutionLayer<Dtype>(layer_param) :
+          new DirectConvolutionLayer<Dtype>(layer_param));
+      layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      layer->blobs()[0]->CopyFrom(weights, false, false);
+      layer->blobs()[1]->CopyFrom(bias, false, false);
+      // Weight gradients accumulate, so start from something other than 0
+      caffe_set(weights.count(), Dtype(1),
+                layer->blobs()[0]->mutable_cpu_diff());
+      caffe_set(bias.count(), Dtype(0), layer->blobs()[1]->mutable_cpu_diff());
+      layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      results[i].CopyFrom(*this->blob_top_, false, true);
+      caffe_copy(top_diff.count(), top_diff.cpu_data(),
+                 this->blob_top_->mutable_cpu_diff());
+      layer->Backward(this->blob_top_vec_, propagate_down,
+                      this->blob_bottom_vec_);
+      bottom_diffs[i].CopyFrom(*this->blob_bottom_, true, true);
+      weight_diffs[i].CopyFrom(*layer->blobs()[0], true, true);
+      bias_diffs[i].CopyFrom(*layer->blobs()[1], true, true);
+    }
+    const Dtype kErrorMargin = 1e-3;
+    for (int j = 0; j < results[0].count(); ++j) {
+      EXPECT_NEAR(results[0].cpu_data()[j], results[1].cpu_data()[j],
+                  kErrorMargin);
+    }
+    for (int j = 0; j < bottom_diffs[0].count(); ++j) {
+      EXPECT_NEAR(bottom_diffs[0].cpu_diff()[j], bottom_diffs[1].cpu_diff()[j],
+                  kErrorMargin);
+    }
+    for (int j = 0; j < weight_diffs[0].count(); ++j) {
+      EXPECT_NEAR(weight_diffs[0].cpu_diff()[j], weight_diffs[1].cpu_diff()[j],
+                  kErrorMargin);
+    }
+    for (int j = 0; j < bias_diffs[0].count(); ++j) {
+      EXPECT_NEAR(bias_diffs[0].cpu_diff()[j], bias_diffs[1].cpu_diff()[j],
+                  kErrorMargin);
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestGradientDirect) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  this->blob_bottom_vec_.push_back(this->blob_bottom_2_);
+  this->blob_top_vec_.push_back(this->blob_top_2_);
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  DirectConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestByteInput) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Frames of bytes from a ByteMemoryData layer against the same frames
+  // widened beforehand
+  const int num = 3;
+  const int channels = 4;
+  const int size = 20;
+  const int count = num * channels * size * size;
+  const Dtype scale = 1. / 255;
+  const Dtype shift = -0.5;
+  vector<uint8_t> bytes(count);
+  Blob<Dtype> widened(num, channels, size, size);
+  for (int i = 0; i < count; ++i) {
+    bytes[i] = (i * 37 + i / 11) % 256;
+    widened.mutable_cpu_data()[i] = scale * bytes[i] + shift;
+  }
+  LayerParameter data_param;
+  MemoryDataParameter* md_param = data_param.mutable_memory_data_param();
+  md_param->set_batch_size(num);
+  md_param->set_channels(channels);
+  md_param->set_height(size);
+  md_param->set_width(size);
+  ByteMemoryDataLayer<Dtype> data_layer(data_param);
+  Blob<Dtype> frames;
+  vector<Blob<Dtype>*> frames_vec(1, &frames);
+  data_layer.SetUp(vector<Blob<Dtype>*>(), frames_vec);
+  data_layer.Reset(&bytes[0], num);
+  data_layer.Forward(vector<Blob<Dtype>*>(), frames_vec);
+  vector<Blob<Dtype>*> widened_vec(1, &widened);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_num_output(5);
+  convolution_param->add_kernel_size(8);
+  convolution_param->add_stride(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  Blob<Dtype> weights;
+  Blob<Dtype> bias;
+  Blob<Dtype> top_diff;
+  {
+    ConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(widened_vec, this->blob_top_vec_);
+    top_diff.ReshapeLike(*this->blob_top_);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(&top_diff);
+    weights.CopyFrom(*layer.blobs()[0], false, true);
+    bias.CopyFrom(*layer.blobs()[1], false, true);
+  }
+  // The widened frames, then the bytes per image, batched and with the
+  // DIRECT engine, which falls back for them
+  vector<bool> propagate_down(1, false);
+  Blob<Dtype> results[4];
+  Blob<Dtype> weight_diffs[4];
+  Blob<Dtype> bias_diffs[4];
+  for (int i = 0; i < 4; ++i) {
+    LayerParameter param(layer_param);
+    if (i > 0) {
+      param.mutable_convolution_param()->set_byte_input(true);
+      param.mutable_convolution_param()->set_input_scale(scale);
+      param.mutable_convolution_param()->set_input_shift(shift);
+    }
+    if (i == 1) {
+      param.mutable_convolution_param()->set_cpu_workspace_limit(0);
+    }
+    shared_ptr<Layer<Dtype> > layer(i == 3 ?
+        new DirectConvolutionLayer<Dtype>(param) :
+        new ConvolutionLayer<Dtype>(param));
+    vector<Blob<Dtype>*>& bottom_vec = i == 0 ? widened_vec : frames_vec;
+    layer->SetUp(bottom_vec, this->blob_top_vec_);
+    EXPECT_EQ(layer->AllowForceBackward(0), i == 0);
+    layer->blobs()[0]->CopyFrom(weights, false, false);
+    layer->blobs()[1]->CopyFrom(bias, false, false);
+    caffe_set(weights.count(), Dtype(0),
+              layer->blobs()[0]->mutable_cpu_diff());
+    caffe_set(bias.count(), Dtype(0), layer->blobs()[1]->mutable_cpu_diff());
+    layer->Forward(bottom_vec, this->blob_top_vec_);
+    results[i].CopyFrom(*this->blob_top_, false, true);
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+               this->blob_top_->mutable_cpu_diff());
+    layer->Backward(this->blob_top_vec_, propagate_down, bottom_vec);
+    weight_diffs[i].CopyFrom(*layer->blobs()[0], true, true);
+    bias_diffs[i].CopyFrom(*layer->blobs()[1], true, true);
+  }
+  const Dtype kErrorMargin = 1e-4;
+  for (int i = 1; i < 4; ++i) {
+    for (int j = 0; j < results[0].count(); ++j) {
+      EXPECT_NEAR(results[0].cpu_data()[j], results[i].cpu_data()[j],
+                  kErrorMargin);
+    }
+    for (int j = 0; j < weight_diffs[0].count(); ++j) {
+      EXPECT_NEAR(weight_diffs[0].cpu_diff()[j], weight_diffs[i].cpu_diff()[j],
+                  kErrorMargin);
+    }
+    for (int j = 0; j < bias_diffs[0].count(); ++j) {
+      EXPECT_NEAR(bias_diffs[0].cpu_diff()[j], bias_diffs[i].cpu_diff()[j],
+                  kErrorMargin);
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestFusedReLU) {
+  typedef typename TypeParam::Dtype Dtype;
+  // A convolution with a leaky ReLU layer on top against the ReLU fused
+  // per image, batched and with the DIRECT engine
+  Blob<Dtype> bottom(3, 4, 12, 10);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_num_output(5);
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  const Dtype negative_slope = 0.1;
+  LayerParameter relu_param;
+  relu_param.mutable_relu_param()->set_negative_slope(negative_slope);
+  ReLULayer<Dtype> relu(relu_param);
+  Blob<Dtype> weights;
+  Blob<Dtype> bias;
+  Blob<Dtype> top_diff;
+  {
+    ConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(bottom_vec, this->blob_top_vec_);
+    top_diff.ReshapeLike(*this->blob_top_);
+    filler.Fill(&top_diff);
+    weights.CopyFrom(*layer.blobs()[0], false, true);
+    bias.CopyFrom(*layer.blobs()[1], false, true);
+  }
+  vector<bool> propagate_down(1, true);
+  Blob<Dtype> results[4];
+  Blob<Dtype> bottom_diffs[4];
+  Blob<Dtype> weight_diffs[4];
+  Blob<Dtype> bias_diffs[4];
+  for (int i = 0; i < 4; ++i) {
+    LayerParameter param(layer_param);
+    if (i > 0) {
+      param.mutable_convolution_param()->set_relu(true);
+      param.mutable_convolution_param()->set_relu_negative_slope(
+          negative_slope);
+    }
+    if (i == 1) {
+      param.mutable_convolution_param()->set_cpu_workspace_limit(0);
+    }
+    shared_ptr<Layer<Dtype> > layer(i == 3 ?
+        new DirectConvolutionLayer<Dtype>(param) :
+        new ConvolutionLayer<Dtype>(param));
+    layer->SetUp(bottom_vec, this->blob_top_vec_);
+    if (i == 0) {
+      relu.SetUp(this->blob_top_vec_, this->blob_top_vec_);
+    }
+    layer->blobs()[0]->CopyFrom(weights, false, false);
+    layer->blobs()[1]->CopyFrom(bias, false, false);
+    caffe_set(weights.count(), Dtype(0),
+              layer->blobs()[0]->mutable_cpu_diff());
+    caffe_set(bias.count(), Dtype(0), layer->blobs()[1]->mutable_cpu_diff());
+    layer->Forward(bottom_vec, this->blob_top_vec_);
+    if (i == 0) {
+      relu.Forward(this->blob_top_vec_, this->blob_top_vec_);
+    }
+    results[i].CopyFrom(*this->blob_top_, false, true);
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+               this->blob_top_->mutable_cpu_diff());
+    if (i == 0) {
+      relu.Backward(this->blob_top_vec_, propagate_down,
+                    this->blob_top_vec_);
+    }
+    layer->Backward(this->blob_top_vec_, propagate_down, bottom_vec);
+    bottom_diffs[i].CopyFrom(bottom, true, true);
+    weight_diffs[i].CopyFrom(*layer->blobs()[0], true, true);
+    bias_diffs[i].CopyFrom(*layer->blobs()[1], true, true);
+  }
+  const Dtype kErrorMargin = 1e-4;
+  for (int i = 1; i < 4; ++i) {
+    for (int j = 0; j < results[0].count(); ++j) {
+      EXPECT_NEAR(results[0].cpu_data()[j], results[i].cpu_data()[j],
+                  kErrorMargin);
+    }
+    for (int j = 0; j < bottom_diffs[0].count(); ++j) {
+      EXPECT_NEAR(bottom_diffs[0].cpu_diff()[j], bottom_diffs[i].cpu_diff()[j],
+                  kErrorMargin);
+    }
+    for (int j = 0; j < weight_diffs[0].count(); ++j) {
+      EXPECT_NEAR(weight_diffs[0].cpu_diff()[j], weight_diffs[i].cpu_diff()[j],
+                  kErrorMargin);
+    }
+    for (int j = 0; j < bias_diffs[0].count(); ++j) {
+      EXPECT_NEAR(bias_diffs[0].cpu_diff()[j], bias_diffs[i].cpu_diff()[j],
+                  kErrorMargin);
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestGradientFusedReLU) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  convolution_param->set_relu(true);
+  convolution_param->set_relu_negative_slope(0.01);
+  ConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3, 1701, 0., 0.01);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
 #ifdef USE_CUDNN
 
 template <typename Dtype>
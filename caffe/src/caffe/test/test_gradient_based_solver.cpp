@@ -26,7 +26,7 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
  protected:
   GradientBasedSolverTest() :
       seed_(1701), num_(4), channels_(3), height_(10), width_(10),
-      share_(false) {
+      share_(false), snapshot_async_(false), snapshot_to_(false) {
         input_file_ = new string(
         CMAKE_SOURCE_DIR "caffe/test/test_data/solver_data_list.txt" CMAKE_EXT);
       }
@@ -42,6 +42,9 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
   // TODO this is brittle and the hdf5 file should be checked instead.
   int num_, channels_, height_, width_;
   bool share_;
+  bool snapshot_async_;
+  // Snapshot with SnapshotTo instead of the snapshot settings
+  bool snapshot_to_;
   Dtype delta_;  // Stability constant for RMSProp, AdaGrad, AdaDelta and Adam
 
   // Test data: check out generate_sample_data.py in the same directory.
@@ -182,6 +185,9 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     if (snapshot) {
       proto << "snapshot: " << num_iters << " ";
     }
+    if (snapshot_async_) {
+      proto << "snapshot_async: true ";
+    }
     Caffe::set_random_seed(this->seed_);
     this->InitSolverFromProtoString(proto.str());
     if (from_snapshot != NULL) {
@@ -209,6 +215,12 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
       this->sync_->run(gpus);
       Caffe::set_solver_count(1);
     }
+    if (snapshot && snapshot_to_) {
+      const string state_filename = snapshot_prefix_ + "/to.solverstate";
+      this->solver_->SnapshotTo(snapshot_prefix_ + "/to.caffemodel",
+          state_filename);
+      return state_filename;
+    }
     if (snapshot) {
       ostringstream resume_file;
       resume_file << snapshot_prefix_ << "/_iter_" << num_iters
@@ -700,6 +712,30 @@ TYPED_TEST(SGDSolverTest, TestSnapshot) {
   }
 }
 
+TYPED_TEST(SGDSolverTest, TestSnapshotAsync) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->snapshot_async_ = true;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(SGDSolverTest, TestSnapshotTo) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->snapshot_to_ = true;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 TYPED_TEST(SGDSolverTest, TestSnapshotShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -1178,6 +1214,18 @@ TYPED_TEST(AdamSolverTest, TestSnapshot) {
   }
 }
 
+TYPED_TEST(AdamSolverTest, TestSnapshotAsync) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->snapshot_async_ = true;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 TYPED_TEST(AdamSolverTest, TestSnapshotShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
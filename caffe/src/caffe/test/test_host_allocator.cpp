@@ -0,0 +1,112 @@
+#include <stdint.h>
+
+#include <algorithm>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/host_allocator.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class HostAllocatorTest : public ::testing::Test {
+ protected:
+  virtual void TearDown() {
+    Caffe::set_host_allocator(HostAllocator::Default());
+  }
+};
+
+TEST_F(HostAllocatorTest, TestClassSize) {
+  EXPECT_EQ(kHostAlignment, PooledHostAllocator::ClassSize(0));
+  EXPECT_EQ(kHostAlignment, PooledHostAllocator::ClassSize(1));
+  EXPECT_EQ(kHostAlignment, PooledHostAllocator::ClassSize(kHostAlignment));
+  EXPECT_EQ(1 << 20, PooledHostAllocator::ClassSize(1 << 20));
+  EXPECT_EQ(5 << 18, PooledHostAllocator::ClassSize((1 << 20) + 1));
+  for (size_t size = 1; size < (1 << 22); size = size * 5 / 4 + 1) {
+    const size_t class_size = PooledHostAllocator::ClassSize(size);
+    EXPECT_GE(class_size, size);
+    EXPECT_EQ(0, class_size % kHostAlignment);
+    EXPECT_LE(class_size - size, std::max(kHostAlignment - 1, size / 4));
+  }
+}
+
+TEST_F(HostAllocatorTest, TestAlignmentAndStats) {
+  HostAllocator allocator;
+  void* first = allocator.Allocate(100);
+  void* second = allocator.Allocate(3);
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(first) % kHostAlignment);
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(second) % kHostAlignment);
+  EXPECT_EQ(103, allocator.stats().live_bytes);
+  allocator.Free(first, 100);
+  void* third = allocator.Allocate(50);
+  allocator.Free(second, 3);
+  allocator.Free(third, 50);
+  const HostAllocator::Stats stats = allocator.stats();
+  EXPECT_EQ(0, stats.live_bytes);
+  EXPECT_EQ(103, stats.peak_bytes);
+  EXPECT_EQ(0, stats.cached_bytes);
+  EXPECT_EQ(3, stats.allocations);
+  EXPECT_EQ(0, stats.reuses);
+}
+
+TEST_F(HostAllocatorTest, TestPooledReuse) {
+  PooledHostAllocator allocator(1 << 20, false);
+  void* first = allocator.Allocate(1000);
+  allocator.Free(first, 1000);
+  EXPECT_EQ(PooledHostAllocator::ClassSize(1000),
+            allocator.stats().cached_bytes);
+  // Any size of the same class gets the cached block back
+  void* second = allocator.Allocate(1010);
+  EXPECT_EQ(first, second);
+  void* third = allocator.Allocate(1000);
+  EXPECT_NE(second, third);
+  const HostAllocator::Stats stats = allocator.stats();
+  EXPECT_EQ(2010, stats.live_bytes);
+  EXPECT_EQ(0, stats.cached_bytes);
+  EXPECT_EQ(3, stats.allocations);
+  EXPECT_EQ(1, stats.reuses);
+  allocator.Free(second, 1010);
+  allocator.Free(third, 1000);
+  allocator.Trim();
+  EXPECT_EQ(0, allocator.stats().cached_bytes);
+  EXPECT_EQ(0, allocator.stats().live_bytes);
+}
+
+TEST_F(HostAllocatorTest, TestPooledCacheLimit) {
+  PooledHostAllocator allocator(1024, false);
+  void* small = allocator.Allocate(512);
+  void* large = allocator.Allocate(2048);
+  allocator.Free(large, 2048);
+  allocator.Free(small, 512);
+  EXPECT_EQ(512, allocator.stats().cached_bytes);
+  allocator.Free(allocator.Allocate(2048), 2048);
+  EXPECT_EQ(0, allocator.stats().reuses);
+}
+
+TEST_F(HostAllocatorTest, TestHugePages) {
+  PooledHostAllocator allocator(0, true);
+  void* ptr = allocator.Allocate(kHugePageSize + 1);
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(ptr) % kHugePageSize);
+  static_cast<char*>(ptr)[kHugePageSize] = 1;
+  allocator.Free(ptr, kHugePageSize + 1);
+}
+
+TEST_F(HostAllocatorTest, TestSyncedMemory) {
+  shared_ptr<HostAllocator> allocator(new PooledHostAllocator(1 << 20, false));
+  Caffe::set_host_allocator(allocator);
+  {
+    SyncedMemory mem(100);
+    EXPECT_EQ(0, allocator->stats().allocations);
+    mem.mutable_cpu_data();
+    EXPECT_EQ(100, allocator->stats().live_bytes);
+    // The memory goes back to its allocator whichever one Caffe has now
+    Caffe::set_host_allocator(HostAllocator::Default());
+  }
+  EXPECT_EQ(0, allocator->stats().live_bytes);
+  EXPECT_EQ(1, allocator->stats().allocations);
+}
+
+}  // namespace caffe
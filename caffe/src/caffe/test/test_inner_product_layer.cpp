@@ -149,4 +149,161 @@ TYPED_TEST(InnerProductLayerTest, TestGradient) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestSparseBackward) {
+  typedef typename TypeParam::Dtype Dtype;
+  // One nonzero top diff per sample, as below a TDLoss layer, against the
+  // gradients by hand
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("gaussian");
+  InnerProductLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int num = this->blob_bottom_->num();
+  const int dim = this->blob_bottom_->count(1);
+  Dtype* top_diff = this->blob_top_->mutable_cpu_diff();
+  caffe_set(this->blob_top_->count(), Dtype(0), top_diff);
+  for (int m = 0; m < num; ++m) {
+    top_diff[m * 10 + (m * 7) % 10] = 0.5 + m;
+  }
+  Dtype* weight_diff = layer.blobs()[0]->mutable_cpu_diff();
+  Dtype* bias_diff = layer.blobs()[1]->mutable_cpu_diff();
+  caffe_set(layer.blobs()[0]->count(), Dtype(1), weight_diff);
+  caffe_set(layer.blobs()[1]->count(), Dtype(1), bias_diff);
+  caffe_set(this->blob_bottom_->count(), Dtype(1),
+            this->blob_bottom_->mutable_cpu_diff());
+  vector<bool> propagate_down(1, true);
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  const Dtype* bottom_data = this->blob_bottom_->cpu_data();
+  const Dtype* weight = layer.blobs()[0]->cpu_data();
+  const Dtype kErrorMargin = 1e-4;
+  for (int n = 0; n < 10; ++n) {
+    Dtype expected_bias_diff = 1;
+    for (int m = 0; m < num; ++m) {
+      expected_bias_diff += top_diff[m * 10 + n];
+    }
+    EXPECT_NEAR(expected_bias_diff, bias_diff[n], kErrorMargin);
+    for (int k = 0; k < dim; ++k) {
+      // Weight diffs accumulate
+      Dtype expected = 1;
+      for (int m = 0; m < num; ++m) {
+        expected += top_diff[m * 10 + n] * bottom_data[m * dim + k];
+      }
+      EXPECT_NEAR(expected, weight_diff[n * dim + k], kErrorMargin);
+    }
+  }
+  for (int m = 0; m < num; ++m) {
+    for (int k = 0; k < dim; ++k) {
+      Dtype expected = 0;
+      for (int n = 0; n < 10; ++n) {
+        expected += top_diff[m * 10 + n] * weight[n * dim + k];
+      }
+      EXPECT_NEAR(expected, this->blob_bottom_->cpu_diff()[m * dim + k],
+                  kErrorMargin);
+    }
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestFusedReLU) {
+  typedef typename TypeParam::Dtype Dtype;
+  // An inner product with a leaky ReLU layer on top against the fused ReLU
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("gaussian");
+  const Dtype negative_slope = 0.1;
+  LayerParameter relu_param;
+  relu_param.mutable_relu_param()->set_negative_slope(negative_slope);
+  ReLULayer<Dtype> relu(relu_param);
+  Blob<Dtype> weights;
+  Blob<Dtype> bias;
+  Blob<Dtype> top_diff;
+  vector<bool> propagate_down(1, true);
+  Blob<Dtype> results[2];
+  Blob<Dtype> bottom_diffs[2];
+  Blob<Dtype> weight_diffs[2];
+  Blob<Dtype> bias_diffs[2];
+  for (int i = 0; i < 2; ++i) {
+    LayerParameter param(layer_param);
+    if (i == 1) {
+      param.mutable_inner_product_param()->set_relu(true);
+      param.mutable_inner_product_param()->set_relu_negative_slope(
+          negative_slope);
+    }
+    InnerProductLayer<Dtype> layer(param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    if (i == 0) {
+      relu.SetUp(this->blob_top_vec_, this->blob_top_vec_);
+      top_diff.ReshapeLike(*this->blob_top_);
+      filler.Fill(&top_diff);
+      weights.CopyFrom(*layer.blobs()[0], false, true);
+      bias.CopyFrom(*layer.blobs()[1], false, true);
+    }
+    layer.blobs()[0]->CopyFrom(weights, false, false);
+    layer.blobs()[1]->CopyFrom(bias, false, false);
+    caffe_set(weights.count(), Dtype(0), layer.blobs()[0]->mutable_cpu_diff());
+    caffe_set(bias.count(), Dtype(0), layer.blobs()[1]->mutable_cpu_diff());
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    if (i == 0) {
+      relu.Forward(this->blob_top_vec_, this->blob_top_vec_);
+    }
+    results[i].CopyFrom(*this->blob_top_, false, true);
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+               this->blob_top_->mutable_cpu_diff());
+    if (i == 0) {
+      relu.Backward(this->blob_top_vec_, propagate_down,
+                    this->blob_top_vec_);
+    }
+    layer.Backward(this->blob_top_vec_, propagate_down,
+                   this->blob_bottom_vec_);
+    bottom_diffs[i].CopyFrom(*this->blob_bottom_, true, true);
+    weight_diffs[i].CopyFrom(*layer.blobs()[0], true, true);
+    bias_diffs[i].CopyFrom(*layer.blobs()[1], true, true);
+  }
+  const Dtype kErrorMargin = 1e-4;
+  for (int j = 0; j < results[0].count(); ++j) {
+    EXPECT_NEAR(results[0].cpu_data()[j], results[1].cpu_data()[j],
+                kErrorMargin);
+  }
+  for (int j = 0; j < bottom_diffs[0].count(); ++j) {
+    EXPECT_NEAR(bottom_diffs[0].cpu_diff()[j], bottom_diffs[1].cpu_diff()[j],
+                kErrorMargin);
+  }
+  for (int j = 0; j < weight_diffs[0].count(); ++j) {
+    EXPECT_NEAR(weight_diffs[0].cpu_diff()[j], weight_diffs[1].cpu_diff()[j],
+                kErrorMargin);
+  }
+  for (int j = 0; j < bias_diffs[0].count(); ++j) {
+    EXPECT_NEAR(bias_diffs[0].cpu_diff()[j], bias_diffs[1].cpu_diff()[j],
+                kErrorMargin);
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestGradientFusedReLU) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("gaussian");
+  inner_product_param->set_relu(true);
+  inner_product_param->set_relu_negative_slope(0.01);
+  InnerProductLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3, 1701, 0., 0.01);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
 }  // namespace caffe
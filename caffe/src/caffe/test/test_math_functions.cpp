@@ -1,8 +1,10 @@
 #include <stdint.h>  // for uint32_t & uint64_t
 #include <time.h>
+#include <algorithm>
 #include <climits>
 #include <cmath>  // for std::fabs
 #include <cstdlib>  // for rand_r
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -150,6 +152,145 @@ TYPED_TEST(CPUMathFunctionsTest, TestCopy) {
   }
 }
 
+// The gradient the fused solver updates start from, the way the solvers
+// compute it in separate passes
+template <typename Dtype>
+void ReferenceSolverGradient(const int n, const Dtype diff_scale,
+    const Dtype l2_decay, const Dtype l1_decay, const Dtype* data,
+    const Dtype* diff, Dtype* g) {
+  vector<Dtype> sign(n);
+  caffe_cpu_scale(n, diff_scale, diff, g);
+  caffe_axpy(n, l2_decay, data, g);
+  caffe_cpu_sign(n, data, &sign[0]);
+  caffe_axpy(n, l1_decay, &sign[0], g);
+}
+
+template <typename Dtype>
+void ExpectAllNear(const int n, const Dtype* expected, const Dtype* actual) {
+  for (int i = 0; i < n; ++i) {
+    EXPECT_NEAR(expected[i], actual[i],
+                1e-4 * std::max(Dtype(1), std::fabs(expected[i])));
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestRMSPropUpdate) {
+  typedef TypeParam Dtype;
+  const int n = this->blob_bottom_->count();
+  const Dtype diff_scale = 0.5, l2_decay = 0.1, l1_decay = 0.05;
+  const Dtype rms_decay = 0.95, delta = 0.01, rate = 0.02;
+  Blob<Dtype> data, diff, history, g, update;
+  data.CopyFrom(*this->blob_bottom_, false, true);
+  diff.CopyFrom(*this->blob_top_, false, true);
+  history.ReshapeLike(data);
+  caffe_sqr(n, this->blob_top_->cpu_data(), history.mutable_cpu_data());
+  g.ReshapeLike(data);
+  update.ReshapeLike(data);
+  Dtype* h = history.mutable_cpu_data();
+  ReferenceSolverGradient(n, diff_scale, l2_decay, l1_decay, data.cpu_data(),
+      diff.cpu_data(), g.mutable_cpu_data());
+  vector<Dtype> expected_history(h, h + n);
+  caffe_powx(n, g.cpu_data(), Dtype(2), update.mutable_cpu_data());
+  caffe_cpu_axpby(n, Dtype(1) - rms_decay, update.cpu_data(), rms_decay,
+      &expected_history[0]);
+  caffe_powx(n, &expected_history[0], Dtype(0.5), update.mutable_cpu_data());
+  caffe_add_scalar(n, delta, update.mutable_cpu_data());
+  caffe_div(n, g.cpu_data(), update.cpu_data(), update.mutable_cpu_data());
+  caffe_scal(n, rate, update.mutable_cpu_data());
+  vector<Dtype> expected_data(data.cpu_data(), data.cpu_data() + n);
+  caffe_axpy(n, Dtype(-1), update.cpu_data(), &expected_data[0]);
+
+  caffe_cpu_rmsprop_update(n, diff_scale, l2_decay, l1_decay, rms_decay,
+      delta, rate, data.mutable_cpu_data(), diff.mutable_cpu_data(), h);
+  ExpectAllNear(n, &expected_history[0], history.cpu_data());
+  ExpectAllNear(n, update.cpu_data(), diff.cpu_data());
+  ExpectAllNear(n, &expected_data[0], data.cpu_data());
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestAdaDeltaUpdate) {
+  typedef TypeParam Dtype;
+  const int n = this->blob_bottom_->count();
+  const Dtype diff_scale = 0.5, l2_decay = 0.1, l1_decay = 0.05;
+  const Dtype momentum = 0.9, delta = 1e-6, rate = 0.1;
+  Blob<Dtype> data, diff, grad_history, update_history, g, update;
+  data.CopyFrom(*this->blob_bottom_, false, true);
+  diff.CopyFrom(*this->blob_top_, false, true);
+  grad_history.ReshapeLike(data);
+  caffe_sqr(n, this->blob_top_->cpu_data(), grad_history.mutable_cpu_data());
+  update_history.ReshapeLike(data);
+  caffe_sqr(n, this->blob_bottom_->cpu_data(),
+      update_history.mutable_cpu_data());
+  g.ReshapeLike(data);
+  update.ReshapeLike(data);
+  ReferenceSolverGradient(n, diff_scale, l2_decay, l1_decay, data.cpu_data(),
+      diff.cpu_data(), g.mutable_cpu_data());
+  vector<Dtype> expected_grad_history(grad_history.cpu_data(),
+      grad_history.cpu_data() + n);
+  vector<Dtype> expected_update_history(update_history.cpu_data(),
+      update_history.cpu_data() + n);
+  vector<Dtype> denominator(n);
+  caffe_powx(n, g.cpu_data(), Dtype(2), update.mutable_cpu_data());
+  caffe_cpu_axpby(n, Dtype(1) - momentum, update.cpu_data(), momentum,
+      &expected_grad_history[0]);
+  caffe_copy(n, &expected_update_history[0], update.mutable_cpu_data());
+  caffe_add_scalar(n, delta, update.mutable_cpu_data());
+  caffe_copy(n, &expected_grad_history[0], &denominator[0]);
+  caffe_add_scalar(n, delta, &denominator[0]);
+  caffe_div(n, update.cpu_data(), &denominator[0], update.mutable_cpu_data());
+  caffe_powx(n, update.cpu_data(), Dtype(0.5), update.mutable_cpu_data());
+  caffe_mul(n, g.cpu_data(), update.cpu_data(), update.mutable_cpu_data());
+  caffe_powx(n, update.cpu_data(), Dtype(2), &denominator[0]);
+  caffe_cpu_axpby(n, Dtype(1) - momentum, &denominator[0], momentum,
+      &expected_update_history[0]);
+  caffe_scal(n, rate, update.mutable_cpu_data());
+  vector<Dtype> expected_data(data.cpu_data(), data.cpu_data() + n);
+  caffe_axpy(n, Dtype(-1), update.cpu_data(), &expected_data[0]);
+
+  caffe_cpu_adadelta_update(n, diff_scale, l2_decay, l1_decay, momentum,
+      delta, rate, data.mutable_cpu_data(), diff.mutable_cpu_data(),
+      grad_history.mutable_cpu_data(), update_history.mutable_cpu_data());
+  ExpectAllNear(n, &expected_grad_history[0], grad_history.cpu_data());
+  ExpectAllNear(n, &expected_update_history[0], update_history.cpu_data());
+  ExpectAllNear(n, update.cpu_data(), diff.cpu_data());
+  ExpectAllNear(n, &expected_data[0], data.cpu_data());
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestAdamUpdate) {
+  typedef TypeParam Dtype;
+  const int n = this->blob_bottom_->count();
+  const Dtype diff_scale = 0.5, l2_decay = 0.1, l1_decay = 0.05;
+  const Dtype beta1 = 0.9, beta2 = 0.999, eps_hat = 1e-8, rate = 0.01;
+  Blob<Dtype> data, diff, m, v, g, update;
+  data.CopyFrom(*this->blob_bottom_, false, true);
+  diff.CopyFrom(*this->blob_top_, false, true);
+  m.CopyFrom(*this->blob_top_, false, true);
+  v.ReshapeLike(data);
+  caffe_sqr(n, this->blob_bottom_->cpu_data(), v.mutable_cpu_data());
+  g.ReshapeLike(data);
+  update.ReshapeLike(data);
+  ReferenceSolverGradient(n, diff_scale, l2_decay, l1_decay, data.cpu_data(),
+      diff.cpu_data(), g.mutable_cpu_data());
+  vector<Dtype> expected_m(m.cpu_data(), m.cpu_data() + n);
+  vector<Dtype> expected_v(v.cpu_data(), v.cpu_data() + n);
+  caffe_cpu_axpby(n, Dtype(1) - beta1, g.cpu_data(), beta1, &expected_m[0]);
+  caffe_mul(n, g.cpu_data(), g.cpu_data(), update.mutable_cpu_data());
+  caffe_cpu_axpby(n, Dtype(1) - beta2, update.cpu_data(), beta2,
+      &expected_v[0]);
+  caffe_powx(n, &expected_v[0], Dtype(0.5), update.mutable_cpu_data());
+  caffe_add_scalar(n, eps_hat, update.mutable_cpu_data());
+  caffe_div(n, &expected_m[0], update.cpu_data(), update.mutable_cpu_data());
+  caffe_scal(n, rate, update.mutable_cpu_data());
+  vector<Dtype> expected_data(data.cpu_data(), data.cpu_data() + n);
+  caffe_axpy(n, Dtype(-1), update.cpu_data(), &expected_data[0]);
+
+  caffe_cpu_adam_update(n, diff_scale, l2_decay, l1_decay, beta1, beta2,
+      eps_hat, rate, data.mutable_cpu_data(), diff.mutable_cpu_data(),
+      m.mutable_cpu_data(), v.mutable_cpu_data());
+  ExpectAllNear(n, &expected_m[0], m.cpu_data());
+  ExpectAllNear(n, &expected_v[0], v.cpu_data());
+  ExpectAllNear(n, update.cpu_data(), diff.cpu_data());
+  ExpectAllNear(n, &expected_data[0], data.cpu_data());
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
@@ -552,8 +552,8 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
-  virtual void InitReshapableNet() {
-    const string& proto =
+  virtual void InitReshapableNet(const bool inference_only = false) {
+    string proto =
         "name: 'ReshapableNetwork' "
         "input: 'data' "
         "input_dim: 1 "
@@ -611,6 +611,9 @@ class NetTest : public MultiDeviceTest<TypeParam> {
         "  bottom: 'norm1' "
         "  top: 'softmax' "
         "} ";
+    if (inference_only) {
+      proto += "inference_only: true ";
+    }
     InitNetFromProtoString(proto);
   }
 
@@ -1226,6 +1229,30 @@ TYPED_TEST(NetTest, TestSharedWeightsResume) {
   }
 }
 
+TYPED_TEST(NetTest, TestCopyParamsFrom) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Two nets of the same definition initialized with different seeds.
+  Caffe::set_random_seed(this->seed_);
+  this->InitTinyNet();
+  shared_ptr<Net<Dtype> > source_net = this->net_;
+  Caffe::set_random_seed(this->seed_ + 1);
+  this->InitTinyNet();
+  const vector<Blob<Dtype>*>& source_params = source_net->learnable_params();
+  const vector<Blob<Dtype>*>& target_params = this->net_->learnable_params();
+  ASSERT_EQ(source_params.size(), target_params.size());
+  ASSERT_GT(target_params[0]->count(), 0);
+  EXPECT_NE(source_params[0]->cpu_data()[0], target_params[0]->cpu_data()[0]);
+  this->net_->CopyParamsFrom(*source_net);
+  for (int i = 0; i < target_params.size(); ++i) {
+    // The params are copied, not shared.
+    EXPECT_NE(source_params[i]->cpu_data(), target_params[i]->cpu_data());
+    for (int j = 0; j < target_params[i]->count(); ++j) {
+      EXPECT_EQ(source_params[i]->cpu_data()[j],
+                target_params[i]->cpu_data()[j]);
+    }
+  }
+}
+
 TYPED_TEST(NetTest, TestParamPropagateDown) {
   typedef typename TypeParam::Dtype Dtype;
   vector<Blob<Dtype>*> bottom;
@@ -2331,6 +2358,60 @@ TYPED_TEST(NetTest, TestReshape) {
   EXPECT_FALSE(same_spatial_shape);
 }
 
+TYPED_TEST(NetTest, TestInferenceOnly) {
+  typedef typename TypeParam::Dtype Dtype;
+  // An inference_only net against the same net trained as usual, on inputs
+  // of two sizes
+  Caffe::set_random_seed(this->seed_);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> blob1(2, 3, 12, 10);
+  Blob<Dtype> blob2(4, 3, 9, 11);
+  filler.Fill(&blob1);
+  filler.Fill(&blob2);
+  this->InitReshapableNet();
+  shared_ptr<Net<Dtype> > reference_net = this->net_;
+  this->InitReshapableNet(true);
+  EXPECT_FALSE(reference_net->inference_only());
+  EXPECT_TRUE(this->net_->inference_only());
+  this->net_->CopyParamsFrom(*reference_net);
+  for (int i = 0; i < this->net_->layers().size(); ++i) {
+    EXPECT_FALSE(this->net_->layer_need_backward()[i]);
+  }
+  // norm1 comes after the last use of conv1; pool1 is computed from it.
+  EXPECT_EQ(this->net_->blob_by_name("conv1")->data(),
+            this->net_->blob_by_name("norm1")->data());
+  EXPECT_NE(this->net_->blob_by_name("conv1")->data(),
+            this->net_->blob_by_name("pool1")->data());
+  Blob<Dtype>* blobs[] = { &blob1, &blob2, &blob1 };
+  for (int i = 0; i < 3; ++i) {
+    shared_ptr<Net<Dtype> > nets[] = { reference_net, this->net_ };
+    for (int j = 0; j < 2; ++j) {
+      Blob<Dtype>* input_blob = nets[j]->input_blobs()[0];
+      input_blob->ReshapeLike(*blobs[i]);
+      caffe_copy(blobs[i]->count(), blobs[i]->cpu_data(),
+                 input_blob->mutable_cpu_data());
+      nets[j]->ForwardPrefilled();
+    }
+    const Blob<Dtype>* reference_output = reference_net->output_blobs()[0];
+    const Blob<Dtype>* output = this->net_->output_blobs()[0];
+    ASSERT_EQ(reference_output->count(), output->count());
+    for (int k = 0; k < output->count(); ++k) {
+      EXPECT_FLOAT_EQ(reference_output->cpu_data()[k], output->cpu_data()[k]);
+    }
+  }
+  // No diff was ever touched.
+  for (int i = 0; i < this->net_->blobs().size(); ++i) {
+    EXPECT_EQ(SyncedMemory::UNINITIALIZED,
+              this->net_->blobs()[i]->diff()->head());
+  }
+  for (int i = 0; i < this->net_->params().size(); ++i) {
+    EXPECT_EQ(SyncedMemory::UNINITIALIZED,
+              this->net_->params()[i]->diff()->head());
+  }
+}
+
 TYPED_TEST(NetTest, TestSkipPropagateDown) {
   // check bottom_need_backward if propagate_down is true
   this->InitSkipPropNet(false);
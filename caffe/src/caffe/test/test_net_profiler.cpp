@@ -0,0 +1,172 @@
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/net_profiler.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class NetProfilerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  virtual void SetUp() {
+    const string proto =
+        "name: 'TinyNet' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 5 dim: 10 } "
+        "    shape { dim: 5 dim: 1 } "
+        "    data_filler { type: 'gaussian' std: 0.01 } "
+        "  } "
+        "  top: 'data' "
+        "  top: 'label' "
+        "} "
+        "layer { "
+        "  name: 'innerproduct' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 1 "
+        "    weight_filler { type: 'gaussian' std: 10 } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'innerproduct' "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'innerproduct' "
+        "  bottom: 'label' "
+        "  top: 'loss' "
+        "} ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    net_.reset(new Net<Dtype>(param));
+  }
+
+  shared_ptr<Net<Dtype> > net_;
+};
+
+TYPED_TEST_CASE(NetProfilerTest, TestDtypesAndDevices);
+
+// Records the layers it is called with, and which list called it
+template <typename Dtype>
+class RecordingCallback : public Net<Dtype>::Callback {
+ public:
+  RecordingCallback(const string& name, vector<pair<string, int> >* calls)
+      : name_(name), calls_(calls) {}
+
+ protected:
+  virtual void run(int layer) {
+    calls_->push_back(make_pair(name_, layer));
+  }
+
+ private:
+  const string name_;
+  vector<pair<string, int> >* const calls_;
+};
+
+TYPED_TEST(NetProfilerTest, TestCallbacks) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<pair<string, int> > calls;
+  RecordingCallback<Dtype> before_forward("before_forward", &calls);
+  RecordingCallback<Dtype> after_forward("after_forward", &calls);
+  RecordingCallback<Dtype> before_backward("before_backward", &calls);
+  RecordingCallback<Dtype> after_backward("after_backward", &calls);
+  this->net_->add_before_forward(&before_forward);
+  this->net_->add_after_forward(&after_forward);
+  this->net_->add_before_backward(&before_backward);
+  this->net_->add_after_backward(&after_backward);
+  this->net_->ForwardBackward(vector<Blob<Dtype>*>());
+  // The data layer needs no backward
+  ASSERT_EQ(10, calls.size());
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(make_pair(string("before_forward"), i), calls[2 * i]);
+    EXPECT_EQ(make_pair(string("after_forward"), i), calls[2 * i + 1]);
+  }
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_EQ(make_pair(string("before_backward"), 2 - i), calls[6 + 2 * i]);
+    EXPECT_EQ(make_pair(string("after_backward"), 2 - i), calls[7 + 2 * i]);
+  }
+  this->net_->RemoveCallback(&before_forward);
+  this->net_->RemoveCallback(&after_forward);
+  this->net_->RemoveCallback(&before_backward);
+  this->net_->RemoveCallback(&after_backward);
+  this->net_->ForwardBackward(vector<Blob<Dtype>*>());
+  EXPECT_EQ(10, calls.size());
+}
+
+TYPED_TEST(NetProfilerTest, TestStats) {
+  typedef typename TypeParam::Dtype Dtype;
+  {
+    NetProfiler<Dtype> profiler(this->net_.get(), 2);
+    for (int i = 0; i < 3; ++i) {
+      this->net_->ForwardBackward(vector<Blob<Dtype>*>());
+    }
+    const vector<typename NetProfiler<Dtype>::LayerStats> stats =
+        profiler.Stats();
+    ASSERT_EQ(3, stats.size());
+    EXPECT_EQ("data", stats[0].name);
+    EXPECT_EQ("DummyData", stats[0].type);
+    EXPECT_EQ(2, stats[0].forward_count);
+    EXPECT_EQ(0, stats[0].backward_count);
+    for (int i = 1; i < 3; ++i) {
+      EXPECT_EQ(2, stats[i].forward_count);
+      EXPECT_EQ(2, stats[i].backward_count);
+      EXPECT_GE(stats[i].forward_max_ms, stats[i].forward_ms);
+      EXPECT_GE(stats[i].backward_max_ms, stats[i].backward_ms);
+    }
+    // 5 x 10 inputs times 1 x 10 weights, and the values it reads or writes
+    EXPECT_EQ("InnerProduct", stats[1].type);
+    EXPECT_EQ(2 * 5 * 10, stats[1].forward_flops);
+    EXPECT_EQ((5 * 10 + 5 + 10 + 1) * sizeof(Dtype),
+              stats[1].forward_bytes);
+    EXPECT_EQ(2 * stats[1].forward_flops, stats[1].backward_flops);
+    EXPECT_NE(string::npos, profiler.Report().find("innerproduct"));
+    profiler.Reset();
+    EXPECT_EQ(0, profiler.Stats()[1].forward_count);
+  }
+  EXPECT_EQ(0, this->net_->before_forward().size());
+  EXPECT_EQ(0, this->net_->after_backward().size());
+}
+
+TYPED_TEST(NetProfilerTest, TestTrace) {
+  typedef typename TypeParam::Dtype Dtype;
+  string filename;
+  MakeTempFilename(&filename);
+  {
+    NetProfiler<Dtype> profiler(this->net_.get());
+    profiler.StartTrace(filename);
+    this->net_->ForwardBackward(vector<Blob<Dtype>*>());
+  }
+  std::ifstream file(filename.c_str());
+  std::stringstream contents;
+  contents << file.rdbuf();
+  const string trace = contents.str();
+  EXPECT_EQ('[', trace[0]);
+  EXPECT_EQ("]\n", trace.substr(trace.size() - 2));
+  int events = 0;
+  for (size_t i = trace.find("\"ph\":\"X\""); i != string::npos;
+       i = trace.find("\"ph\":\"X\"", i + 1)) {
+    ++events;
+  }
+  EXPECT_EQ(5, events);
+  EXPECT_NE(string::npos, trace.find(
+      "\"name\":\"innerproduct\",\"cat\":\"backward\""));
+}
+
+}  // namespace caffe
@@ -0,0 +1,168 @@
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/vision_layers.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class TDLossLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  TDLossLayerTest()
+      : blob_bottom_q_(new Blob<Dtype>(10, 5, 1, 1)),
+        blob_bottom_td_(new Blob<Dtype>(10, 3, 1, 1)),
+        blob_top_loss_(new Blob<Dtype>()) {
+    // fill the values
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_q_);
+    Blob<Dtype> targets(10, 1, 1, 1);
+    filler.Fill(&targets);
+    Dtype* td = blob_bottom_td_->mutable_cpu_data();
+    for (int n = 0; n < 10; ++n) {
+      td[n * 3] = (n * 3) % 5;
+      td[n * 3 + 1] = targets.cpu_data()[n];
+      td[n * 3 + 2] = 0.5 + 0.1 * n;
+    }
+    blob_bottom_vec_.push_back(blob_bottom_q_);
+    blob_bottom_vec_.push_back(blob_bottom_td_);
+    blob_top_vec_.push_back(blob_top_loss_);
+  }
+  virtual ~TDLossLayerTest() {
+    delete blob_bottom_q_;
+    delete blob_bottom_td_;
+    delete blob_top_loss_;
+  }
+
+  // The loss of the given TD errors by hand
+  Dtype ReferenceLoss(const Dtype huber_delta) {
+    const Dtype* q = blob_bottom_q_->cpu_data();
+    const Dtype* td = blob_bottom_td_->cpu_data();
+    Dtype loss = 0;
+    for (int n = 0; n < 10; ++n) {
+      const int action = static_cast<int>(td[n * 3]);
+      const Dtype error = q[n * 5 + action] - td[n * 3 + 1];
+      if (huber_delta > 0 && std::abs(error) > huber_delta) {
+        loss += td[n * 3 + 2] * huber_delta *
+            (std::abs(error) - huber_delta / 2);
+      } else {
+        loss += td[n * 3 + 2] * error * error / 2;
+      }
+    }
+    return loss / 10;
+  }
+
+  Blob<Dtype>* const blob_bottom_q_;
+  Blob<Dtype>* const blob_bottom_td_;
+  Blob<Dtype>* const blob_top_loss_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(TDLossLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(TDLossLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  TDLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype loss =
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype kErrorMargin = 1e-5;
+  EXPECT_NEAR(this->ReferenceLoss(0), loss, kErrorMargin);
+  EXPECT_GE(loss, 1e-1);
+}
+
+TYPED_TEST(TDLossLayerTest, TestForwardHuber) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_td_loss_param()->set_huber_delta(0.5);
+  TDLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype loss =
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype kErrorMargin = 1e-5;
+  EXPECT_NEAR(this->ReferenceLoss(0.5), loss, kErrorMargin);
+  EXPECT_LT(loss, this->ReferenceLoss(0));
+}
+
+TYPED_TEST(TDLossLayerTest, TestMatchesMaskedEuclideanLoss) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The Q values masked by a filter of sqrt(w) on the actions taken, against
+  // targets scaled likewise, as the loss used to be built
+  const Dtype* q = this->blob_bottom_q_->cpu_data();
+  const Dtype* td = this->blob_bottom_td_->cpu_data();
+  Blob<Dtype> filter(10, 5, 1, 1);
+  Blob<Dtype> filtered(10, 5, 1, 1);
+  Blob<Dtype> target(10, 5, 1, 1);
+  caffe_set(filter.count(), Dtype(0), filter.mutable_cpu_data());
+  caffe_set(target.count(), Dtype(0), target.mutable_cpu_data());
+  for (int n = 0; n < 10; ++n) {
+    const int index = n * 5 + static_cast<int>(td[n * 3]);
+    filter.mutable_cpu_data()[index] = std::sqrt(td[n * 3 + 2]);
+    target.mutable_cpu_data()[index] =
+        std::sqrt(td[n * 3 + 2]) * td[n * 3 + 1];
+  }
+  caffe_mul(filtered.count(), q, filter.cpu_data(),
+            filtered.mutable_cpu_data());
+  vector<Blob<Dtype>*> euclidean_bottom_vec;
+  euclidean_bottom_vec.push_back(&filtered);
+  euclidean_bottom_vec.push_back(&target);
+  LayerParameter layer_param;
+  const Dtype kLossWeight = 3.7;
+  layer_param.add_loss_weight(kLossWeight);
+  EuclideanLossLayer<Dtype> euclidean_layer(layer_param);
+  euclidean_layer.SetUp(euclidean_bottom_vec, this->blob_top_vec_);
+  const Dtype euclidean_loss =
+      euclidean_layer.Forward(euclidean_bottom_vec, this->blob_top_vec_);
+  vector<bool> propagate_down(2, false);
+  propagate_down[0] = true;
+  euclidean_layer.Backward(this->blob_top_vec_, propagate_down,
+                           euclidean_bottom_vec);
+  TDLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype loss =
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  const Dtype kErrorMargin = 1e-5;
+  EXPECT_NEAR(euclidean_loss, loss, kErrorMargin);
+  for (int i = 0; i < filtered.count(); ++i) {
+    EXPECT_NEAR(filtered.cpu_diff()[i] * filter.cpu_data()[i],
+                this->blob_bottom_q_->cpu_diff()[i], kErrorMargin);
+  }
+}
+
+TYPED_TEST(TDLossLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  const Dtype kLossWeight = 3.7;
+  layer_param.add_loss_weight(kLossWeight);
+  TDLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(TDLossLayerTest, TestGradientHuber) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_td_loss_param()->set_huber_delta(0.5);
+  TDLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+}  // namespace caffe
@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/util/im2col.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ThreadPoolTest : public ::testing::Test {
+ protected:
+  virtual void TearDown() {
+    Caffe::set_cpu_threads(1);
+  }
+};
+
+// Counts how often each item is visited and records its range's length.
+struct CountTask {
+  vector<int>* counts;
+  vector<int>* lengths;
+  void operator()(const int begin, const int end) const {
+    for (int i = begin; i < end; ++i) {
+      ++(*counts)[i];
+      (*lengths)[i] = end - begin;
+    }
+  }
+};
+
+TEST_F(ThreadPoolTest, TestCoversRangeOnce) {
+  ThreadPool pool(4);
+  EXPECT_EQ(pool.num_threads(), 4);
+  const int sizes[] = {0, 1, 7, 100, 1001};
+  const int grains[] = {1, 3, 250};
+  for (int i = 0; i < 5; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      vector<int> counts(sizes[i], 0);
+      vector<int> lengths(sizes[i], 0);
+      CountTask task = { &counts, &lengths };
+      pool.For(sizes[i], grains[j], boost::cref(task));
+      for (int k = 0; k < sizes[i]; ++k) {
+        EXPECT_EQ(counts[k], 1);
+        EXPECT_GE(lengths[k], std::min(sizes[i], grains[j]));
+      }
+    }
+  }
+}
+
+TEST_F(ThreadPoolTest, TestParallelForWithoutPool) {
+  EXPECT_TRUE(Caffe::thread_pool() == NULL);
+  vector<int> counts(10, 0);
+  vector<int> lengths(10, 0);
+  CountTask task = { &counts, &lengths };
+  caffe_parallel_for(10, 1, task);
+  for (int k = 0; k < 10; ++k) {
+    EXPECT_EQ(counts[k], 1);
+    EXPECT_EQ(lengths[k], 10);
+  }
+}
+
+class PoolThread : public InternalThread {
+ public:
+  ThreadPool* pool;
+
+ protected:
+  void InternalThreadEntry() {
+    pool = Caffe::thread_pool().get();
+  }
+};
+
+TEST_F(ThreadPoolTest, TestSharedWithInternalThread) {
+  Caffe::set_cpu_threads(3);
+  ASSERT_TRUE(Caffe::thread_pool() != NULL);
+  EXPECT_EQ(Caffe::thread_pool()->num_threads(), 3);
+  PoolThread thread;
+  thread.StartInternalThread();
+  thread.StopInternalThread();
+  EXPECT_EQ(thread.pool, Caffe::thread_pool().get());
+  Caffe::set_cpu_threads(1);
+  EXPECT_TRUE(Caffe::thread_pool() == NULL);
+}
+
+TEST_F(ThreadPoolTest, TestKernelsWithPool) {
+  // Large enough to be split
+  const int count = 8 * kParallelGrain + 5;
+  Blob<float> a(1, 1, 1, count);
+  Blob<float> b(1, 1, 1, count);
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  filler.Fill(&a);
+  filler.Fill(&b);
+  // A 3 x 3 convolution of 64 x 64 images with enough rows to split
+  const int channels = 16;
+  Blob<float> image(2, channels, 64, 64);
+  filler.Fill(&image);
+  const int col_count = channels * 9 * 62 * 62;
+  Blob<float> results[2];
+  for (int threads = 1; threads <= 4; threads += 3) {
+    Caffe::set_cpu_threads(threads);
+    Blob<float>& result = results[threads == 1 ? 0 : 1];
+    result.Reshape(1, 1, 5, col_count);
+    float* y = result.mutable_cpu_data();
+    caffe_add(count, a.cpu_data(), b.cpu_data(), y);
+    caffe_copy(count, a.cpu_data(), y + col_count);
+    caffe_axpy(count, 0.5f, b.cpu_data(), y + col_count);
+    caffe_set(count, 3.f, y + 2 * col_count);
+    caffe_powx(count, y + 2 * col_count, 2.f, y + 2 * col_count);
+    im2col_cpu(image.cpu_data(), channels, 64, 64, 3, 3, 0, 0, 1, 1,
+        y + 3 * col_count);
+    col2im_cpu(y + 3 * col_count, channels, 64, 64, 3, 3, 0, 0, 1, 1,
+        y + 4 * col_count);
+  }
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < count; ++j) {
+      EXPECT_EQ(results[0].data_at(0, 0, i, j), results[1].data_at(0, 0, i, j));
+    }
+  }
+  for (int i = 3; i < 5; ++i) {
+    for (int j = 0; j < col_count; ++j) {
+      EXPECT_EQ(results[0].data_at(0, 0, i, j), results[1].data_at(0, 0, i, j));
+    }
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,538 @@
+#include <algorithm>
+#include <cstring>
+
+#include "caffe/common.hpp"
+#include "caffe/util/direct_conv.hpp"
+#include "caffe/util/math_functions.hpp"
+
+// The kernels are written once with GCC vector extensions and compiled for
+// each instruction set by inlining them into functions with a target
+// attribute; the widest one the CPU supports is picked at run time.
+#if defined(__x86_64__) || defined(__i386__)
+#define DIRECT_CONV_X86
+#endif
+
+#define DIRECT_CONV_INLINE inline __attribute__((always_inline))
+// The accumulators of a micro-kernel only stay in registers when its loops
+// over pixels are unrolled, which -O2 does not do by itself.  Only GCC 8
+// and later know the pragma.
+#if defined(__GNUC__) && __GNUC__ >= 8 && !defined(__clang__)
+#define DIRECT_CONV_UNROLL _Pragma("GCC unroll 4")
+#else
+#define DIRECT_CONV_UNROLL
+#endif
+
+namespace caffe {
+
+namespace {
+
+// Outputs computed together by one call of a micro-kernel.
+const int kPixelBlock = 4;
+
+// SIMD vectors of kBytes. Vectors are only passed by pointer, which keeps
+// the calling convention independent of the instruction set.
+template <typename Dtype, int kBytes>
+struct Vector {
+  typedef Dtype Type __attribute__((vector_size(kBytes)));
+  static const int kSize = kBytes / sizeof(Dtype);
+  // Channels of a micro-kernel: two vectors.
+  static const int kChannelBlock = 2 * kSize;
+
+  static DIRECT_CONV_INLINE void Load(const Dtype* data, Type* v) {
+    memcpy(v, data, sizeof(Type));
+  }
+  static DIRECT_CONV_INLINE void Store(const Type* v, Dtype* data) {
+    memcpy(data, v, sizeof(Type));
+  }
+  static DIRECT_CONV_INLINE void Broadcast(const Dtype value, Type* v) {
+    *v = Type() + value;
+  }
+};
+
+inline int PadChannels(const int channels, const int block) {
+  return (channels + block - 1) / block * block;
+}
+
+// kPixels consecutive outputs of one row, for one block of output channels:
+// out[j][c] = sum_{ci,ky,kx} in[ci][ky][j * stride_w + kx] * w[ci][ky][kx][c]
+template <typename Dtype, int kBytes, int kPixels>
+DIRECT_CONV_INLINE void ForwardBlock(const DirectConvShape& s,
+    const Dtype* in, const Dtype* w, const int out_stride, Dtype* out) {
+  typedef Vector<Dtype, kBytes> V;
+  typename V::Type acc[kPixels][2];
+  DIRECT_CONV_UNROLL
+  for (int j = 0; j < kPixels; ++j) {
+    acc[j][0] = acc[j][1] = typename V::Type();
+  }
+  for (int ci = 0; ci < s.channels; ++ci) {
+    for (int ky = 0; ky < s.kernel_h; ++ky) {
+      const Dtype* row = in + (ci * s.height + ky) * s.width;
+      for (int kx = 0; kx < s.kernel_w; ++kx) {
+        typename V::Type w0, w1, x;
+        V::Load(w, &w0);
+        V::Load(w + V::kSize, &w1);
+        w += out_stride;
+        DIRECT_CONV_UNROLL
+        for (int j = 0; j < kPixels; ++j) {
+          V::Broadcast(row[j * s.stride_w + kx], &x);
+          acc[j][0] += x * w0;
+          acc[j][1] += x * w1;
+        }
+      }
+    }
+  }
+  DIRECT_CONV_UNROLL
+  for (int j = 0; j < kPixels; ++j) {
+    V::Store(&acc[j][0], out + j * out_stride);
+    V::Store(&acc[j][1], out + j * out_stride + V::kSize);
+  }
+}
+
+// One block of output channels of kTaps consecutive taps of a filter row,
+// summed over all outputs:
+// dw[j][c] += sum_{oy,ox} in[oy * stride_h][ox * stride_w + j] * dy[oy][ox][c]
+template <typename Dtype, int kBytes, int kTaps>
+DIRECT_CONV_INLINE void WeightBlock(const DirectConvShape& s,
+    const Dtype* in, const Dtype* dy, const int dy_stride, Dtype* dw) {
+  typedef Vector<Dtype, kBytes> V;
+  typename V::Type acc[kTaps][2];
+  DIRECT_CONV_UNROLL
+  for (int j = 0; j < kTaps; ++j) {
+    acc[j][0] = acc[j][1] = typename V::Type();
+  }
+  for (int oy = 0; oy < s.height_out; ++oy) {
+    const Dtype* row = in + oy * s.stride_h * s.width;
+    for (int ox = 0; ox < s.width_out; ++ox) {
+      typename V::Type d0, d1, x;
+      V::Load(dy, &d0);
+      V::Load(dy + V::kSize, &d1);
+      dy += dy_stride;
+      DIRECT_CONV_UNROLL
+      for (int j = 0; j < kTaps; ++j) {
+        V::Broadcast(row[ox * s.stride_w + j], &x);
+        acc[j][0] += x * d0;
+        acc[j][1] += x * d1;
+      }
+    }
+  }
+  DIRECT_CONV_UNROLL
+  for (int j = 0; j < kTaps; ++j) {
+    typename V::Type sum0, sum1;
+    V::Load(dw + j * dy_stride, &sum0);
+    V::Load(dw + j * dy_stride + V::kSize, &sum1);
+    sum0 += acc[j][0];
+    sum1 += acc[j][1];
+    V::Store(&sum0, dw + j * dy_stride);
+    V::Store(&sum1, dw + j * dy_stride + V::kSize);
+  }
+}
+
+// One tap of the filter applied backwards from kPixels consecutive outputs
+// of one row, for one block of input channels:
+// dx[j * stride_w][c] += sum_co dy[j][co] * w[co][c]
+template <typename Dtype, int kBytes, int kPixels>
+DIRECT_CONV_INLINE void DataBlock(const DirectConvShape& s,
+    const Dtype* dy, const Dtype* w, const int dx_stride, Dtype* dx) {
+  typedef Vector<Dtype, kBytes> V;
+  typename V::Type acc[kPixels][2];
+  DIRECT_CONV_UNROLL
+  for (int j = 0; j < kPixels; ++j) {
+    acc[j][0] = acc[j][1] = typename V::Type();
+  }
+  for (int co = 0; co < s.num_output; ++co) {
+    typename V::Type w0, w1, d;
+    V::Load(w, &w0);
+    V::Load(w + V::kSize, &w1);
+    w += dx_stride;
+    DIRECT_CONV_UNROLL
+    for (int j = 0; j < kPixels; ++j) {
+      V::Broadcast(dy[j * s.num_output + co], &d);
+      acc[j][0] += d * w0;
+      acc[j][1] += d * w1;
+    }
+  }
+  DIRECT_CONV_UNROLL
+  for (int j = 0; j < kPixels; ++j) {
+    Dtype* pixel = dx + j * s.stride_w * dx_stride;
+    typename V::Type sum0, sum1;
+    V::Load(pixel, &sum0);
+    V::Load(pixel + V::kSize, &sum1);
+    sum0 += acc[j][0];
+    sum1 += acc[j][1];
+    V::Store(&sum0, pixel);
+    V::Store(&sum1, pixel + V::kSize);
+  }
+}
+
+// Workspace: packed weights (channels x kernel_h x kernel_w x padded
+// num_output), then the output of one image with channels last.
+template <typename Dtype, int kBytes>
+DIRECT_CONV_INLINE void ForwardImpl(const DirectConvShape& s,
+    const Dtype* input, const Dtype* weights, Dtype* output, const int num,
+    Dtype* workspace) {
+  typedef Vector<Dtype, kBytes> V;
+  const int kernel_dim = s.channels * s.kernel_h * s.kernel_w;
+  const int out_spatial_dim = s.height_out * s.width_out;
+  const int out_channels = PadChannels(s.num_output, V::kChannelBlock);
+  Dtype* packed = workspace;
+  Dtype* out_t = workspace + kernel_dim * out_channels;
+  for (int k = 0; k < kernel_dim; ++k) {
+    for (int c = 0; c < out_channels; ++c) {
+      packed[k * out_channels + c] =
+          c < s.num_output ? weights[c * kernel_dim + k] : Dtype(0);
+    }
+  }
+  for (int n = 0; n < num; ++n) {
+    const Dtype* in = input + n * s.channels * s.height * s.width;
+    for (int c = 0; c < out_channels; c += V::kChannelBlock) {
+      for (int oy = 0; oy < s.height_out; ++oy) {
+        const Dtype* in_row = in + oy * s.stride_h * s.width;
+        Dtype* out = out_t + oy * s.width_out * out_channels + c;
+        int ox = 0;
+        for (; ox + kPixelBlock <= s.width_out; ox += kPixelBlock) {
+          ForwardBlock<Dtype, kBytes, kPixelBlock>(s,
+              in_row + ox * s.stride_w, packed + c, out_channels,
+              out + ox * out_channels);
+        }
+        for (; ox < s.width_out; ++ox) {
+          ForwardBlock<Dtype, kBytes, 1>(s, in_row + ox * s.stride_w,
+              packed + c, out_channels, out + ox * out_channels);
+        }
+      }
+    }
+    Dtype* out = output + n * s.num_output * out_spatial_dim;
+    for (int c = 0; c < s.num_output; ++c) {
+      for (int p = 0; p < out_spatial_dim; ++p) {
+        out[c * out_spatial_dim + p] = out_t[p * out_channels + c];
+      }
+    }
+  }
+}
+
+// Workspace: the packed weight gradient, laid out as the packed weights of
+// Forward, then the output gradient of one image with channels last.
+template <typename Dtype, int kBytes>
+DIRECT_CONV_INLINE void BackwardWeightsImpl(const DirectConvShape& s,
+    const Dtype* input, const Dtype* output_diff, Dtype* weight_diff,
+    const int num, Dtype* workspace) {
+  typedef Vector<Dtype, kBytes> V;
+  const int kernel_dim = s.channels * s.kernel_h * s.kernel_w;
+  const int out_spatial_dim = s.height_out * s.width_out;
+  const int out_channels = PadChannels(s.num_output, V::kChannelBlock);
+  Dtype* packed_diff = workspace;
+  Dtype* dy_t = workspace + kernel_dim * out_channels;
+  caffe_set(kernel_dim * out_channels, Dtype(0), packed_diff);
+  for (int n = 0; n < num; ++n) {
+    const Dtype* dy = output_diff + n * s.num_output * out_spatial_dim;
+    for (int p = 0; p < out_spatial_dim; ++p) {
+      for (int c = 0; c < out_channels; ++c) {
+        dy_t[p * out_channels + c] =
+            c < s.num_output ? dy[c * out_spatial_dim + p] : Dtype(0);
+      }
+    }
+    const Dtype* in = input + n * s.channels * s.height * s.width;
+    for (int c = 0; c < out_channels; c += V::kChannelBlock) {
+      for (int ci = 0; ci < s.channels; ++ci) {
+        for (int ky = 0; ky < s.kernel_h; ++ky) {
+          const Dtype* in_row = in + (ci * s.height + ky) * s.width;
+          Dtype* dw = packed_diff +
+              (ci * s.kernel_h + ky) * s.kernel_w * out_channels + c;
+          int kx = 0;
+          for (; kx + kPixelBlock <= s.kernel_w; kx += kPixelBlock) {
+            WeightBlock<Dtype, kBytes, kPixelBlock>(s, in_row + kx,
+                dy_t + c, out_channels, dw + kx * out_channels);
+          }
+          for (; kx < s.kernel_w; ++kx) {
+            WeightBlock<Dtype, kBytes, 1>(s, in_row + kx, dy_t + c,
+                out_channels, dw + kx * out_channels);
+          }
+        }
+      }
+    }
+  }
+  for (int c = 0; c < s.num_output; ++c) {
+    for (int k = 0; k < kernel_dim; ++k) {
+      weight_diff[c * kernel_dim + k] += packed_diff[k * out_channels + c];
+    }
+  }
+}
+
+// Workspace: the weights packed as kernel_h x kernel_w x num_output x padded
+// channels, the output gradient of one image with channels last, then the
+// input gradient of one image with padded channels last.
+template <typename Dtype, int kBytes>
+DIRECT_CONV_INLINE void BackwardDataImpl(const DirectConvShape& s,
+    const Dtype* output_diff, const Dtype* weights, Dtype* input_diff,
+    const int num, Dtype* workspace) {
+  typedef Vector<Dtype, kBytes> V;
+  const int kernel_size = s.kernel_h * s.kernel_w;
+  const int spatial_dim = s.height * s.width;
+  const int out_spatial_dim = s.height_out * s.width_out;
+  const int in_channels = PadChannels(s.channels, V::kChannelBlock);
+  Dtype* packed = workspace;
+  Dtype* dy_t = packed + kernel_size * s.num_output * in_channels;
+  Dtype* dx_t = dy_t + out_spatial_dim * s.num_output;
+  for (int k = 0; k < kernel_size; ++k) {
+    for (int co = 0; co < s.num_output; ++co) {
+      for (int c = 0; c < in_channels; ++c) {
+        packed[(k * s.num_output + co) * in_channels + c] = c < s.channels ?
+            weights[(co * s.channels + c) * kernel_size + k] : Dtype(0);
+      }
+    }
+  }
+  for (int n = 0; n < num; ++n) {
+    const Dtype* dy = output_diff + n * s.num_output * out_spatial_dim;
+    for (int co = 0; co < s.num_output; ++co) {
+      for (int p = 0; p < out_spatial_dim; ++p) {
+        dy_t[p * s.num_output + co] = dy[co * out_spatial_dim + p];
+      }
+    }
+    caffe_set(spatial_dim * in_channels, Dtype(0), dx_t);
+    for (int c = 0; c < in_channels; c += V::kChannelBlock) {
+      for (int oy = 0; oy < s.height_out; ++oy) {
+        for (int ox = 0; ox < s.width_out; ) {
+          const int pixels = s.width_out - ox >= kPixelBlock ? kPixelBlock : 1;
+          const Dtype* dy_pixels = dy_t + (oy * s.width_out + ox) * s.num_output;
+          for (int ky = 0; ky < s.kernel_h; ++ky) {
+            for (int kx = 0; kx < s.kernel_w; ++kx) {
+              const Dtype* w = packed +
+                  (ky * s.kernel_w + kx) * s.num_output * in_channels + c;
+              Dtype* dx = dx_t + ((oy * s.stride_h + ky) * s.width +
+                  ox * s.stride_w + kx) * in_channels + c;
+              if (pixels == kPixelBlock) {
+                DataBlock<Dtype, kBytes, kPixelBlock>(s, dy_pixels, w,
+                    in_channels, dx);
+              } else {
+                DataBlock<Dtype, kBytes, 1>(s, dy_pixels, w, in_channels, dx);
+              }
+            }
+          }
+          ox += pixels;
+        }
+      }
+    }
+    Dtype* dx = input_diff + n * s.channels * spatial_dim;
+    for (int c = 0; c < s.channels; ++c) {
+      for (int p = 0; p < spatial_dim; ++p) {
+        dx[c * spatial_dim + p] = dx_t[p * in_channels + c];
+      }
+    }
+  }
+}
+
+// Vectors narrower than kBytes waste fewer lanes on few channels, such as
+// the input channels of the first layer.
+template <typename Dtype, int kBytes>
+DIRECT_CONV_INLINE int ChannelBytes(const int channels) {
+  if (kBytes > 16 && channels <= Vector<Dtype, 16>::kChannelBlock) {
+    return 16;
+  }
+  if (kBytes > 32 && channels <= Vector<Dtype, 32>::kChannelBlock) {
+    return 32;
+  }
+  return kBytes;
+}
+
+template <typename Dtype, int kBytes>
+DIRECT_CONV_INLINE void Forward(const DirectConvShape& s, const Dtype* input,
+    const Dtype* weights, Dtype* output, const int num, Dtype* workspace) {
+  switch (ChannelBytes<Dtype, kBytes>(s.num_output)) {
+  case 16:
+    ForwardImpl<Dtype, 16>(s, input, weights, output, num, workspace);
+    break;
+  case 32:
+    ForwardImpl<Dtype, 32>(s, input, weights, output, num, workspace);
+    break;
+  default:
+    ForwardImpl<Dtype, kBytes>(s, input, weights, output, num, workspace);
+  }
+}
+
+template <typename Dtype, int kBytes>
+DIRECT_CONV_INLINE void BackwardWeights(const DirectConvShape& s,
+    const Dtype* input, const Dtype* output_diff, Dtype* weight_diff,
+    const int num, Dtype* workspace) {
+  switch (ChannelBytes<Dtype, kBytes>(s.num_output)) {
+  case 16:
+    BackwardWeightsImpl<Dtype, 16>(s, input, output_diff, weight_diff, num,
+        workspace);
+    break;
+  case 32:
+    BackwardWeightsImpl<Dtype, 32>(s, input, output_diff, weight_diff, num,
+        workspace);
+    break;
+  default:
+    BackwardWeightsImpl<Dtype, kBytes>(s, input, output_diff, weight_diff,
+        num, workspace);
+  }
+}
+
+template <typename Dtype, int kBytes>
+DIRECT_CONV_INLINE void BackwardData(const DirectConvShape& s,
+    const Dtype* output_diff, const Dtype* weights, Dtype* input_diff,
+    const int num, Dtype* workspace) {
+  switch (ChannelBytes<Dtype, kBytes>(s.channels)) {
+  case 16:
+    BackwardDataImpl<Dtype, 16>(s, output_diff, weights, input_diff, num,
+        workspace);
+    break;
+  case 32:
+    BackwardDataImpl<Dtype, 32>(s, output_diff, weights, input_diff, num,
+        workspace);
+    break;
+  default:
+    BackwardDataImpl<Dtype, kBytes>(s, output_diff, weights, input_diff, num,
+        workspace);
+  }
+}
+
+// Large enough for every vector width Forward and friends may choose, as
+// padding to the widest block pads the most.
+template <typename Dtype, int kBytes>
+size_t WorkspaceSize(const DirectConvShape& s) {
+  const int block = Vector<Dtype, kBytes>::kChannelBlock;
+  const size_t kernel_size = s.kernel_h * s.kernel_w;
+  const size_t out_spatial_dim = s.height_out * s.width_out;
+  const size_t out_channels = PadChannels(s.num_output, block);
+  const size_t in_channels = PadChannels(s.channels, block);
+  const size_t forward = (s.channels * kernel_size + out_spatial_dim) *
+      out_channels;
+  const size_t backward_data = kernel_size * s.num_output * in_channels +
+      out_spatial_dim * s.num_output + s.height * s.width * in_channels;
+  return std::max(forward, backward_data);
+}
+
+// The kernels for one instruction set.
+template <typename Dtype>
+struct DirectConvKernels {
+  const char* instruction_set;
+  size_t (*workspace_size)(const DirectConvShape&);
+  void (*forward)(const DirectConvShape&, const Dtype*, const Dtype*, Dtype*,
+      const int, Dtype*);
+  void (*backward_weights)(const DirectConvShape&, const Dtype*, const Dtype*,
+      Dtype*, const int, Dtype*);
+  void (*backward_data)(const DirectConvShape&, const Dtype*, const Dtype*,
+      Dtype*, const int, Dtype*);
+};
+
+// Defines the kernels of an instruction set as NAME##Forward etc.
+#define DEFINE_DIRECT_CONV_KERNELS(NAME, TARGET, BYTES) \
+template <typename Dtype> \
+size_t NAME##WorkspaceSize(const DirectConvShape& s) { \
+  return WorkspaceSize<Dtype, BYTES>(s); \
+} \
+template <typename Dtype> TARGET \
+void NAME##Forward(const DirectConvShape& s, const Dtype* input, \
+    const Dtype* weights, Dtype* output, const int num, Dtype* workspace) { \
+  Forward<Dtype, BYTES>(s, input, weights, output, num, workspace); \
+} \
+template <typename Dtype> TARGET \
+void NAME##BackwardWeights(const DirectConvShape& s, const Dtype* input, \
+    const Dtype* output_diff, Dtype* weight_diff, const int num, \
+    Dtype* workspace) { \
+  BackwardWeights<Dtype, BYTES>(s, input, output_diff, weight_diff, num, \
+      workspace); \
+} \
+template <typename Dtype> TARGET \
+void NAME##BackwardData(const DirectConvShape& s, const Dtype* output_diff, \
+    const Dtype* weights, Dtype* input_diff, const int num, \
+    Dtype* workspace) { \
+  BackwardData<Dtype, BYTES>(s, output_diff, weights, input_diff, num, \
+      workspace); \
+} \
+template <typename Dtype> \
+DirectConvKernels<Dtype> NAME##Kernels() { \
+  DirectConvKernels<Dtype> kernels = { #NAME, &NAME##WorkspaceSize<Dtype>, \
+      &NAME##Forward<Dtype>, &NAME##BackwardWeights<Dtype>, \
+      &NAME##BackwardData<Dtype> }; \
+  return kernels; \
+}
+
+// 16 byte vectors, which are SSE2 on x86 and split or scalar elsewhere.
+DEFINE_DIRECT_CONV_KERNELS(Generic, , 16)
+#ifdef DIRECT_CONV_X86
+DEFINE_DIRECT_CONV_KERNELS(AVX2, __attribute__((target("avx2,fma"))), 32)
+DEFINE_DIRECT_CONV_KERNELS(AVX512, __attribute__((target("avx512f,fma"))), 64)
+#endif
+
+template <typename Dtype>
+DirectConvKernels<Dtype> SelectKernels() {
+#ifdef DIRECT_CONV_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("fma")) {
+    return AVX512Kernels<Dtype>();
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return AVX2Kernels<Dtype>();
+  }
+#endif
+  return GenericKernels<Dtype>();
+}
+
+template <typename Dtype>
+const DirectConvKernels<Dtype>& Kernels() {
+  static const DirectConvKernels<Dtype> kernels = SelectKernels<Dtype>();
+  return kernels;
+}
+
+}  // namespace
+
+template <typename Dtype>
+size_t direct_conv_workspace_size(const DirectConvShape& shape) {
+  return Kernels<Dtype>().workspace_size(shape);
+}
+
+template <typename Dtype>
+void direct_conv_forward_cpu(const DirectConvShape& shape, const Dtype* input,
+    const Dtype* weights, Dtype* output, const int num, Dtype* workspace) {
+  Kernels<Dtype>().forward(shape, input, weights, output, num, workspace);
+}
+
+template <typename Dtype>
+void direct_conv_backward_weights_cpu(const DirectConvShape& shape,
+    const Dtype* input, const Dtype* output_diff, Dtype* weight_diff,
+    const int num, Dtype* workspace) {
+  Kernels<Dtype>().backward_weights(shape, input, output_diff, weight_diff,
+      num, workspace);
+}
+
+template <typename Dtype>
+void direct_conv_backward_data_cpu(const DirectConvShape& shape,
+    const Dtype* output_diff, const Dtype* weights, Dtype* input_diff,
+    const int num, Dtype* workspace) {
+  Kernels<Dtype>().backward_data(shape, output_diff, weights, input_diff,
+      num, workspace);
+}
+
+const char* direct_conv_instruction_set() {
+  return Kernels<float>().instruction_set;
+}
+
+// Explicit instantiation
+template size_t direct_conv_workspace_size<float>(
+    const DirectConvShape& shape);
+template size_t direct_conv_workspace_size<double>(
+    const DirectConvShape& shape);
+template void direct_conv_forward_cpu<float>(const DirectConvShape& shape,
+    const float* input, const float* weights, float* output, const int num,
+    float* workspace);
+template void direct_conv_forward_cpu<double>(const DirectConvShape& shape,
+    const double* input, const double* weights, double* output, const int num,
+    double* workspace);
+template void direct_conv_backward_weights_cpu<float>(
+    const DirectConvShape& shape, const float* input,
+    const float* output_diff, float* weight_diff, const int num,
+    float* workspace);
+template void direct_conv_backward_weights_cpu<double>(
+    const DirectConvShape& shape, const double* input,
+    const double* output_diff, double* weight_diff, const int num,
+    double* workspace);
+template void direct_conv_backward_data_cpu<float>(
+    const DirectConvShape& shape, const float* output_diff,
+    const float* weights, float* input_diff, const int num, float* workspace);
+template void direct_conv_backward_data_cpu<double>(
+    const DirectConvShape& shape, const double* output_diff,
+    const double* weights, double* input_diff, const int num,
+    double* workspace);
+
+}  // namespace caffe
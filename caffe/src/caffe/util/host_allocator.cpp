@@ -0,0 +1,173 @@
+#include <boost/thread.hpp>
+#include <stdlib.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "caffe/util/host_allocator.hpp"
+
+namespace caffe {
+
+// Freed memory the default allocator keeps for reuse.
+static const size_t kDefaultMaxCachedBytes = 256 << 20;
+
+static void* SystemAllocate(const size_t size, const bool huge_pages) {
+  const bool huge = huge_pages && size >= kHugePageSize;
+  void* ptr = NULL;
+  CHECK_EQ(posix_memalign(&ptr, huge ? kHugePageSize : kHostAlignment,
+      std::max(size, kHostAlignment)), 0)
+      << "host allocation of size " << size << " failed";
+#ifdef MADV_HUGEPAGE
+  if (huge) {
+    // Only advice: the kernel may still back the block with small pages
+    madvise(ptr, size, MADV_HUGEPAGE);
+  }
+#endif
+  return ptr;
+}
+
+class HostAllocator::sync {
+ public:
+  mutable boost::mutex mutex;
+};
+
+HostAllocator::HostAllocator()
+    : sync_(new sync()) {
+}
+
+void* HostAllocator::Allocate(size_t size) {
+  bool reused = false;
+  void* ptr = AllocateBlock(size, &reused);
+  boost::mutex::scoped_lock lock(sync_->mutex);
+  stats_.live_bytes += size;
+  stats_.peak_bytes = std::max(stats_.peak_bytes, stats_.live_bytes);
+  ++stats_.allocations;
+  if (reused) {
+    ++stats_.reuses;
+  }
+  return ptr;
+}
+
+void HostAllocator::Free(void* ptr, size_t size) {
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex);
+    CHECK_GE(stats_.live_bytes, size) << "Freeing more than was allocated";
+    stats_.live_bytes -= size;
+  }
+  FreeBlock(ptr, size);
+}
+
+HostAllocator::Stats HostAllocator::stats() const {
+  Stats stats;
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex);
+    stats = stats_;
+  }
+  stats.cached_bytes = cached_bytes();
+  return stats;
+}
+
+const shared_ptr<HostAllocator>& HostAllocator::Default() {
+  static const shared_ptr<HostAllocator> allocator(
+      new PooledHostAllocator(kDefaultMaxCachedBytes, false));
+  return allocator;
+}
+
+void* HostAllocator::AllocateBlock(size_t size, bool* reused) {
+  *reused = false;
+  return SystemAllocate(size, false);
+}
+
+void HostAllocator::FreeBlock(void* ptr, size_t size) {
+  free(ptr);
+}
+
+class PooledHostAllocator::Pool {
+ public:
+  Pool() : cached_bytes(0) {}
+
+  mutable boost::mutex mutex;
+  // The cached blocks of each class size
+  std::map<size_t, vector<void*> > blocks;
+  size_t cached_bytes;
+};
+
+PooledHostAllocator::PooledHostAllocator(size_t max_cached_bytes,
+    bool huge_pages)
+    : max_cached_bytes_(max_cached_bytes), huge_pages_(huge_pages),
+      pool_(new Pool()) {
+}
+
+PooledHostAllocator::~PooledHostAllocator() {
+  Trim();
+}
+
+void PooledHostAllocator::Trim() {
+  std::map<size_t, vector<void*> > blocks;
+  {
+    boost::mutex::scoped_lock lock(pool_->mutex);
+    blocks.swap(pool_->blocks);
+    pool_->cached_bytes = 0;
+  }
+  for (std::map<size_t, vector<void*> >::iterator it = blocks.begin();
+       it != blocks.end(); ++it) {
+    for (int i = 0; i < it->second.size(); ++i) {
+      free(it->second[i]);
+    }
+  }
+}
+
+size_t PooledHostAllocator::ClassSize(size_t size) {
+  if (size <= kHostAlignment) {
+    return kHostAlignment;
+  }
+  // Steps of a quarter of the power of two below size
+  int log2 = 0;
+  while ((size - 1) >> (log2 + 1)) {
+    ++log2;
+  }
+  const size_t step = std::max(kHostAlignment, size_t(1) << (log2 - 2));
+  return (size + step - 1) / step * step;
+}
+
+void* PooledHostAllocator::AllocateBlock(size_t size, bool* reused) {
+  const size_t class_size = ClassSize(size);
+  {
+    boost::mutex::scoped_lock lock(pool_->mutex);
+    std::map<size_t, vector<void*> >::iterator it =
+        pool_->blocks.find(class_size);
+    if (it != pool_->blocks.end() && !it->second.empty()) {
+      void* ptr = it->second.back();
+      it->second.pop_back();
+      pool_->cached_bytes -= class_size;
+      *reused = true;
+      return ptr;
+    }
+  }
+  *reused = false;
+  return SystemAllocate(class_size, huge_pages_);
+}
+
+void PooledHostAllocator::FreeBlock(void* ptr, size_t size) {
+  const size_t class_size = ClassSize(size);
+  {
+    boost::mutex::scoped_lock lock(pool_->mutex);
+    if (pool_->cached_bytes + class_size <= max_cached_bytes_) {
+      pool_->blocks[class_size].push_back(ptr);
+      pool_->cached_bytes += class_size;
+      return;
+    }
+  }
+  free(ptr);
+}
+
+size_t PooledHostAllocator::cached_bytes() const {
+  boost::mutex::scoped_lock lock(pool_->mutex);
+  return pool_->cached_bytes;
+}
+
+}  // namespace caffe
@@ -5,34 +5,164 @@
 
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
+namespace {
+
+// The 2D functions split their loops over channels across the thread pool.
+template <typename Dtype, typename Itype = Dtype>
+struct Im2colArgs {
+  const Itype* input;
+  Dtype* output;
+  int num;
+  int channels;
+  int height;
+  int width;
+  int kernel_h;
+  int kernel_w;
+  int pad_h;
+  int pad_w;
+  int stride_h;
+  int stride_w;
+  int height_col;
+  int width_col;
+};
+
+template <typename Dtype, typename Itype>
+Im2colArgs<Dtype, Itype> make_im2col_args(const Itype* input, const int num,
+    const int channels, const int height, const int width, const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, Dtype* output) {
+  Im2colArgs<Dtype, Itype> args = { input, output, num, channels, height, width,
+      kernel_h, kernel_w, pad_h, pad_w, stride_h, stride_w,
+      (height + 2 * pad_h - kernel_h) / stride_h + 1,
+      (width + 2 * pad_w - kernel_w) / stride_w + 1 };
+  return args;
+}
+
+// Rows [begin, end) of the column buffer of one image
+template <typename Dtype>
+struct Im2colTask {
+  Im2colArgs<Dtype> a;
+  void operator()(const int begin, const int end) const {
+    for (int c = begin; c < end; ++c) {
+      int w_offset = c % a.kernel_w;
+      int h_offset = (c / a.kernel_w) % a.kernel_h;
+      int c_im = c / a.kernel_h / a.kernel_w;
+      for (int h = 0; h < a.height_col; ++h) {
+        for (int w = 0; w < a.width_col; ++w) {
+          int h_pad = h * a.stride_h - a.pad_h + h_offset;
+          int w_pad = w * a.stride_w - a.pad_w + w_offset;
+          if (h_pad >= 0 && h_pad < a.height && w_pad >= 0 && w_pad < a.width)
+            a.output[(c * a.height_col + h) * a.width_col + w] =
+              a.input[(c_im * a.height + h_pad) * a.width + w_pad];
+          else
+            a.output[(c * a.height_col + h) * a.width_col + w] = 0;
+        }
+      }
+    }
+  }
+};
+
+// Channels [begin, end) of one image, from the rows of the column buffer
+// that add to them
+template <typename Dtype>
+struct Col2imTask {
+  Im2colArgs<Dtype> a;
+  void operator()(const int begin, const int end) const {
+    const int kernel_size = a.kernel_h * a.kernel_w;
+    for (int c = begin * kernel_size; c < end * kernel_size; ++c) {
+      int w_offset = c % a.kernel_w;
+      int h_offset = (c / a.kernel_w) % a.kernel_h;
+      int c_im = c / a.kernel_h / a.kernel_w;
+      for (int h = 0; h < a.height_col; ++h) {
+        for (int w = 0; w < a.width_col; ++w) {
+          int h_pad = h * a.stride_h - a.pad_h + h_offset;
+          int w_pad = w * a.stride_w - a.pad_w + w_offset;
+          if (h_pad >= 0 && h_pad < a.height && w_pad >= 0 && w_pad < a.width)
+            a.output[(c_im * a.height + h_pad) * a.width + w_pad] +=
+                a.input[(c * a.height_col + h) * a.width_col + w];
+        }
+      }
+    }
+  }
+};
+
+// Rows [begin, end) of the column buffer of a batch, whose images of Itype
+// are read as scale * x + shift
+template <typename Dtype, typename Itype>
+struct Im2colBatchTask {
+  Im2colArgs<Dtype, Itype> a;
+  Dtype scale;
+  Dtype shift;
+  void operator()(const int begin, const int end) const {
+    for (int c = begin; c < end; ++c) {
+      int w_offset = c % a.kernel_w;
+      int h_offset = (c / a.kernel_w) % a.kernel_h;
+      int c_im = c / a.kernel_h / a.kernel_w;
+      for (int n = 0; n < a.num; ++n) {
+        const Itype* im =
+            a.input + ((n * a.channels + c_im) * a.height) * a.width;
+        Dtype* col = a.output + (c * a.num + n) * a.height_col * a.width_col;
+        for (int h = 0; h < a.height_col; ++h) {
+          int h_pad = h * a.stride_h - a.pad_h + h_offset;
+          for (int w = 0; w < a.width_col; ++w) {
+            int w_pad = w * a.stride_w - a.pad_w + w_offset;
+            if (h_pad >= 0 && h_pad < a.height && w_pad >= 0 && w_pad < a.width)
+              col[h * a.width_col + w] = scale * im[h_pad * a.width + w_pad]
+                  + shift;
+            else
+              col[h * a.width_col + w] = 0;
+          }
+        }
+      }
+    }
+  }
+};
+
+// Channels [begin, end) of every image of a batch
+template <typename Dtype>
+struct Col2imBatchTask {
+  Im2colArgs<Dtype> a;
+  void operator()(const int begin, const int end) const {
+    const int kernel_size = a.kernel_h * a.kernel_w;
+    for (int c = begin * kernel_size; c < end * kernel_size; ++c) {
+      int w_offset = c % a.kernel_w;
+      int h_offset = (c / a.kernel_w) % a.kernel_h;
+      int c_im = c / a.kernel_h / a.kernel_w;
+      for (int n = 0; n < a.num; ++n) {
+        Dtype* im = a.output + ((n * a.channels + c_im) * a.height) * a.width;
+        const Dtype* col =
+            a.input + (c * a.num + n) * a.height_col * a.width_col;
+        for (int h = 0; h < a.height_col; ++h) {
+          int h_pad = h * a.stride_h - a.pad_h + h_offset;
+          if (h_pad < 0 || h_pad >= a.height) continue;
+          for (int w = 0; w < a.width_col; ++w) {
+            int w_pad = w * a.stride_w - a.pad_w + w_offset;
+            if (w_pad >= 0 && w_pad < a.width)
+              im[h_pad * a.width + w_pad] += col[h * a.width_col + w];
+          }
+        }
+      }
+    }
+  }
+};
+
+}  // namespace
+
 template <typename Dtype>
 void im2col_cpu(const Dtype* data_im, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
     const int pad_h, const int pad_w,
     const int stride_h, const int stride_w,
     Dtype* data_col) {
-  int height_col = (height + 2 * pad_h - kernel_h) / stride_h + 1;
-  int width_col = (width + 2 * pad_w - kernel_w) / stride_w + 1;
-  int channels_col = channels * kernel_h * kernel_w;
-  for (int c = 0; c < channels_col; ++c) {
-    int w_offset = c % kernel_w;
-    int h_offset = (c / kernel_w) % kernel_h;
-    int c_im = c / kernel_h / kernel_w;
-    for (int h = 0; h < height_col; ++h) {
-      for (int w = 0; w < width_col; ++w) {
-        int h_pad = h * stride_h - pad_h + h_offset;
-        int w_pad = w * stride_w - pad_w + w_offset;
-        if (h_pad >= 0 && h_pad < height && w_pad >= 0 && w_pad < width)
-          data_col[(c * height_col + h) * width_col + w] =
-            data_im[(c_im * height + h_pad) * width + w_pad];
-        else
-          data_col[(c * height_col + h) * width_col + w] = 0;
-      }
-    }
-  }
+  Im2colTask<Dtype> task = { make_im2col_args(data_im, 1, channels, height,
+      width, kernel_h, kernel_w, pad_h, pad_w, stride_h, stride_w,
+      data_col) };
+  caffe_parallel_for(channels * kernel_h * kernel_w,
+      caffe_parallel_grain(task.a.height_col * task.a.width_col), task);
 }
 
 // Explicit instantiation
@@ -144,23 +274,10 @@ void col2im_cpu(const Dtype* data_col, const int channels,
     const int stride_h, const int stride_w,
     Dtype* data_im) {
   caffe_set(height * width * channels, Dtype(0), data_im);
-  int height_col = (height + 2 * pad_h - patch_h) / stride_h + 1;
-  int width_col = (width + 2 * pad_w - patch_w) / stride_w + 1;
-  int channels_col = channels * patch_h * patch_w;
-  for (int c = 0; c < channels_col; ++c) {
-    int w_offset = c % patch_w;
-    int h_offset = (c / patch_w) % patch_h;
-    int c_im = c / patch_h / patch_w;
-    for (int h = 0; h < height_col; ++h) {
-      for (int w = 0; w < width_col; ++w) {
-        int h_pad = h * stride_h - pad_h + h_offset;
-        int w_pad = w * stride_w - pad_w + w_offset;
-        if (h_pad >= 0 && h_pad < height && w_pad >= 0 && w_pad < width)
-          data_im[(c_im * height + h_pad) * width + w_pad] +=
-              data_col[(c * height_col + h) * width_col + w];
-      }
-    }
-  }
+  Col2imTask<Dtype> task = { make_im2col_args(data_col, 1, channels, height,
+      width, patch_h, patch_w, pad_h, pad_w, stride_h, stride_w, data_im) };
+  caffe_parallel_for(channels, caffe_parallel_grain(
+      patch_h * patch_w * task.a.height_col * task.a.width_col), task);
 }
 
 // Explicit instantiation
@@ -173,6 +290,79 @@ template void col2im_cpu<double>(const double* data_col, const int channels,
     const int pad_h, const int pad_w, const int stride_h,
     const int stride_w, double* data_im);
 
+template <typename Dtype>
+void im2col_batch_cpu(const Dtype* data_im, const int num, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    Dtype* data_col) {
+  Im2colBatchTask<Dtype, Dtype> task = { make_im2col_args(data_im, num,
+      channels, height, width, kernel_h, kernel_w, pad_h, pad_w, stride_h,
+      stride_w, data_col), Dtype(1), Dtype(0) };
+  caffe_parallel_for(channels * kernel_h * kernel_w,
+      caffe_parallel_grain(num * task.a.height_col * task.a.width_col), task);
+}
+
+// Explicit instantiation
+template void im2col_batch_cpu<float>(const float* data_im, const int num,
+    const int channels, const int height, const int width, const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, float* data_col);
+template void im2col_batch_cpu<double>(const double* data_im, const int num,
+    const int channels, const int height, const int width, const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, double* data_col);
+
+template <typename Dtype>
+void im2col_batch_cpu(const uint8_t* data_im, const Dtype scale,
+    const Dtype shift, const int num, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    Dtype* data_col) {
+  Im2colBatchTask<Dtype, uint8_t> task = { make_im2col_args(data_im, num,
+      channels, height, width, kernel_h, kernel_w, pad_h, pad_w, stride_h,
+      stride_w, data_col), scale, shift };
+  caffe_parallel_for(channels * kernel_h * kernel_w,
+      caffe_parallel_grain(num * task.a.height_col * task.a.width_col), task);
+}
+
+// Explicit instantiation
+template void im2col_batch_cpu<float>(const uint8_t* data_im,
+    const float scale, const float shift, const int num, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, float* data_col);
+template void im2col_batch_cpu<double>(const uint8_t* data_im,
+    const double scale, const double shift, const int num, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, double* data_col);
+
+template <typename Dtype>
+void col2im_batch_cpu(const Dtype* data_col, const int num, const int channels,
+    const int height, const int width, const int patch_h, const int patch_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    Dtype* data_im) {
+  caffe_set(num * channels * height * width, Dtype(0), data_im);
+  Col2imBatchTask<Dtype> task = { make_im2col_args(data_col, num, channels,
+      height, width, patch_h, patch_w, pad_h, pad_w, stride_h, stride_w,
+      data_im) };
+  caffe_parallel_for(channels, caffe_parallel_grain(
+      num * patch_h * patch_w * task.a.height_col * task.a.width_col), task);
+}
+
+// Explicit instantiation
+template void col2im_batch_cpu<float>(const float* data_col, const int num,
+    const int channels, const int height, const int width, const int patch_h,
+    const int patch_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, float* data_im);
+template void col2im_batch_cpu<double>(const double* data_col, const int num,
+    const int channels, const int height, const int width, const int patch_h,
+    const int patch_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, double* data_im);
+
 template <typename Dtype>
 void col2im_nd_cpu(const Dtype* data_col, const int num_spatial_axes,
     const int* im_shape, const int* col_shape,
@@ -1,3 +1,4 @@
+#include <boost/bind.hpp>
 #include <fcntl.h>
 #include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
@@ -9,8 +10,10 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #endif  // USE_OPENCV
 #include <stdint.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <cstdio>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
@@ -69,6 +72,39 @@ void WriteProtoToBinaryFile(const Message& proto, const char* filename) {
   CHECK(proto.SerializeToOstream(&output));
 }
 
+void SyncDirectory(const string& directory) {
+  int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+  CHECK_NE(fd, -1) << "Cannot open " << directory;
+  CHECK_EQ(fsync(fd), 0) << "Cannot sync " << directory;
+  CHECK_EQ(close(fd), 0) << "Cannot close " << directory;
+}
+
+// Makes a rename in the directory holding filename durable
+static void SyncParentDirectory(const string& filename) {
+  const size_t slash = filename.rfind('/');
+  SyncDirectory(slash == string::npos ? "." :
+      slash == 0 ? "/" : filename.substr(0, slash));
+}
+
+void WriteFileDurably(const string& filename,
+    const boost::function<bool(int)>& writer) {
+  const string temp_filename = filename + ".tmp";
+  int fd = open(temp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  CHECK_NE(fd, -1) << "Cannot open " << temp_filename;
+  CHECK(writer(fd)) << "Cannot write " << temp_filename;
+  CHECK_EQ(fsync(fd), 0) << "Cannot sync " << temp_filename;
+  CHECK_EQ(close(fd), 0) << "Cannot close " << temp_filename;
+  CHECK_EQ(rename(temp_filename.c_str(), filename.c_str()), 0)
+      << "Cannot rename " << temp_filename << " to " << filename;
+  SyncParentDirectory(filename);
+}
+
+void WriteProtoToBinaryFileDurably(const Message& proto,
+    const string& filename) {
+  WriteFileDurably(filename,
+      boost::bind(&Message::SerializeToFileDescriptor, &proto, _1));
+}
+
 #ifdef USE_OPENCV
 cv::Mat ReadImageToCVMat(const string& filename,
     const int height, const int width, const bool is_color) {
@@ -6,6 +6,7 @@
 #include "caffe/common.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -45,42 +46,183 @@ void caffe_cpu_gemv<double>(const CBLAS_TRANSPOSE TransA, const int M,
   cblas_dgemv(CblasRowMajor, TransA, M, N, alpha, A, N, x, 1, beta, y, 1);
 }
 
+namespace {
+
+// The element-wise functions below split their arrays over the thread pool.
+// The tasks call BLAS and the vs/vd functions directly, since they may run
+// on threads without a Caffe context.
+
+inline void blas_axpy(const int n, const float alpha, const float* x,
+    float* y) { cblas_saxpy(n, alpha, x, 1, y, 1); }
+inline void blas_axpy(const int n, const double alpha, const double* x,
+    double* y) { cblas_daxpy(n, alpha, x, 1, y, 1); }
+inline void blas_axpby(const int n, const float alpha, const float* x,
+    const float beta, float* y) { cblas_saxpby(n, alpha, x, 1, beta, y, 1); }
+inline void blas_axpby(const int n, const double alpha, const double* x,
+    const double beta, double* y) { cblas_daxpby(n, alpha, x, 1, beta, y, 1); }
+inline void blas_scal(const int n, const float alpha, float* x) {
+  cblas_sscal(n, alpha, x, 1);
+}
+inline void blas_scal(const int n, const double alpha, double* x) {
+  cblas_dscal(n, alpha, x, 1);
+}
+
+template <typename Dtype>
+struct SetTask {
+  Dtype alpha;
+  Dtype* y;
+  void operator()(const int begin, const int end) const {
+    if (alpha == 0) {
+      // NOLINT_NEXT_LINE(caffe/alt_fn)
+      memset(y + begin, 0, sizeof(Dtype) * (end - begin));
+      return;
+    }
+    for (int i = begin; i < end; ++i) {
+      y[i] = alpha;
+    }
+  }
+};
+
+template <typename Dtype>
+struct AddScalarTask {
+  Dtype alpha;
+  Dtype* y;
+  void operator()(const int begin, const int end) const {
+    for (int i = begin; i < end; ++i) {
+      y[i] += alpha;
+    }
+  }
+};
+
+template <typename Dtype>
+struct CopyTask {
+  const Dtype* x;
+  Dtype* y;
+  void operator()(const int begin, const int end) const {
+    // NOLINT_NEXT_LINE(caffe/alt_fn)
+    memcpy(y + begin, x + begin, sizeof(Dtype) * (end - begin));
+  }
+};
+
+template <typename Dtype>
+struct AxpyTask {
+  Dtype alpha;
+  const Dtype* x;
+  Dtype* y;
+  void operator()(const int begin, const int end) const {
+    blas_axpy(end - begin, alpha, x + begin, y + begin);
+  }
+};
+
+template <typename Dtype>
+struct AxpbyTask {
+  Dtype alpha;
+  const Dtype* x;
+  Dtype beta;
+  Dtype* y;
+  void operator()(const int begin, const int end) const {
+    blas_axpby(end - begin, alpha, x + begin, beta, y + begin);
+  }
+};
+
+template <typename Dtype>
+struct ScalTask {
+  Dtype alpha;
+  Dtype* x;
+  void operator()(const int begin, const int end) const {
+    blas_scal(end - begin, alpha, x + begin);
+  }
+};
+
+// y = f(a) for a vs/vd function f
+template <typename Dtype>
+struct UnaryTask {
+  void (*function)(const int, const Dtype*, Dtype*);
+  const Dtype* a;
+  Dtype* y;
+  void operator()(const int begin, const int end) const {
+    function(end - begin, a + begin, y + begin);
+  }
+};
+
+// y = f(a, b) for a vs/vd function f
+template <typename Dtype>
+struct BinaryTask {
+  void (*function)(const int, const Dtype*, const Dtype*, Dtype*);
+  const Dtype* a;
+  const Dtype* b;
+  Dtype* y;
+  void operator()(const int begin, const int end) const {
+    function(end - begin, a + begin, b + begin, y + begin);
+  }
+};
+
+template <typename Dtype>
+struct PowxTask {
+  const Dtype* a;
+  Dtype b;
+  Dtype* y;
+  void operator()(const int begin, const int end) const;
+};
+
 template <>
-void caffe_axpy<float>(const int N, const float alpha, const float* X,
-    float* Y) { cblas_saxpy(N, alpha, X, 1, Y, 1); }
+void PowxTask<float>::operator()(const int begin, const int end) const {
+  vsPowx(end - begin, a + begin, b, y + begin);
+}
 
 template <>
-void caffe_axpy<double>(const int N, const double alpha, const double* X,
-    double* Y) { cblas_daxpy(N, alpha, X, 1, Y, 1); }
+void PowxTask<double>::operator()(const int begin, const int end) const {
+  vdPowx(end - begin, a + begin, b, y + begin);
+}
+
+template <typename Dtype>
+void unary_parallel(void (*function)(const int, const Dtype*, Dtype*),
+    const int n, const Dtype* a, Dtype* y) {
+  UnaryTask<Dtype> task = { function, a, y };
+  caffe_parallel_for(n, kParallelGrain, task);
+}
+
+template <typename Dtype>
+void binary_parallel(
+    void (*function)(const int, const Dtype*, const Dtype*, Dtype*),
+    const int n, const Dtype* a, const Dtype* b, Dtype* y) {
+  BinaryTask<Dtype> task = { function, a, b, y };
+  caffe_parallel_for(n, kParallelGrain, task);
+}
+
+}  // namespace
+
+template <typename Dtype>
+void caffe_axpy(const int N, const Dtype alpha, const Dtype* X, Dtype* Y) {
+  AxpyTask<Dtype> task = { alpha, X, Y };
+  caffe_parallel_for(N, kParallelGrain, task);
+}
+
+template void caffe_axpy<float>(const int N, const float alpha,
+    const float* X, float* Y);
+template void caffe_axpy<double>(const int N, const double alpha,
+    const double* X, double* Y);
 
 template <typename Dtype>
 void caffe_set(const int N, const Dtype alpha, Dtype* Y) {
-  if (alpha == 0) {
-    memset(Y, 0, sizeof(Dtype) * N);  // NOLINT(caffe/alt_fn)
-    return;
-  }
-  for (int i = 0; i < N; ++i) {
-    Y[i] = alpha;
-  }
+  SetTask<Dtype> task = { alpha, Y };
+  caffe_parallel_for(N, kParallelGrain, task);
 }
 
 template void caffe_set<int>(const int N, const int alpha, int* Y);
 template void caffe_set<float>(const int N, const float alpha, float* Y);
 template void caffe_set<double>(const int N, const double alpha, double* Y);
 
-template <>
-void caffe_add_scalar(const int N, const float alpha, float* Y) {
-  for (int i = 0; i < N; ++i) {
-    Y[i] += alpha;
-  }
+template <typename Dtype>
+void caffe_add_scalar(const int N, const Dtype alpha, Dtype* Y) {
+  AddScalarTask<Dtype> task = { alpha, Y };
+  caffe_parallel_for(N, kParallelGrain, task);
 }
 
-template <>
-void caffe_add_scalar(const int N, const double alpha, double* Y) {
-  for (int i = 0; i < N; ++i) {
-    Y[i] += alpha;
-  }
-}
+template void caffe_add_scalar<float>(const int N, const float alpha,
+    float* Y);
+template void caffe_add_scalar<double>(const int N, const double alpha,
+    double* Y);
 
 template <typename Dtype>
 void caffe_copy(const int N, const Dtype* X, Dtype* Y) {
@@ -93,7 +235,8 @@ void caffe_copy(const int N, const Dtype* X, Dtype* Y) {
       NO_GPU;
 #endif
     } else {
-      memcpy(Y, X, sizeof(Dtype) * N);  // NOLINT(caffe/alt_fn)
+      CopyTask<Dtype> task = { X, Y };
+      caffe_parallel_for(N, kParallelGrain, task);
     }
   }
 }
@@ -104,126 +247,124 @@ template void caffe_copy<unsigned int>(const int N, const unsigned int* X,
 template void caffe_copy<float>(const int N, const float* X, float* Y);
 template void caffe_copy<double>(const int N, const double* X, double* Y);
 
-template <>
-void caffe_scal<float>(const int N, const float alpha, float *X) {
-  cblas_sscal(N, alpha, X, 1);
+template <typename Dtype>
+void caffe_scal(const int N, const Dtype alpha, Dtype *X) {
+  ScalTask<Dtype> task = { alpha, X };
+  caffe_parallel_for(N, kParallelGrain, task);
 }
 
-template <>
-void caffe_scal<double>(const int N, const double alpha, double *X) {
-  cblas_dscal(N, alpha, X, 1);
-}
+template void caffe_scal<float>(const int N, const float alpha, float *X);
+template void caffe_scal<double>(const int N, const double alpha, double *X);
 
-template <>
-void caffe_cpu_axpby<float>(const int N, const float alpha, const float* X,
-                            const float beta, float* Y) {
-  cblas_saxpby(N, alpha, X, 1, beta, Y, 1);
+template <typename Dtype>
+void caffe_cpu_axpby(const int N, const Dtype alpha, const Dtype* X,
+    const Dtype beta, Dtype* Y) {
+  AxpbyTask<Dtype> task = { alpha, X, beta, Y };
+  caffe_parallel_for(N, kParallelGrain, task);
 }
 
-template <>
-void caffe_cpu_axpby<double>(const int N, const double alpha, const double* X,
-                             const double beta, double* Y) {
-  cblas_daxpby(N, alpha, X, 1, beta, Y, 1);
-}
+template void caffe_cpu_axpby<float>(const int N, const float alpha,
+    const float* X, const float beta, float* Y);
+template void caffe_cpu_axpby<double>(const int N, const double alpha,
+    const double* X, const double beta, double* Y);
 
 template <>
 void caffe_add<float>(const int n, const float* a, const float* b,
     float* y) {
-  vsAdd(n, a, b, y);
+  binary_parallel(vsAdd, n, a, b, y);
 }
 
 template <>
 void caffe_add<double>(const int n, const double* a, const double* b,
     double* y) {
-  vdAdd(n, a, b, y);
+  binary_parallel(vdAdd, n, a, b, y);
 }
 
 template <>
 void caffe_sub<float>(const int n, const float* a, const float* b,
     float* y) {
-  vsSub(n, a, b, y);
+  binary_parallel(vsSub, n, a, b, y);
 }
 
 template <>
 void caffe_sub<double>(const int n, const double* a, const double* b,
     double* y) {
-  vdSub(n, a, b, y);
+  binary_parallel(vdSub, n, a, b, y);
 }
 
 template <>
 void caffe_mul<float>(const int n, const float* a, const float* b,
     float* y) {
-  vsMul(n, a, b, y);
+  binary_parallel(vsMul, n, a, b, y);
 }
 
 template <>
 void caffe_mul<double>(const int n, const double* a, const double* b,
     double* y) {
-  vdMul(n, a, b, y);
+  binary_parallel(vdMul, n, a, b, y);
 }
 
 template <>
 void caffe_div<float>(const int n, const float* a, const float* b,
     float* y) {
-  vsDiv(n, a, b, y);
+  binary_parallel(vsDiv, n, a, b, y);
 }
 
 template <>
 void caffe_div<double>(const int n, const double* a, const double* b,
     double* y) {
-  vdDiv(n, a, b, y);
+  binary_parallel(vdDiv, n, a, b, y);
 }
 
-template <>
-void caffe_powx<float>(const int n, const float* a, const float b,
-    float* y) {
-  vsPowx(n, a, b, y);
+template <typename Dtype>
+void caffe_powx(const int n, const Dtype* a, const Dtype b, Dtype* y) {
+  PowxTask<Dtype> task = { a, b, y };
+  caffe_parallel_for(n, kParallelGrain, task);
 }
 
-template <>
-void caffe_powx<double>(const int n, const double* a, const double b,
-    double* y) {
-  vdPowx(n, a, b, y);
-}
+template void caffe_powx<float>(const int n, const float* a, const float b,
+    float* y);
+template void caffe_powx<double>(const int n, const double* a,
+    const double b, double* y);
 
 template <>
 void caffe_sqr<float>(const int n, const float* a, float* y) {
-  vsSqr(n, a, y);
+  unary_parallel(vsSqr, n, a, y);
 }
 
 template <>
 void caffe_sqr<double>(const int n, const double* a, double* y) {
-  vdSqr(n, a, y);
+  unary_parallel(vdSqr, n, a, y);
 }
 
 template <>
 void caffe_exp<float>(const int n, const float* a, float* y) {
-  vsExp(n, a, y);
+  unary_parallel(vsExp, n, a, y);
 }
 
 template <>
 void caffe_exp<double>(const int n, const double* a, double* y) {
-  vdExp(n, a, y);
+  unary_parallel(vdExp, n, a, y);
 }
 
 template <>
 void caffe_log<float>(const int n, const float* a, float* y) {
-  vsLn(n, a, y);
+  unary_parallel(vsLn, n, a, y);
 }
 
 template <>
 void caffe_log<double>(const int n, const double* a, double* y) {
-  vdLn(n, a, y);
+  unary_parallel(vdLn, n, a, y);
 }
 
 template <>
 void caffe_abs<float>(const int n, const float* a, float* y) {
-    vsAbs(n, a, y);
+  unary_parallel(vsAbs, n, a, y);
 }
 
 template <>
 void caffe_abs<double>(const int n, const double* a, double* y) {
-    vdAbs(n, a, y);
+  unary_parallel(vdAbs, n, a, y);
 }
 
 unsigned int caffe_rng_rand() {
@@ -394,4 +535,237 @@ void caffe_cpu_scale<double>(const int n, const double alpha, const double *x,
   cblas_dscal(n, alpha, y, 1);
 }
 
+namespace {
+
+// Rows [begin, end) of the num * channels rows of inner values
+template <typename Dtype>
+struct BiasReLUTask {
+  int channels;
+  int inner;
+  const Dtype* bias;
+  Dtype negative_slope;
+  Dtype* data;
+  void operator()(const int begin, const int end) const {
+    for (int r = begin; r < end; ++r) {
+      const Dtype b = bias ? bias[r % channels] : Dtype(0);
+      Dtype* row = data + r * inner;
+      for (int i = 0; i < inner; ++i) {
+        const Dtype v = row[i] + b;
+        row[i] = v > 0 ? v : negative_slope * v;
+      }
+    }
+  }
+};
+
+// Channels [begin, end) of every item, so that each task sums the bias
+// gradient of its own channels
+template <typename Dtype>
+struct BiasReLUBackwardTask {
+  int num;
+  int channels;
+  int inner;
+  const Dtype* data;
+  Dtype negative_slope;
+  Dtype* diff;
+  Dtype* bias_diff;
+  void operator()(const int begin, const int end) const {
+    for (int c = begin; c < end; ++c) {
+      Dtype sum = 0;
+      for (int n = 0; n < num; ++n) {
+        const Dtype* y = data + (n * channels + c) * inner;
+        Dtype* dy = diff + (n * channels + c) * inner;
+        for (int i = 0; i < inner; ++i) {
+          dy[i] *= (y[i] > 0) + negative_slope * (y[i] <= 0);
+          sum += dy[i];
+        }
+      }
+      if (bias_diff) {
+        bias_diff[c] += sum;
+      }
+    }
+  }
+};
+
+}  // namespace
+
+template <typename Dtype>
+void caffe_cpu_bias_relu(const int num, const int channels, const int inner,
+    const Dtype* bias, const Dtype negative_slope, Dtype* data) {
+  BiasReLUTask<Dtype> task = { channels, inner, bias, negative_slope, data };
+  caffe_parallel_for(num * channels, caffe_parallel_grain(inner), task);
+}
+
+template void caffe_cpu_bias_relu<float>(const int num, const int channels,
+    const int inner, const float* bias, const float negative_slope,
+    float* data);
+template void caffe_cpu_bias_relu<double>(const int num, const int channels,
+    const int inner, const double* bias, const double negative_slope,
+    double* data);
+
+template <typename Dtype>
+void caffe_cpu_bias_relu_backward(const int num, const int channels,
+    const int inner, const Dtype* data, const Dtype negative_slope,
+    Dtype* diff, Dtype* bias_diff) {
+  BiasReLUBackwardTask<Dtype> task = { num, channels, inner, data,
+      negative_slope, diff, bias_diff };
+  caffe_parallel_for(channels, caffe_parallel_grain(num * inner), task);
+}
+
+template void caffe_cpu_bias_relu_backward<float>(const int num,
+    const int channels, const int inner, const float* data,
+    const float negative_slope, float* diff, float* bias_diff);
+template void caffe_cpu_bias_relu_backward<double>(const int num,
+    const int channels, const int inner, const double* data,
+    const double negative_slope, double* diff, double* bias_diff);
+
+namespace {
+
+// The regularized, scaled gradient the solver updates start from
+template <typename Dtype>
+inline Dtype SolverGradient(const Dtype diff, const Dtype data,
+    const Dtype diff_scale, const Dtype l2_decay, const Dtype l1_decay) {
+  return diff_scale * diff + l2_decay * data +
+      l1_decay * caffe_sign(data);
+}
+
+template <typename Dtype>
+struct RMSPropUpdateTask {
+  Dtype diff_scale;
+  Dtype l2_decay;
+  Dtype l1_decay;
+  Dtype rms_decay;
+  Dtype delta;
+  Dtype rate;
+  Dtype* data;
+  Dtype* diff;
+  Dtype* history;
+  void operator()(const int begin, const int end) const {
+    for (int i = begin; i < end; ++i) {
+      const Dtype g = SolverGradient(diff[i], data[i], diff_scale, l2_decay,
+          l1_decay);
+      const Dtype h = rms_decay * history[i] + (1 - rms_decay) * g * g;
+      const Dtype update = rate * g / (std::sqrt(h) + delta);
+      history[i] = h;
+      diff[i] = update;
+      data[i] -= update;
+    }
+  }
+};
+
+template <typename Dtype>
+struct AdaDeltaUpdateTask {
+  Dtype diff_scale;
+  Dtype l2_decay;
+  Dtype l1_decay;
+  Dtype momentum;
+  Dtype delta;
+  Dtype rate;
+  Dtype* data;
+  Dtype* diff;
+  Dtype* grad_history;
+  Dtype* update_history;
+  void operator()(const int begin, const int end) const {
+    for (int i = begin; i < end; ++i) {
+      const Dtype g = SolverGradient(diff[i], data[i], diff_scale, l2_decay,
+          l1_decay);
+      const Dtype gh = momentum * grad_history[i] + (1 - momentum) * g * g;
+      const Dtype u = g * std::sqrt((update_history[i] + delta) /
+          (gh + delta));
+      grad_history[i] = gh;
+      update_history[i] = momentum * update_history[i] +
+          (1 - momentum) * u * u;
+      diff[i] = rate * u;
+      data[i] -= rate * u;
+    }
+  }
+};
+
+template <typename Dtype>
+struct AdamUpdateTask {
+  Dtype diff_scale;
+  Dtype l2_decay;
+  Dtype l1_decay;
+  Dtype beta1;
+  Dtype beta2;
+  Dtype eps_hat;
+  Dtype rate;
+  Dtype* data;
+  Dtype* diff;
+  Dtype* m;
+  Dtype* v;
+  void operator()(const int begin, const int end) const {
+    for (int i = begin; i < end; ++i) {
+      const Dtype g = SolverGradient(diff[i], data[i], diff_scale, l2_decay,
+          l1_decay);
+      const Dtype mi = beta1 * m[i] + (1 - beta1) * g;
+      const Dtype vi = beta2 * v[i] + (1 - beta2) * g * g;
+      const Dtype update = rate * mi / (std::sqrt(vi) + eps_hat);
+      m[i] = mi;
+      v[i] = vi;
+      diff[i] = update;
+      data[i] -= update;
+    }
+  }
+};
+
+}  // namespace
+
+template <typename Dtype>
+void caffe_cpu_rmsprop_update(const int n, const Dtype diff_scale,
+    const Dtype l2_decay, const Dtype l1_decay, const Dtype rms_decay,
+    const Dtype delta, const Dtype rate, Dtype* data, Dtype* diff,
+    Dtype* history) {
+  RMSPropUpdateTask<Dtype> task = { diff_scale, l2_decay, l1_decay,
+      rms_decay, delta, rate, data, diff, history };
+  caffe_parallel_for(n, kParallelGrain, task);
+}
+
+template void caffe_cpu_rmsprop_update<float>(const int n,
+    const float diff_scale, const float l2_decay, const float l1_decay,
+    const float rms_decay, const float delta, const float rate, float* data,
+    float* diff, float* history);
+template void caffe_cpu_rmsprop_update<double>(const int n,
+    const double diff_scale, const double l2_decay, const double l1_decay,
+    const double rms_decay, const double delta, const double rate,
+    double* data, double* diff, double* history);
+
+template <typename Dtype>
+void caffe_cpu_adadelta_update(const int n, const Dtype diff_scale,
+    const Dtype l2_decay, const Dtype l1_decay, const Dtype momentum,
+    const Dtype delta, const Dtype rate, Dtype* data, Dtype* diff,
+    Dtype* grad_history, Dtype* update_history) {
+  AdaDeltaUpdateTask<Dtype> task = { diff_scale, l2_decay, l1_decay,
+      momentum, delta, rate, data, diff, grad_history, update_history };
+  caffe_parallel_for(n, kParallelGrain, task);
+}
+
+template void caffe_cpu_adadelta_update<float>(const int n,
+    const float diff_scale, const float l2_decay, const float l1_decay,
+    const float momentum, const float delta, const float rate, float* data,
+    float* diff, float* grad_history, float* update_history);
+template void caffe_cpu_adadelta_update<double>(const int n,
+    const double diff_scale, const double l2_decay, const double l1_decay,
+    const double momentum, const double delta, const double rate,
+    double* data, double* diff, double* grad_history,
+    double* update_history);
+
+template <typename Dtype>
+void caffe_cpu_adam_update(const int n, const Dtype diff_scale,
+    const Dtype l2_decay, const Dtype l1_decay, const Dtype beta1,
+    const Dtype beta2, const Dtype eps_hat, const Dtype rate, Dtype* data,
+    Dtype* diff, Dtype* m, Dtype* v) {
+  AdamUpdateTask<Dtype> task = { diff_scale, l2_decay, l1_decay, beta1,
+      beta2, eps_hat, rate, data, diff, m, v };
+  caffe_parallel_for(n, kParallelGrain, task);
+}
+
+template void caffe_cpu_adam_update<float>(const int n,
+    const float diff_scale, const float l2_decay, const float l1_decay,
+    const float beta1, const float beta2, const float eps_hat,
+    const float rate, float* data, float* diff, float* m, float* v);
+template void caffe_cpu_adam_update<double>(const int n,
+    const double diff_scale, const double l2_decay, const double l1_decay,
+    const double beta1, const double beta2, const double eps_hat,
+    const double rate, double* data, double* diff, double* m, double* v);
+
 }  // namespace caffe
@@ -142,6 +142,54 @@ void caffe_gpu_scale<double>(const int n, const double alpha, const double *x,
   CUBLAS_CHECK(cublasDscal(Caffe::cublas_handle(), n, &alpha, y, 1));
 }
 
+template <typename Dtype>
+__global__ void bias_relu_kernel(const int n, const int channels,
+    const int inner, const Dtype* bias, const Dtype negative_slope,
+    Dtype* data) {
+  CUDA_KERNEL_LOOP(index, n) {
+    const Dtype v = data[index] +
+        (bias ? bias[(index / inner) % channels] : Dtype(0));
+    data[index] = v > 0 ? v : negative_slope * v;
+  }
+}
+
+template <typename Dtype>
+void caffe_gpu_bias_relu(const int num, const int channels, const int inner,
+    const Dtype* bias, const Dtype negative_slope, Dtype* data) {
+  const int n = num * channels * inner;
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  bias_relu_kernel<Dtype><<<CAFFE_GET_BLOCKS(n), CAFFE_CUDA_NUM_THREADS>>>(
+      n, channels, inner, bias, negative_slope, data);
+}
+
+template void caffe_gpu_bias_relu<float>(const int num, const int channels,
+    const int inner, const float* bias, const float negative_slope,
+    float* data);
+template void caffe_gpu_bias_relu<double>(const int num, const int channels,
+    const int inner, const double* bias, const double negative_slope,
+    double* data);
+
+template <typename Dtype>
+__global__ void relu_backward_kernel(const int n, const Dtype* data,
+    const Dtype negative_slope, Dtype* diff) {
+  CUDA_KERNEL_LOOP(index, n) {
+    diff[index] *= (data[index] > 0) + negative_slope * (data[index] <= 0);
+  }
+}
+
+template <typename Dtype>
+void caffe_gpu_relu_backward(const int n, const Dtype* data,
+    const Dtype negative_slope, Dtype* diff) {
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  relu_backward_kernel<Dtype><<<CAFFE_GET_BLOCKS(n), CAFFE_CUDA_NUM_THREADS>>>(
+      n, data, negative_slope, diff);
+}
+
+template void caffe_gpu_relu_backward<float>(const int n, const float* data,
+    const float negative_slope, float* diff);
+template void caffe_gpu_relu_backward<double>(const int n, const double* data,
+    const double negative_slope, double* diff);
+
 template <typename Dtype>
 __global__ void set_kernel(const int n, const Dtype alpha, Dtype* y) {
   CUDA_KERNEL_LOOP(index, n) {
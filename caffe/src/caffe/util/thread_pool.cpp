@@ -0,0 +1,113 @@
+#include <boost/thread.hpp>
+
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+class ThreadPool::State {
+ public:
+  State() : generation(0), pending(0), stop(false), n(0), tasks(0),
+      body(NULL) {}
+
+  // Held by the thread running a loop
+  boost::mutex loop_mutex;
+
+  boost::mutex mutex;
+  boost::condition_variable start;
+  boost::condition_variable done;
+  // Incremented for every loop, which the threads wait for
+  int generation;
+  // Tasks of the current loop the threads have not finished yet
+  int pending;
+  bool stop;
+  int n;
+  int tasks;
+  const boost::function<void(int, int)>* body;
+};
+
+// First item of a task when n items are split into tasks.
+static int TaskBegin(const int n, const int tasks, const int task) {
+  return static_cast<int64_t>(n) * task / tasks;
+}
+
+ThreadPool::ThreadPool(const int num_threads)
+    : num_threads_(num_threads), state_(new State()) {
+  CHECK_GE(num_threads, 1);
+  for (int i = 1; i < num_threads; ++i) {
+    try {
+      threads_.push_back(shared_ptr<boost::thread>(
+          new boost::thread(&ThreadPool::WorkerEntry, this, i)));
+    } catch (std::exception& e) {
+      LOG(FATAL) << "Thread exception: " << e.what();
+    }
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    boost::lock_guard<boost::mutex> lock(state_->mutex);
+    state_->stop = true;
+  }
+  state_->start.notify_all();
+  for (int i = 0; i < threads_.size(); ++i) {
+    threads_[i]->join();
+  }
+}
+
+void ThreadPool::For(const int n, const int grain,
+    const boost::function<void(int, int)>& body) {
+  State& state = *state_;
+  const int tasks = std::min(num_threads_, n / std::max(1, grain));
+  boost::unique_lock<boost::mutex> loop_lock(state.loop_mutex,
+      boost::try_to_lock);
+  if (tasks <= 1 || !loop_lock.owns_lock()) {
+    if (n > 0) {
+      body(0, n);
+    }
+    return;
+  }
+  {
+    boost::lock_guard<boost::mutex> lock(state.mutex);
+    state.n = n;
+    state.tasks = tasks;
+    state.body = &body;
+    state.pending = tasks - 1;
+    ++state.generation;
+  }
+  state.start.notify_all();
+  // The calling thread runs the first task.
+  body(0, TaskBegin(n, tasks, 1));
+  boost::unique_lock<boost::mutex> lock(state.mutex);
+  while (state.pending > 0) {
+    state.done.wait(lock);
+  }
+}
+
+void ThreadPool::WorkerEntry(const int index) {
+  State& state = *state_;
+  int generation = 0;
+  boost::unique_lock<boost::mutex> lock(state.mutex);
+  while (true) {
+    while (!state.stop && state.generation == generation) {
+      state.start.wait(lock);
+    }
+    if (state.stop) {
+      return;
+    }
+    generation = state.generation;
+    if (index >= state.tasks) {
+      continue;
+    }
+    const int n = state.n;
+    const int tasks = state.tasks;
+    const boost::function<void(int, int)>& body = *state.body;
+    lock.unlock();
+    body(TaskBegin(n, tasks, index), TaskBegin(n, tasks, index + 1));
+    lock.lock();
+    if (--state.pending == 0) {
+      state.done.notify_one();
+    }
+  }
+}
+
+}  // namespace caffe
@@ -5,13 +5,18 @@ namespace bp = boost::python;
 
 #include <glog/logging.h>
 
+#include <algorithm>
 #include <cstring>
+#include <fstream>
+#include <iomanip>
 #include <map>
 #include <string>
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/net_profiler.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "caffe/util/signal_handler.h"
 
 using caffe::Blob;
@@ -46,6 +51,15 @@ DEFINE_string(sigint_effect, "stop",
 DEFINE_string(sighup_effect, "snapshot",
              "Optional; action to take when a SIGHUP signal is received: "
              "snapshot, stop or none.");
+DEFINE_bool(dqn, false,
+    "Optional; with time, time DQN training iterations on the net of the "
+    "-solver: a target net forward pass, the training forward/backward pass "
+    "and the solver update.");
+DEFINE_string(json, "",
+    "Optional; with time, the file to write the timings to as JSON.");
+DEFINE_int32(cpu_threads, 1,
+    "Optional; the number of threads running the CPU layers, including the "
+    "main one.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -286,9 +300,296 @@ int test() {
 RegisterBrewFunction(test);
 
 
+// Backs each MemoryData and ByteMemoryData layer of a net with one batch of
+// uniform random values in [0, 1), or random bytes, so that nets fed from
+// memory can be timed. The buffers must outlive the net's forward passes.
+void FeedSyntheticData(Net<float>* net,
+    vector<shared_ptr<vector<float> > >* buffers,
+    vector<shared_ptr<vector<uint8_t> > >* byte_buffers) {
+  const vector<shared_ptr<Layer<float> > >& layers = net->layers();
+  for (int i = 0; i < layers.size(); ++i) {
+    caffe::MemoryDataLayer<float>* memory_layer =
+        dynamic_cast<caffe::MemoryDataLayer<float>*>(layers[i].get());
+    if (memory_layer) {
+      const int batch_size = memory_layer->batch_size();
+      shared_ptr<vector<float> > data(new vector<float>(batch_size *
+          memory_layer->channels() * memory_layer->height() *
+          memory_layer->width()));
+      shared_ptr<vector<float> > labels(new vector<float>(batch_size));
+      caffe::caffe_rng_uniform<float>(data->size(), 0, 1, &(*data)[0]);
+      caffe::caffe_rng_uniform<float>(labels->size(), 0, 1, &(*labels)[0]);
+      memory_layer->Reset(&(*data)[0], &(*labels)[0], batch_size);
+      buffers->push_back(data);
+      buffers->push_back(labels);
+      LOG(INFO) << "Feeding synthetic data to " << net->layer_names()[i];
+    }
+    caffe::ByteMemoryDataLayer<float>* byte_layer =
+        dynamic_cast<caffe::ByteMemoryDataLayer<float>*>(layers[i].get());
+    if (byte_layer) {
+      const int batch_size = byte_layer->batch_size();
+      shared_ptr<vector<uint8_t> > data(new vector<uint8_t>(batch_size *
+          byte_layer->channels() * byte_layer->height() *
+          byte_layer->width()));
+      for (int j = 0; j < data->size(); ++j) {
+        (*data)[j] = caffe::caffe_rng_rand() & 0xff;
+      }
+      byte_layer->Reset(&(*data)[0], batch_size);
+      byte_buffers->push_back(data);
+      LOG(INFO) << "Feeding synthetic data to " << net->layer_names()[i];
+    }
+  }
+}
+
+// The durations of one timed phase over all iterations
+struct PhaseTimes {
+  explicit PhaseTimes(const string& name) : name(name) {}
+  void Add(const double value) { ms.push_back(value); }
+  double Mean() const {
+    double sum = 0;
+    for (int i = 0; i < ms.size(); ++i) {
+      sum += ms[i];
+    }
+    return ms.empty() ? 0 : sum / ms.size();
+  }
+  double Max() const {
+    return ms.empty() ? 0 : *std::max_element(ms.begin(), ms.end());
+  }
+
+  string name;
+  vector<double> ms;
+};
+
+string JsonString(const string& value) {
+  ostringstream json;
+  json << '"';
+  for (int i = 0; i < value.size(); ++i) {
+    if (value[i] == '"' || value[i] == '\\') {
+      json << '\\';
+    }
+    json << value[i];
+  }
+  json << '"';
+  return json.str();
+}
+
+// Writes the phases and the layers of the profiled nets as JSON
+void WriteTimesJson(const string& path, const string& mode,
+    const vector<PhaseTimes>& phases,
+    const vector<std::pair<string, caffe::NetProfiler<float>*> >& nets) {
+  std::ofstream json(path.c_str());
+  CHECK(json) << "Cannot open " << path;
+  json << std::fixed << std::setprecision(4)
+      << "{\n  \"mode\": " << JsonString(mode)
+      << ",\n  \"iterations\": " << FLAGS_iterations
+      << ",\n  \"phases\": [";
+  for (int i = 0; i < phases.size(); ++i) {
+    json << (i ? "," : "") << "\n    {\"name\": "
+        << JsonString(phases[i].name) << ", \"mean_ms\": "
+        << phases[i].Mean() << ", \"max_ms\": " << phases[i].Max() << "}";
+  }
+  json << "\n  ],\n  \"nets\": [";
+  for (int i = 0; i < nets.size(); ++i) {
+    const vector<caffe::NetProfiler<float>::LayerStats> stats =
+        nets[i].second->Stats();
+    json << (i ? "," : "") << "\n    {\"name\": "
+        << JsonString(nets[i].first) << ", \"layers\": [";
+    for (int j = 0; j < stats.size(); ++j) {
+      const caffe::NetProfiler<float>::LayerStats& layer = stats[j];
+      json << (j ? "," : "") << "\n      {\"name\": "
+          << JsonString(layer.name) << ", \"type\": "
+          << JsonString(layer.type)
+          << ", \"forward_ms\": " << layer.forward_ms
+          << ", \"forward_max_ms\": " << layer.forward_max_ms
+          << ", \"backward_ms\": " << layer.backward_ms
+          << ", \"backward_max_ms\": " << layer.backward_max_ms
+          << ", \"forward_flops\": " << layer.forward_flops
+          << ", \"forward_bytes\": " << layer.forward_bytes
+          << ", \"backward_flops\": " << layer.backward_flops
+          << ", \"backward_bytes\": " << layer.backward_bytes << "}";
+    }
+    json << "\n    ]}";
+  }
+  json << "\n  ]\n}\n";
+  LOG(INFO) << "Wrote the timings to " << path;
+}
+
+void LogPhases(const vector<PhaseTimes>& phases) {
+  for (int i = 0; i < phases.size(); ++i) {
+    LOG(INFO) << "Average " << phases[i].name << ": " << phases[i].Mean()
+        << " ms (max " << phases[i].Max() << " ms).";
+  }
+}
+
+// Times the forward and backward passes of the TRAIN net and the forward
+// pass of the TEST net of FLAGS_model.
+int time_net() {
+  vector<PhaseTimes> phases;
+  vector<shared_ptr<Net<float> > > nets;
+  // Declared after the nets, so that they are destroyed first
+  vector<shared_ptr<caffe::NetProfiler<float> > > profilers;
+  vector<std::pair<string, caffe::NetProfiler<float>*> > profiled;
+  vector<shared_ptr<vector<float> > > buffers;
+  vector<shared_ptr<vector<uint8_t> > > byte_buffers;
+  const caffe::Phase net_phases[] = { caffe::TRAIN, caffe::TEST };
+  for (int p = 0; p < 2; ++p) {
+    const bool train = net_phases[p] == caffe::TRAIN;
+    const string phase_name = train ? "TRAIN" : "TEST";
+    shared_ptr<Net<float> > net(new Net<float>(FLAGS_model, net_phases[p]));
+    if (net->layers().empty()) {
+      LOG(INFO) << "No " << phase_name << " layers to time.";
+      continue;
+    }
+    if (FLAGS_weights.size()) {
+      net->CopyTrainedLayersFrom(FLAGS_weights);
+    }
+    FeedSyntheticData(net.get(), &buffers, &byte_buffers);
+
+    // Do a clean forward and backward pass, so that memory allocation are
+    // done and future iterations will be more stable.
+    LOG(INFO) << "Performing " << phase_name << " Forward";
+    float initial_loss;
+    net->ForwardPrefilled(&initial_loss);
+    LOG(INFO) << "Initial loss: " << initial_loss;
+    if (train) {
+      LOG(INFO) << "Performing " << phase_name << " Backward";
+      net->Backward();
+    }
+
+    shared_ptr<caffe::NetProfiler<float> > profiler(
+        new caffe::NetProfiler<float>(net.get(), FLAGS_iterations));
+    PhaseTimes forward(phase_name + " forward");
+    PhaseTimes backward(phase_name + " backward");
+    LOG(INFO) << "*** " << phase_name << " benchmark begins ***";
+    LOG(INFO) << "Testing for " << FLAGS_iterations << " iterations.";
+    Timer timer;
+    for (int j = 0; j < FLAGS_iterations; ++j) {
+      timer.Start();
+      net->ForwardPrefilled();
+      forward.Add(timer.MicroSeconds() / 1000);
+      if (train) {
+        timer.Start();
+        net->Backward();
+        backward.Add(timer.MicroSeconds() / 1000);
+      }
+    }
+    LOG(INFO) << profiler->Report();
+    phases.push_back(forward);
+    if (train) {
+      phases.push_back(backward);
+    }
+    LOG(INFO) << "*** " << phase_name << " benchmark ends ***";
+    nets.push_back(net);
+    profilers.push_back(profiler);
+    profiled.push_back(std::make_pair(phase_name, profiler.get()));
+  }
+  LogPhases(phases);
+  if (FLAGS_json.size()) {
+    WriteTimesJson(FLAGS_json, "net", phases, profiled);
+  }
+  return 0;
+}
+
+// Splits a solver step into the forward/backward passes and the rest
+class StepTimer : public Solver<float>::Callback {
+ public:
+  StepTimer() : forward_backward_ms_(0) {}
+  double forward_backward_ms() const { return forward_backward_ms_; }
+
+ protected:
+  virtual void on_start() { timer_.Start(); }
+  virtual void on_gradients_ready() {
+    forward_backward_ms_ = timer_.MicroSeconds() / 1000;
+  }
+
+ private:
+  Timer timer_;
+  double forward_backward_ms_;
+};
+
+// Times the iterations of DQN training on the net of FLAGS_solver: the
+// forward pass of an inference-only target net, then the solver step, split
+// into the forward/backward passes and the update.
+int time_dqn() {
+  CHECK_GT(FLAGS_solver.size(), 0) << "Need a solver definition to time DQN "
+      "training.";
+  caffe::SolverParameter solver_param;
+  caffe::ReadProtoFromTextFileOrDie(FLAGS_solver, &solver_param);
+  // Keep testing, logging and snapshots out of the timed steps
+  solver_param.set_test_interval(0);
+  solver_param.set_display(0);
+  solver_param.set_snapshot(0);
+  shared_ptr<Solver<float> > solver(caffe::GetSolver<float>(solver_param));
+  if (FLAGS_weights.size()) {
+    CopyLayers(solver.get(), FLAGS_weights);
+  }
+  Net<float>* net = solver->net().get();
+
+  // The target net as fast_dqn clones it from the training net
+  caffe::NetParameter target_param;
+  net->ToProto(&target_param);
+  target_param.mutable_state()->set_phase(net->phase());
+  target_param.set_inference_only(true);
+  Net<float> target_net(target_param);
+  target_net.CopyParamsFrom(*net);
+
+  vector<shared_ptr<vector<float> > > buffers;
+  vector<shared_ptr<vector<uint8_t> > > byte_buffers;
+  FeedSyntheticData(net, &buffers, &byte_buffers);
+  FeedSyntheticData(&target_net, &buffers, &byte_buffers);
+  StepTimer step_timer;
+  solver->add_callback(&step_timer);
+
+  LOG(INFO) << "Performing a DQN iteration";
+  target_net.ForwardPrefilled();
+  solver->Step(1);
+
+  caffe::NetProfiler<float> train_profiler(net, FLAGS_iterations);
+  caffe::NetProfiler<float> target_profiler(&target_net, FLAGS_iterations);
+  PhaseTimes target_forward("target forward");
+  PhaseTimes forward_backward("train forward-backward");
+  PhaseTimes update("solver update");
+  PhaseTimes iteration("DQN iteration");
+  LOG(INFO) << "*** DQN benchmark begins ***";
+  LOG(INFO) << "Testing for " << FLAGS_iterations << " iterations.";
+  Timer timer;
+  Timer iter_timer;
+  for (int j = 0; j < FLAGS_iterations; ++j) {
+    iter_timer.Start();
+    timer.Start();
+    target_net.ForwardPrefilled();
+    target_forward.Add(timer.MicroSeconds() / 1000);
+    timer.Start();
+    solver->Step(1);
+    const double step_ms = timer.MicroSeconds() / 1000;
+    forward_backward.Add(step_timer.forward_backward_ms());
+    update.Add(step_ms - step_timer.forward_backward_ms());
+    iteration.Add(iter_timer.MicroSeconds() / 1000);
+  }
+  LOG(INFO) << train_profiler.Report();
+  LOG(INFO) << target_profiler.Report();
+  LOG(INFO) << "*** DQN benchmark ends ***";
+
+  vector<PhaseTimes> phases;
+  phases.push_back(target_forward);
+  phases.push_back(forward_backward);
+  phases.push_back(update);
+  phases.push_back(iteration);
+  LogPhases(phases);
+  if (FLAGS_json.size()) {
+    vector<std::pair<string, caffe::NetProfiler<float>*> > profiled;
+    profiled.push_back(std::make_pair(string("train"), &train_profiler));
+    profiled.push_back(std::make_pair(string("target"), &target_profiler));
+    WriteTimesJson(FLAGS_json, "dqn", phases, profiled);
+  }
+  return 0;
+}
+
 // Time: benchmark the execution time of a model.
 int time() {
-  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to time.";
+  if (!FLAGS_dqn) {
+    CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to time.";
+  }
+  CHECK_GT(FLAGS_iterations, 0);
 
   // Set device id and mode
   vector<int> gpus;
@@ -301,77 +602,7 @@ int time() {
     LOG(INFO) << "Use CPU.";
     Caffe::set_mode(Caffe::CPU);
   }
-  // Instantiate the caffe net.
-  Net<float> caffe_net(FLAGS_model, caffe::TRAIN);
-
-  // Do a clean forward and backward pass, so that memory allocation are done
-  // and future iterations will be more stable.
-  LOG(INFO) << "Performing Forward";
-  // Note that for the speed benchmark, we will assume that the network does
-  // not take any input blobs.
-  float initial_loss;
-  caffe_net.Forward(vector<Blob<float>*>(), &initial_loss);
-  LOG(INFO) << "Initial loss: " << initial_loss;
-  LOG(INFO) << "Performing Backward";
-  caffe_net.Backward();
-
-  const vector<shared_ptr<Layer<float> > >& layers = caffe_net.layers();
-  const vector<vector<Blob<float>*> >& bottom_vecs = caffe_net.bottom_vecs();
-  const vector<vector<Blob<float>*> >& top_vecs = caffe_net.top_vecs();
-  const vector<vector<bool> >& bottom_need_backward =
-      caffe_net.bottom_need_backward();
-  LOG(INFO) << "*** Benchmark begins ***";
-  LOG(INFO) << "Testing for " << FLAGS_iterations << " iterations.";
-  Timer total_timer;
-  total_timer.Start();
-  Timer forward_timer;
-  Timer backward_timer;
-  Timer timer;
-  std::vector<double> forward_time_per_layer(layers.size(), 0.0);
-  std::vector<double> backward_time_per_layer(layers.size(), 0.0);
-  double forward_time = 0.0;
-  double backward_time = 0.0;
-  for (int j = 0; j < FLAGS_iterations; ++j) {
-    Timer iter_timer;
-    iter_timer.Start();
-    forward_timer.Start();
-    for (int i = 0; i < layers.size(); ++i) {
-      timer.Start();
-      layers[i]->Forward(bottom_vecs[i], top_vecs[i]);
-      forward_time_per_layer[i] += timer.MicroSeconds();
-    }
-    forward_time += forward_timer.MicroSeconds();
-    backward_timer.Start();
-    for (int i = layers.size() - 1; i >= 0; --i) {
-      timer.Start();
-      layers[i]->Backward(top_vecs[i], bottom_need_backward[i],
-                          bottom_vecs[i]);
-      backward_time_per_layer[i] += timer.MicroSeconds();
-    }
-    backward_time += backward_timer.MicroSeconds();
-    LOG(INFO) << "Iteration: " << j + 1 << " forward-backward time: "
-      << iter_timer.MilliSeconds() << " ms.";
-  }
-  LOG(INFO) << "Average time per layer: ";
-  for (int i = 0; i < layers.size(); ++i) {
-    const caffe::string& layername = layers[i]->layer_param().name();
-    LOG(INFO) << std::setfill(' ') << std::setw(10) << layername <<
-      "\tforward: " << forward_time_per_layer[i] / 1000 /
-      FLAGS_iterations << " ms.";
-    LOG(INFO) << std::setfill(' ') << std::setw(10) << layername  <<
-      "\tbackward: " << backward_time_per_layer[i] / 1000 /
-      FLAGS_iterations << " ms.";
-  }
-  total_timer.Stop();
-  LOG(INFO) << "Average Forward pass: " << forward_time / 1000 /
-    FLAGS_iterations << " ms.";
-  LOG(INFO) << "Average Backward pass: " << backward_time / 1000 /
-    FLAGS_iterations << " ms.";
-  LOG(INFO) << "Average Forward-Backward: " << total_timer.MilliSeconds() /
-    FLAGS_iterations << " ms.";
-  LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
-  LOG(INFO) << "*** Benchmark ends ***";
-  return 0;
+  return FLAGS_dqn ? time_dqn() : time_net();
 }
 RegisterBrewFunction(time);
 
@@ -388,6 +619,7 @@ int main(int argc, char** argv) {
       "  time            benchmark model execution time");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  Caffe::set_cpu_threads(FLAGS_cpu_threads);
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {
@@ -0,0 +1,217 @@
+#include "async_trainer.h"
+#include <glog/logging.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <thread>
+#include <utility>
+
+namespace fast_dqn {
+
+namespace {
+
+// Room for a few hundred steps of every actor
+constexpr auto kQueueCapacity = 4096;
+// How long a waiting thread sleeps before checking again
+constexpr auto kWaitInterval = std::chrono::microseconds(100);
+
+}  // namespace
+
+void WeightSnapshot::Publish(const caffe::Net<float>& net) {
+  const auto& params = net.learnable_params();
+  std::lock_guard<std::mutex> lock(mutex_);
+  params_.resize(params.size());
+  for (auto i = 0; i < params.size(); ++i) {
+    params_[i].assign(params[i]->cpu_data(),
+                      params[i]->cpu_data() + params[i]->count());
+  }
+  version_.fetch_add(1, std::memory_order_release);
+}
+
+bool WeightSnapshot::Fetch(caffe::Net<float>* net, int* version) const {
+  if (version_.load(std::memory_order_acquire) == *version) {
+    return false;
+  }
+  const auto& params = net->learnable_params();
+  std::lock_guard<std::mutex> lock(mutex_);
+  CHECK_EQ(params.size(), params_.size());
+  for (auto i = 0; i < params.size(); ++i) {
+    CHECK_EQ(params[i]->count(), params_[i].size());
+    std::copy(params_[i].begin(), params_[i].end(),
+              params[i]->mutable_cpu_data());
+  }
+  *version = version_.load(std::memory_order_relaxed);
+  return true;
+}
+
+AsyncTrainer::AsyncTrainer(Fast_DQN* dqn,
+                           const std::vector<EnvironmentSp>& environments,
+                           const std::function<double(int)>& epsilon_schedule,
+                           const double replay_ratio, const int replay_slack,
+                           const int memory_threshold) :
+    dqn_(dqn),
+    epsilon_schedule_(epsilon_schedule),
+    replay_ratio_(replay_ratio),
+    replay_slack_(replay_slack),
+    memory_threshold_(memory_threshold),
+    queue_(kQueueCapacity),
+    published_clone_count_(dqn->clone_count()),
+    iteration_(dqn->current_iteration()),
+    learning_(false),
+    learning_start_(0),
+    update_count_(0),
+    transition_count_(0),
+    produced_count_(0) {
+  CHECK_GT(replay_ratio_, 0.0);
+  CHECK_GE(replay_slack_, 0);
+  for (auto i = 0; i < environments.size(); ++i) {
+    actors_.emplace_back(
+        new Actor(this, i, environments[i], dqn_->CreateActingNet()));
+  }
+}
+
+AsyncTrainer::~AsyncTrainer() {
+  // Stop the actors before the queue and snapshot go away
+  actors_.clear();
+}
+
+std::vector<EpisodeResult> AsyncTrainer::Learn() {
+  Experience experience;
+  auto drained = false;
+  while (queue_.TryPop(&experience)) {
+    drained = true;
+    if (experience.frame) {
+      dqn_->AddFrame(experience.stream, *experience.frame,
+                     experience.episode_start);
+    } else {
+      dqn_->AddTransition(experience.stream, experience.action,
+                          experience.reward, experience.terminal);
+      transition_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  if (!learning_ && dqn_->memory_size() > memory_threshold_) {
+    learning_start_.store(transition_count_.load());
+    learning_.store(true, std::memory_order_release);
+  }
+  if (learning_ && update_count_ < replay_ratio_ *
+      (transition_count_ - learning_start_) + replay_slack_) {
+    dqn_->Update();
+    update_count_.fetch_add(1, std::memory_order_release);
+    iteration_.store(dqn_->current_iteration(), std::memory_order_relaxed);
+    if (dqn_->clone_count() != published_clone_count_) {
+      snapshot_.Publish(dqn_->acting_net());
+      published_clone_count_ = dqn_->clone_count();
+    }
+  } else if (!drained) {
+    std::this_thread::sleep_for(kWaitInterval);
+  }
+
+  std::vector<EpisodeResult> results;
+  std::lock_guard<std::mutex> lock(results_mutex_);
+  results.swap(results_);
+  return results;
+}
+
+AsyncTrainer::Actor::Actor(AsyncTrainer* trainer, const int stream,
+                           const EnvironmentSp& environment,
+                           const Fast_DQN::NetSp& net) :
+    trainer_(trainer),
+    stream_(stream),
+    environment_(environment),
+    net_(net),
+    weights_version_(trainer->snapshot_.version()),
+    random_engine_(stream) {
+  CHECK(!environment_->EpisodeOver());
+  StartInternalThread();
+}
+
+AsyncTrainer::Actor::~Actor() {
+  StopInternalThread();
+}
+
+bool AsyncTrainer::Actor::Push(Experience&& experience) {
+  while (!trainer_->queue_.TryPush(std::move(experience))) {
+    if (must_stop()) {
+      return false;
+    }
+    std::this_thread::sleep_for(kWaitInterval);
+  }
+  return true;
+}
+
+bool AsyncTrainer::Actor::WaitForLearner() {
+  for (;;) {
+    if (must_stop()) {
+      return false;
+    }
+    if (!trainer_->learning_.load(std::memory_order_acquire) ||
+        trainer_->replay_ratio_ *
+            (trainer_->produced_count_ - trainer_->learning_start_) <=
+        trainer_->update_count_ + trainer_->replay_slack_) {
+      return true;
+    }
+    std::this_thread::sleep_for(kWaitInterval);
+  }
+}
+
+void AsyncTrainer::Actor::InternalThreadEntry() {
+  std::deque<FrameDataSp> past_frames;
+  // Frames queued for the learner stay out of the pool until it drops them
+  FramePool frame_pool;
+  auto score = 0.0;
+  auto frames = 0L;
+  while (!must_stop()) {
+    const auto current_frame = frame_pool.Next();
+    environment_->PreprocessScreen(current_frame.get());
+    ++frames;
+    if (!Push(Experience{stream_, current_frame, frames == 1, 0, 0.0f,
+                         false})) {
+      return;
+    }
+    past_frames.push_back(current_frame);
+    if (past_frames.size() > kInputFrameCount) {
+      past_frames.pop_front();
+    }
+    if (past_frames.size() < kInputFrameCount) {
+      // If there are not past frames enough for DQN input, just select NOOP
+      environment_->ActNoop();
+    } else {
+      trainer_->snapshot_.Fetch(net_.get(), &weights_version_);
+      State state;
+      std::copy(past_frames.begin(), past_frames.end(), state.begin());
+      const auto epsilon = trainer_->epsilon_schedule_(
+          trainer_->iteration_.load(std::memory_order_relaxed));
+      const auto action = trainer_->dqn_->SelectActions(
+          net_, InputStateBatch{{state}}, epsilon, random_engine_)[0];
+      const auto immediate_score = environment_->Act(action);
+      score += immediate_score;
+      // Rewards for DQN are normalized as follows:
+      // 1 for any positive score, -1 for any negative score, otherwise 0
+      const auto reward = immediate_score == 0 ? 0 :
+          immediate_score / std::abs(immediate_score);
+      if (!Push(Experience{stream_, nullptr, false, action,
+                           static_cast<float>(reward),
+                           environment_->EpisodeOver()})) {
+        return;
+      }
+      trainer_->produced_count_.fetch_add(1, std::memory_order_relaxed);
+      if (!WaitForLearner()) {
+        return;
+      }
+    }
+    if (environment_->EpisodeOver()) {
+      {
+        std::lock_guard<std::mutex> lock(trainer_->results_mutex_);
+        trainer_->results_.push_back(EpisodeResult{score, frames});
+      }
+      past_frames.clear();
+      score = 0.0;
+      frames = 0;
+      environment_->Reset();
+    }
+  }
+}
+
+}  // namespace fast_dqn
@@ -0,0 +1,133 @@
+#ifndef SRC_ASYNC_TRAINER_H_
+#define SRC_ASYNC_TRAINER_H_
+
+#include "environment.h"
+#include "fast_dqn.h"
+#include "mpsc_queue.h"
+#include <caffe/internal_thread.hpp>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <vector>
+
+namespace fast_dqn {
+
+/**
+ * Versioned copy of the acting weights.  The learner publishes a version
+ * whenever the acting net changes; actors copy it into their own net
+ * when it is newer than the one they hold.
+ */
+class WeightSnapshot {
+ public:
+  WeightSnapshot() : version_(0) {}
+
+  void Publish(const caffe::Net<float>& net);
+
+  /**
+   * Copy the latest version into net if it is newer than *version.
+   */
+  bool Fetch(caffe::Net<float>* net, int* version) const;
+
+  int version() const { return version_.load(std::memory_order_acquire); }
+
+ private:
+  mutable std::mutex mutex_;
+  std::atomic<int> version_;
+  std::vector<std::vector<float>> params_;
+};
+
+/**
+ * Runs acting and learning concurrently.  Each actor thread plays its own
+ * environment with a private copy of the acting net and pushes frames and
+ * transitions into a lock-free queue.  The learner, on the calling thread,
+ * drains the queue into replay memory and updates the DQN.
+ *
+ * The replay ratio is the number of updates per transition.  Once
+ * learning has started the learner stays within replay_slack updates of
+ * it: it waits for transitions when ahead and the actors wait for updates
+ * when behind.
+ */
+class AsyncTrainer {
+ public:
+  AsyncTrainer(Fast_DQN* dqn, const std::vector<EnvironmentSp>& environments,
+               const std::function<double(int)>& epsilon_schedule,
+               const double replay_ratio, const int replay_slack,
+               const int memory_threshold);
+  ~AsyncTrainer();
+
+  /**
+   * Move the queued experience into replay memory and update the DQN once
+   * if the replay ratio allows it.  Returns the episodes finished since
+   * the last call.
+   */
+  std::vector<EpisodeResult> Learn();
+
+  int64_t transition_count() const { return transition_count_.load(); }
+  int64_t update_count() const { return update_count_.load(); }
+
+ private:
+  /**
+   * A frame to add to replay memory or, without frame, a transition
+   */
+  struct Experience {
+    int stream;
+    FrameDataSp frame;
+    bool episode_start;
+    Environment::ActionCode action;
+    float reward;
+    bool terminal;
+  };
+
+  class Actor : public caffe::InternalThread {
+   public:
+    Actor(AsyncTrainer* trainer, const int stream,
+          const EnvironmentSp& environment, const Fast_DQN::NetSp& net);
+    ~Actor();
+
+   protected:
+    void InternalThreadEntry();
+
+   private:
+    // False when the thread was asked to stop
+    bool Push(Experience&& experience);
+    bool WaitForLearner();
+
+    AsyncTrainer* const trainer_;
+    const int stream_;
+    const EnvironmentSp environment_;
+    const Fast_DQN::NetSp net_;
+    int weights_version_;
+    std::mt19937 random_engine_;
+  };
+
+  Fast_DQN* const dqn_;
+  const std::function<double(int)> epsilon_schedule_;
+  const double replay_ratio_;
+  const int replay_slack_;
+  const int memory_threshold_;
+
+  MpscQueue<Experience> queue_;
+  WeightSnapshot snapshot_;
+  int published_clone_count_;
+
+  // Written by the learner, read by the actors
+  std::atomic<int> iteration_;
+  std::atomic<bool> learning_;
+  std::atomic<int64_t> learning_start_;  // Transitions when learning began
+  std::atomic<int64_t> update_count_;
+  std::atomic<int64_t> transition_count_;  // Moved into replay memory
+  // Written by the actors
+  std::atomic<int64_t> produced_count_;
+
+  std::mutex results_mutex_;
+  std::vector<EpisodeResult> results_;
+
+  std::vector<std::unique_ptr<Actor>> actors_;
+};
+
+}  // namespace fast_dqn
+
+#endif  // SRC_ASYNC_TRAINER_H_
@@ -0,0 +1,114 @@
+#include "checkpoint.h"
+#include <caffe/util/io.hpp>
+#include <glog/logging.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace fast_dqn {
+
+namespace {
+
+std::string LatestFile(const std::string& prefix) {
+  return prefix + ".latest";
+}
+
+// Checkpoint directories hold files only
+void RemoveCheckpointDirectory(const std::string& directory) {
+  const auto dir = opendir(directory.c_str());
+  if (dir == nullptr) {
+    PLOG(WARNING) << "Cannot open " << directory;
+    return;
+  }
+  while (const auto entry = readdir(dir)) {
+    const std::string name(entry->d_name);
+    if (name == "." || name == "..") {
+      continue;
+    }
+    const auto path = directory + "/" + name;
+    PLOG_IF(WARNING, unlink(path.c_str()) != 0) << "Cannot remove " << path;
+  }
+  closedir(dir);
+  PLOG_IF(WARNING, rmdir(directory.c_str()) != 0)
+      << "Cannot remove " << directory;
+}
+
+}  // namespace
+
+void CheckCheckpointWritePermissions(const std::string& prefix) {
+  const auto probe_path = prefix + ".tempfile";
+  std::ofstream probe(probe_path);
+  if (!probe.good()) {
+    LOG(FATAL) << "Cannot write to checkpoint prefix '" << prefix
+               << "'.  Make sure that the directory exists and is writeable.";
+  }
+  probe.close();
+  std::remove(probe_path.c_str());
+}
+
+std::string CreateCheckpointDirectory(const std::string& prefix,
+                                      const int iteration) {
+  const auto directory = prefix + "_iter_" + std::to_string(iteration);
+  // A directory left by a crash while writing is overwritten
+  PCHECK(mkdir(directory.c_str(), 0755) == 0 || errno == EEXIST)
+      << "Cannot create " << directory;
+  return directory;
+}
+
+void CommitCheckpoint(const std::string& prefix,
+                      const std::string& directory) {
+  caffe::SyncDirectory(directory);
+  const auto previous = LatestCheckpoint(prefix);
+  WriteFileDurably(LatestFile(prefix), directory + "\n");
+  if (!previous.empty() && previous != directory) {
+    RemoveCheckpointDirectory(previous);
+  }
+}
+
+std::string LatestCheckpoint(const std::string& prefix) {
+  std::string contents;
+  if (!ReadFile(LatestFile(prefix), &contents)) {
+    return "";
+  }
+  return contents.substr(0, contents.find('\n'));
+}
+
+void WriteFileDurably(const std::string& path, const std::string& contents) {
+  caffe::WriteFileDurably(path, [&contents](int fd) {
+    return WriteAt(fd, contents.data(), contents.size(), 0);
+  });
+}
+
+bool WriteAt(const int fd, const void* data, size_t size, off_t offset) {
+  auto bytes = static_cast<const char*>(data);
+  while (size > 0) {
+    const auto written = pwrite(fd, bytes, size, offset);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    bytes += written;
+    size -= written;
+    offset += written;
+  }
+  return true;
+}
+
+bool ReadFile(const std::string& path, std::string* contents) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  std::ostringstream buffer;
+  buffer << file.rdbuf();
+  *contents = buffer.str();
+  return true;
+}
+
+}  // namespace fast_dqn
@@ -0,0 +1,59 @@
+#ifndef SRC_CHECKPOINT_H_
+#define SRC_CHECKPOINT_H_
+
+#include <sys/types.h>
+#include <cstddef>
+#include <string>
+
+namespace fast_dqn {
+
+/**
+ * Checkpoints of a training run are directories named
+ * <prefix>_iter_<iteration>.  Their files are written in place; the file
+ * <prefix>.latest names the most recent checkpoint once all of them are on
+ * disk, so a crash while writing one leaves the previous checkpoint in use.
+ */
+
+/**
+ * Fail unless checkpoints can be written under prefix, before training
+ * rather than at the first checkpoint.
+ */
+void CheckCheckpointWritePermissions(const std::string& prefix);
+
+/**
+ * Create the directory of the checkpoint at the given iteration and return
+ * its path.
+ */
+std::string CreateCheckpointDirectory(const std::string& prefix,
+                                      const int iteration);
+
+/**
+ * Sync the checkpoint directory, make it the latest checkpoint and remove
+ * the one it replaces.
+ */
+void CommitCheckpoint(const std::string& prefix, const std::string& directory);
+
+/**
+ * Directory of the latest complete checkpoint, or "" if there is none.
+ */
+std::string LatestCheckpoint(const std::string& prefix);
+
+/**
+ * Write contents to path with caffe::WriteFileDurably.
+ */
+void WriteFileDurably(const std::string& path, const std::string& contents);
+
+/**
+ * Write size bytes of data at offset in the file fd.  False on failure,
+ * with errno set.
+ */
+bool WriteAt(const int fd, const void* data, size_t size, off_t offset);
+
+/**
+ * Read the whole file at path into contents.  False if it cannot be opened.
+ */
+bool ReadFile(const std::string& path, std::string* contents);
+
+}  // namespace fast_dqn
+
+#endif  // SRC_CHECKPOINT_H_
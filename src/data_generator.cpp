@@ -52,13 +52,15 @@ double PlayOneEpisode(fast_dqn::EnvironmentSp environmentSp,
   //for(int i=0;i<actions.size();++i) act2idx[actions[i]] = i;
   
   std::deque<fast_dqn::FrameDataSp> past_frames;
+  fast_dqn::FramePool frame_pool;
   //std::vector<int> acts;
   std::vector<int> acts_idx;
   std::vector<int> rewards;
   auto total_score = 0.0;
   for (auto frame = 0; !environmentSp->EpisodeOver(); ++frame) {
     // get current frame
-    const auto current_frame = environmentSp->PreprocessScreen();
+    const auto current_frame = frame_pool.Next();
+    environmentSp->PreprocessScreen(current_frame.get());
     past_frames.push_back(current_frame);
 
     // take action
@@ -129,7 +131,7 @@ int main(int argc, char** argv) {
   for(int i=0;i<num_acts;++i) legal_actions.push_back(i);
 
   fast_dqn::Fast_DQN dqn(environmentSp, legal_actions, FLAGS_solver,
-      FLAGS_memory, FLAGS_gamma, FLAGS_verbose);
+      FLAGS_memory, 1, 0.0, FLAGS_gamma, FLAGS_verbose);
 
   dqn.Initialize();
 
@@ -1,7 +1,11 @@
 #ifndef SRC_ENVIRONMENT_H_
 #define SRC_ENVIRONMENT_H_
+#include <array>
+#include <atomic>
+#include <deque>
 #include <vector>
 #include <memory>
+#include <string>
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -33,7 +37,20 @@ class Environment {
   using FrameDataSp = std::shared_ptr<FrameData>;
   using State = std::array<FrameDataSp, kInputFrameCount>;
 
-  virtual FrameDataSp PreprocessScreen() = 0;
+  /**
+   * Write the current screen, preprocessed, into frame
+   */
+  virtual void PreprocessScreen(FrameData* frame) = 0;
+
+  /**
+   * Convenience for paths off the training loop; the drivers write into
+   * buffers of a FramePool instead of allocating a frame every step
+   */
+  FrameDataSp PreprocessScreen() {
+    auto frame = std::make_shared<FrameData>();
+    PreprocessScreen(frame.get());
+    return frame;
+  }
 
   virtual double ActNoop() = 0;
 
@@ -50,6 +67,51 @@ class Environment {
   //virtual const ActionVec& GetMinimalActionSet() = 0;
   virtual const int num_acts() = 0; // return number of actions
 
+  /**
+   * Serialize the whole emulator state, pseudorandomness included, so that
+   * RestoreState continues exactly from this point
+   */
+  virtual std::string SaveState() = 0;
+  virtual void RestoreState(const std::string& state) = 0;
+
+};
+
+/**
+ * Score and length of a finished episode
+ */
+struct EpisodeResult {
+  double score;
+  long frames;
+};
+
+/**
+ * Recycles the frame buffers of one driver.  Next returns the oldest
+ * buffer, or a new one while the oldest is still referenced elsewhere
+ * (e.g. queued for the learner), so the pool only grows to the number of
+ * frames in flight.  A pool is used by one thread at a time.
+ */
+class FramePool {
+ public:
+  explicit FramePool(const size_t size = Environment::kInputFrameCount + 1) {
+    for (size_t i = 0; i < size; ++i) {
+      frames_.push_back(std::make_shared<Environment::FrameData>());
+    }
+  }
+
+  Environment::FrameDataSp Next() {
+    if (frames_.front().use_count() == 1) {
+      // Order the reads of other threads that released it before our writes
+      std::atomic_thread_fence(std::memory_order_acquire);
+      frames_.push_back(std::move(frames_.front()));
+      frames_.pop_front();
+    } else {
+      frames_.push_back(std::make_shared<Environment::FrameData>());
+    }
+    return frames_.back();
+  }
+
+ private:
+  std::deque<Environment::FrameDataSp> frames_;
 };
 
 // Factory method
@@ -1,16 +1,25 @@
 #include "fast_dqn.h"
+#include "checkpoint.h"
 #include "environment.h"
+#include "profiler.h"
+#include <caffe/util/rng.hpp>
 #include <glog/logging.h>
 #include <algorithm>
 #include <iostream>
 #include <cassert>
+#include <cmath>
+#include <cstring>
 #include <sstream>
+#include <type_traits>
 #include <utility>
 #include <string>
 #include <vector>
 
 namespace fast_dqn {
 
+// Version of the dqn_state file of a checkpoint
+constexpr auto kCheckpointVersion = 1;
+
 
 std::string PrintQValues(
     EnvironmentSp environmentSp,
@@ -37,24 +46,6 @@ std::string PrintQValues(
 }
 
 
-const State Transition::GetNextState() const {
-
-  //  Create the s(t+1) states from the experience(t)'s
-
-  if (next_frame_ == nullptr) {
-    // Terminal state so no next_observation, just return current state
-    return state_;
-  } else {
-    State state_clone;
-
-    for (int i = 0; i < kInputFrameCount - 1; ++i)
-      state_clone[i] = state_[i + 1];
-    state_clone[kInputFrameCount - 1] = next_frame_;
-    return state_clone;
-  }
-
-}
-
 template <typename Dtype>
 void HasBlobSize(caffe::Net<Dtype>& net,
                  const std::string& blob_name,
@@ -72,6 +63,13 @@ void Fast_DQN::LoadTrainedModel(const std::string& model_bin) {
   CloneTrainingNetToTargetNet();
 }
 
+Fast_DQN::~Fast_DQN() {
+  if (solver_) {
+    // Also writes a snapshot deferred while the writer was busy
+    solver_->WaitForSnapshot();
+  }
+}
+
 void Fast_DQN::Initialize() {
 
   // Initialize dummy input data with 0
@@ -97,14 +95,97 @@ void Fast_DQN::Initialize() {
   // Check the primary network
   HasBlobSize(*net_, train_frames_blob_name, {kMinibatchSize,
           kInputFrameCount, kCroppedFrameSize, kCroppedFrameSize});
-  HasBlobSize(*net_, target_blob_name, {kMinibatchSize,kOutputCount,1,1});
-  HasBlobSize(*net_, filter_blob_name, {kMinibatchSize,kOutputCount,1,1});
+  HasBlobSize(*net_, td_blob_name, {kMinibatchSize,kTDInputSize,1,1});
+
+  for (auto& minibatch : minibatches_) {
+    minibatch.reset(new Minibatch);
+  }
+  target_frames_input_.reset(new FramesLayerInputData);
+  prefetcher_.reset(new WorkerThread);
 
+  LOG(INFO) << "Replay memory: " << replay_memory_.capacity()
+      << " transitions, " << replay_memory_.bytes_per_transition()
+      << " bytes per transition, "
+      << replay_memory_.capacity() * replay_memory_.bytes_per_transition()
+          / (1024.0 * 1024.0) << " MB in total";
 
   LOG(INFO) << "Finished " << net_->name() << " Initialization";
 }
 
 
+void Fast_DQN::SaveCheckpoint(const std::string& directory) {
+  static_assert(std::is_trivially_copyable<Minibatch>::value,
+                "The prefetched minibatch is saved as raw bytes");
+  caffe::Timer timer;
+  timer.Start();
+  solver_->SnapshotTo(directory + "/dqn.caffemodel",
+                      directory + "/dqn.solverstate");
+  caffe::NetParameter target_net_param;
+  target_net_->ToProto(&target_net_param);
+  caffe::WriteProtoToBinaryFileDurably(target_net_param,
+                                       directory + "/target.caffemodel");
+  replay_memory_.Save(directory + "/replay_memory");
+
+  // The engines are written in their text form, which restores them exactly
+  std::ostringstream state;
+  state.precision(17);
+  state << kCheckpointVersion << "\n"
+        << last_clone_iter_ << " " << clone_count_ << " " << clone_time_ms_
+        << "\n"
+        << current_minibatch_ << " " << minibatch_prefetched_ << "\n"
+        << random_engine_ << "\n"
+        << *caffe::caffe_rng() << "\n";
+  WriteFileDurably(directory + "/dqn_state", state.str());
+  if (minibatch_prefetched_) {
+    // Sampled with random_engine_ before it reached its saved state
+    const auto& minibatch = *minibatches_[current_minibatch_];
+    WriteFileDurably(directory + "/minibatch",
+        std::string(reinterpret_cast<const char*>(&minibatch),
+                    sizeof(minibatch)));
+  }
+  LOG(INFO) << "Checkpoint of iteration " << current_iteration()
+            << " written to " << directory << " in " << timer.Seconds()
+            << " s";
+}
+
+void Fast_DQN::LoadCheckpoint(const std::string& directory) {
+  caffe::Timer timer;
+  timer.Start();
+  solver_->Restore((directory + "/dqn.solverstate").c_str());
+  target_net_->CopyTrainedLayersFrom(directory + "/target.caffemodel");
+  replay_memory_.Load(directory + "/replay_memory");
+
+  std::string contents;
+  CHECK(ReadFile(directory + "/dqn_state", &contents))
+      << "Cannot read " << directory << "/dqn_state";
+  std::istringstream state(contents);
+  auto version = 0;
+  state >> version;
+  CHECK_EQ(version, kCheckpointVersion)
+      << "Unsupported checkpoint version in " << directory;
+  state >> last_clone_iter_ >> clone_count_ >> clone_time_ms_
+        >> current_minibatch_ >> minibatch_prefetched_
+        >> random_engine_ >> *caffe::caffe_rng();
+  CHECK(state) << "Corrupt " << directory << "/dqn_state";
+  if (minibatch_prefetched_) {
+    CHECK(ReadFile(directory + "/minibatch", &contents))
+        << "Cannot read " << directory << "/minibatch";
+    CHECK_EQ(contents.size(), sizeof(Minibatch));
+    std::memcpy(minibatches_[current_minibatch_].get(), contents.data(),
+                sizeof(Minibatch));
+  }
+  LOG(INFO) << "Resumed iteration " << current_iteration() << " with "
+            << memory_size() << " transitions from " << directory << " in "
+            << timer.Seconds() << " s";
+}
+
+void Fast_DQN::ProfileLayers(const std::string& trace_path) {
+  layer_profiler_.reset(new caffe::NetProfiler<float>(net_.get()));
+  if (!trace_path.empty()) {
+    layer_profiler_->StartTrace(trace_path);
+  }
+}
+
 Environment::ActionCode Fast_DQN::SelectAction(const State& frames, 
                                                const double epsilon) {
   return SelectActions(InputStateBatch{{frames}}, epsilon)[0];
@@ -113,23 +194,39 @@ Environment::ActionCode Fast_DQN::SelectAction(const State& frames,
 Environment::ActionVec Fast_DQN::SelectActions(
                               const InputStateBatch& frames_batch,
                               const double epsilon) {
+  return SelectActions(target_net_, frames_batch, epsilon, random_engine_);
+}
+
+Environment::ActionVec Fast_DQN::SelectActions(
+                              NetSp net,
+                              const InputStateBatch& frames_batch,
+                              const double epsilon,
+                              std::mt19937& random_engine) {
   CHECK(epsilon <= 1.0 && epsilon >= 0.0);
   CHECK_LE(frames_batch.size(), kMinibatchSize);
   Environment::ActionVec actions(frames_batch.size());
-  if (std::uniform_real_distribution<>(0.0, 1.0)(random_engine_) < epsilon) {
-    // Select randomly
-    for (int i = 0; i < actions.size(); ++i) {
+  // Each state is explored independently; the greedy ones share a forward
+  InputStateBatch greedy_batch;
+  std::vector<int> greedy_indices;
+  for (int i = 0; i < actions.size(); ++i) {
+    if (std::uniform_real_distribution<>(0.0, 1.0)(random_engine) < epsilon) {
+      // Select randomly
       const auto random_idx = std::uniform_int_distribution<int>
-          (0, legal_actions_.size() - 1)(random_engine_);
+          (0, legal_actions_.size() - 1)(random_engine);
       actions[i] = legal_actions_[random_idx];
+    } else {
+      greedy_batch.push_back(frames_batch[i]);
+      greedy_indices.push_back(i);
     }
-  } else {
+  }
+  if (!greedy_batch.empty()) {
     // Select greedily
+    ScopedPhase phase(Phase::kSelectAction);
     std::vector<ActionValue> actions_and_values =
-        SelectActionGreedily(target_net_, frames_batch);
-    CHECK_EQ(actions_and_values.size(), actions.size());
+        SelectActionGreedily(net, greedy_batch);
+    CHECK_EQ(actions_and_values.size(), greedy_indices.size());
     for (int i=0; i<actions_and_values.size(); ++i) {
-      actions[i] = actions_and_values[i].action;
+      actions[greedy_indices[i]] = actions_and_values[i].action;
     }
   }
   return actions;
@@ -146,7 +243,7 @@ std::vector<ActionValue> Fast_DQN::SelectActionGreedily(
     NetSp net,
     const InputStateBatch& last_frames_batch) {
   assert(last_frames_batch.size() <= kMinibatchSize);
-  std::array<float, kMinibatchDataSize> frames_input;
+  FramesLayerInputData frames_input;
   for (auto i = 0; i < last_frames_batch.size(); ++i) {
     // Input frames to the net and compute Q values for each legal actions
     for (auto j = 0; j < kInputFrameCount; ++j) {
@@ -159,6 +256,19 @@ std::vector<ActionValue> Fast_DQN::SelectActionGreedily(
 
     }
   }
+  return SelectActionGreedily(net, frames_input, last_frames_batch.size());
+}
+
+std::vector<ActionValue> Fast_DQN::SelectActionGreedily(
+    NetSp net,
+    const FramesLayerInputData& frames_input,
+    const int batch_size) {
+  assert(batch_size <= kMinibatchSize);
+  if (batch_size == 0) {
+    return {};
+  }
+  // Only compute the rows that hold a state
+  SetBatchSize(net, batch_size);
 
   // for test
   //for(int q=0;q<frames_input.size();++q) {
@@ -166,14 +276,14 @@ std::vector<ActionValue> Fast_DQN::SelectActionGreedily(
   //}
   //std::cout << std::endl;
 
-  InputDataIntoLayers(net, frames_input, dummy_input_data_, dummy_input_data_);
+  InputDataIntoLayers(net, frames_input, dummy_input_data_);
   net->ForwardPrefilled();
 
   std::vector<ActionValue> results;
-  results.reserve(last_frames_batch.size());
+  results.reserve(batch_size);
   CHECK(net->has_blob(q_values_blob_name));
   const auto q_values_blob = net->blob_by_name(q_values_blob_name);
-  for (auto i = 0; i < last_frames_batch.size(); ++i) {
+  for (auto i = 0; i < batch_size; ++i) {
     // Get the Q values from the net
     const auto action_evaluator = [&](Environment::ActionCode action) {
       const auto q = q_values_blob->data_at(i, static_cast<int>(action), 0, 0);
@@ -206,80 +316,94 @@ std::vector<ActionValue> Fast_DQN::SelectActionGreedily(
   return results;
 }
 
-void Fast_DQN::AddTransition(const Transition& transition) {
-  if (replay_memory_.size() == replay_memory_capacity_) {
-    replay_memory_.pop_front();
-  }
-  replay_memory_.push_back(transition);
+void Fast_DQN::AddFrame(const int environment, const FrameData& frame,
+                        const bool episode_start) {
+  replay_memory_.AddFrame(environment, frame.data(), episode_start);
 }
 
-void Fast_DQN::Update() {
-  if (verbose_)
-    LOG(INFO) << "iteration: " << current_iteration() << std::endl;
-
-  // Every clone_iters steps, update the clone_net_
-  if (current_iteration() >= last_clone_iter_ + clone_frequency_) {
-    LOG(INFO) << "Iter " << current_iteration() << ": Updating Clone Net";
-    CloneTrainingNetToTargetNet();
-    last_clone_iter_ = current_iteration();
-  }
+void Fast_DQN::AddTransition(const int environment,
+                             Environment::ActionCode action, double reward,
+                             bool terminal) {
+  replay_memory_.AddTransition(environment, action, reward, terminal);
+}
 
+void Fast_DQN::PrepareMinibatch(Minibatch* minibatch) {
   // Sample transitions from replay memory
-  std::vector<int> transitions;
-  transitions.reserve(kMinibatchSize);
-  for (auto i = 0; i < kMinibatchSize; ++i) {
-    const auto random_transition_idx =
-        std::uniform_int_distribution<int>(0, replay_memory_.size() - 1)(
-            random_engine_);
-    transitions.push_back(random_transition_idx);
+  auto& transitions = minibatch->transitions;
+  std::array<float, kMinibatchSize> weights;
+  {
+    ScopedPhase phase(Phase::kSample);
+    replay_memory_.SampleBatch(kMinibatchSize, priority_beta_, random_engine_,
+                               transitions.data(), weights.data());
+    for (auto i = 0; i < kMinibatchSize; ++i) {
+      minibatch->generations[i] = replay_memory_.generation(transitions[i]);
+    }
   }
 
   // Compute target values: max_a Q(s',a)
-  std::vector<State> target_last_frames_batch;
-  for (const auto idx : transitions) {
-    const auto& transition = replay_memory_[idx];
-    if (transition.is_terminal()) {
-      continue;
+  auto& target_frames_input = *target_frames_input_;
+  auto target_batch_size = 0;
+  {
+    ScopedPhase phase(Phase::kAssemble);
+    for (const auto slot : transitions) {
+      if (replay_memory_.is_terminal(slot)) {
+        continue;
+      }
+      replay_memory_.GetNextState(slot,
+          target_frames_input.data() + target_batch_size++ * kInputDataSize);
     }
-
-    target_last_frames_batch.push_back(transition.GetNextState());
   }
 
-    // Get the next state QValues
-  const auto actions_and_values =
-      SelectActionGreedily(target_net_, target_last_frames_batch);
+  // Get the next state QValues
+  std::vector<ActionValue> actions_and_values;
+  {
+    ScopedPhase phase(Phase::kTargetForward);
+    actions_and_values = SelectActionGreedily(target_net_, target_frames_input,
+                                              target_batch_size);
+  }
 
-  FramesLayerInputData frames_input;
-  TargetLayerInputData target_input;
-  FilterLayerInputData filter_input;
-  std::fill(target_input.begin(), target_input.end(), 0.0f);
-  std::fill(filter_input.begin(), filter_input.end(), 0.0f);
+  ScopedPhase phase(Phase::kAssemble);
+  auto& td_input = minibatch->td;
   auto target_value_idx = 0;
   for (auto i = 0; i < kMinibatchSize; ++i) {
-    const auto& transition = replay_memory_[transitions[i]];
-    const auto action = transition.GetAction();
-    const auto reward = transition.GetReward();
+    const auto slot = transitions[i];
+    const auto action = replay_memory_.action(slot);
+    const auto reward = replay_memory_.reward(slot);
     assert(reward >= -1.0 && reward <= 1.0);
-    const auto target = transition.is_terminal() ?
+    const auto target = replay_memory_.is_terminal(slot) ?
           reward :
           reward + gamma_ * actions_and_values[target_value_idx++].q_value;
     assert(!std::isnan(target));
-    target_input[i * kOutputCount + static_cast<int>(action)] = target;
-    filter_input[i * kOutputCount + static_cast<int>(action)] = 1;
+    minibatch->targets[i] = target;
+    td_input[i * kTDInputSize] = static_cast<float>(action);
+    td_input[i * kTDInputSize + 1] = target;
+    td_input[i * kTDInputSize + 2] = weights[i];
     if (verbose_)
-      VLOG(1) << "filter:" << environmentSp_->action_to_string(action) 
+      VLOG(1) << "action:" << environmentSp_->action_to_string(action) 
         << " target:" << target;
-    for (auto j = 0; j < kInputFrameCount; ++j) {
-      const State& state = transition.GetState();
-      const auto& frame_data = state[j];
-      std::copy(
-          frame_data->begin(),
-          frame_data->end(),
-          frames_input.begin() + i * kInputDataSize +
-              j * kCroppedFrameDataSize);
-    }
+    replay_memory_.GetState(slot,
+                            minibatch->frames.data() + i * kInputDataSize);
+  }
+}
+
+void Fast_DQN::Update() {
+  if (verbose_)
+    LOG(INFO) << "iteration: " << current_iteration() << std::endl;
+
+  // Every clone_iters steps, update the clone_net_
+  if (current_iteration() >= last_clone_iter_ + clone_frequency_) {
+    LOG(INFO) << "Iter " << current_iteration() << ": Updating Clone Net";
+    ScopedPhase phase(Phase::kClone);
+    CloneTrainingNetToTargetNet();
+    last_clone_iter_ = current_iteration();
   }
-  InputDataIntoLayers(net_, frames_input, target_input, filter_input);
+
+  Minibatch& minibatch = *minibatches_[current_minibatch_];
+  if (!minibatch_prefetched_) {
+    PrepareMinibatch(&minibatch);
+  }
+  // The layers read straight from the minibatch
+  InputDataIntoLayers(net_, minibatch.frames, minibatch.td);
 
   // for test
   //BlobSp blob_frame = net_->blob_by_name("frames");
@@ -289,7 +413,45 @@ void Fast_DQN::Update() {
   //}
   //std::cout << std::endl;
 
-  solver_->Step(1);
+  // Build the next minibatch during the step, unless the target_net_ is
+  // cloned from the result of this step first.  Replay memory and the
+  // target_net_ are left alone by this thread until Wait() returns.
+  minibatch_prefetched_ =
+      current_iteration() + 1 < last_clone_iter_ + clone_frequency_;
+  if (minibatch_prefetched_) {
+    const auto next_minibatch = minibatches_[1 - current_minibatch_].get();
+    prefetcher_->Start([this, next_minibatch] {
+      PrepareMinibatch(next_minibatch);
+    });
+  }
+
+  {
+    ScopedPhase phase(Phase::kSolverStep);
+    solver_->Step(1);
+  }
+
+  if (minibatch_prefetched_) {
+    ScopedPhase phase(Phase::kPrefetchWait);
+    prefetcher_->Wait();
+  }
+  current_minibatch_ = 1 - current_minibatch_;
+
+  if (replay_memory_.prioritized()) {
+    // The forward pass of the step left Q(s,a) in the q_values blob.  The
+    // slots may have been overwritten while the minibatch waited, so the
+    // action is read from the minibatch itself.
+    const auto q_values_blob = net_->blob_by_name(q_values_blob_name);
+    std::array<float, kMinibatchSize> td_errors;
+    for (auto i = 0; i < kMinibatchSize; ++i) {
+      const auto action = static_cast<int>(minibatch.td[i * kTDInputSize]);
+      td_errors[i] = minibatch.targets[i] -
+          q_values_blob->data_at(i, action, 0, 0);
+    }
+    replay_memory_.UpdatePriorities(kMinibatchSize,
+                                    minibatch.transitions.data(),
+                                    minibatch.generations.data(),
+                                    td_errors.data());
+  }
   // Log the first parameter of each hidden layer
 //   VLOG(1) << "conv1:" <<
 //     net_->layer_by_name("conv1_layer")->blobs().front()->data_at(1, 0, 0, 0);
@@ -302,64 +464,91 @@ void Fast_DQN::Update() {
 }
 
 void Fast_DQN::InitNet(NetSp net) {
-    const auto target_input_layer =
+    const auto td_input_layer =
         boost::dynamic_pointer_cast<caffe::MemoryDataLayer<float>>(
-            net->layer_by_name(target_layer_name));
-    CHECK(target_input_layer);
-    target_input_layer->Reset(const_cast<float*>(dummy_input_data_.data()),
-                              const_cast<float*>(dummy_input_data_.data()),
-                              target_input_layer->batch_size());
-    const auto filter_input_layer =
-        boost::dynamic_pointer_cast<caffe::MemoryDataLayer<float>>(
-            net->layer_by_name(filter_layer_name));
-    CHECK(filter_input_layer);
-    filter_input_layer->Reset(const_cast<float*>(dummy_input_data_.data()),
-                              const_cast<float*>(dummy_input_data_.data()),
-                              filter_input_layer->batch_size());
+            net->layer_by_name(td_layer_name));
+    CHECK(td_input_layer);
+    td_input_layer->Reset(const_cast<float*>(dummy_input_data_.data()),
+                          const_cast<float*>(dummy_input_data_.data()),
+                          td_input_layer->batch_size());
 }
 
-void Fast_DQN::CloneNet(NetSp net) {
+void Fast_DQN::SetBatchSize(NetSp net, const int batch_size) {
+  const auto frames_input_layer =
+      boost::dynamic_pointer_cast<caffe::ByteMemoryDataLayer<float>>(
+          net->layer_by_name(frames_layer_name));
+  CHECK(frames_input_layer);
+  if (frames_input_layer->batch_size() == batch_size) {
+    return;
+  }
+  frames_input_layer->set_batch_size(batch_size);
+  // The TD layer only sees dummy data outside the training net, but its
+  // read position must restart for the new batch size.
+  const auto td_input_layer =
+      boost::dynamic_pointer_cast<caffe::MemoryDataLayer<float>>(
+          net->layer_by_name(td_layer_name));
+  CHECK(td_input_layer);
+  td_input_layer->set_batch_size(batch_size);
+  td_input_layer->Reset(const_cast<float*>(dummy_input_data_.data()),
+                        const_cast<float*>(dummy_input_data_.data()),
+                        batch_size);
+}
+
+Fast_DQN::NetSp Fast_DQN::CreateActingNet() {
   caffe::NetParameter net_param;
-  net->ToProto(&net_param);
-  net_param.mutable_state()->set_phase(net->phase());
+  target_net_->ToProto(&net_param);
+  net_param.mutable_state()->set_phase(target_net_->phase());
+  net_param.set_inference_only(true);
+  NetSp acting_net(new caffe::Net<float>(net_param));
+  InitNet(acting_net);
+  return acting_net;
+}
+
+void Fast_DQN::CloneNet(NetSp net) {
   if (target_net_ == nullptr) {
+    caffe::NetParameter net_param;
+    net->ToProto(&net_param);
+    net_param.mutable_state()->set_phase(net->phase());
+    // Only ever run forward: the Q values are read from the input of the
+    // loss layer, which stays intact.
+    net_param.set_inference_only(true);
     target_net_.reset(new caffe::Net<float>(net_param));
-  } else {
-    target_net_->CopyTrainedLayersFrom(net_param);
+    InitNet(target_net_);
+    return;
   }
-  InitNet(target_net_);
+  // Both nets share one definition, so the parameters are copied blob by
+  // blob instead of being serialized and parsed again.
+  caffe::Timer timer;
+  timer.Start();
+  target_net_->CopyParamsFrom(*net);
+  timer.Stop();
+  ++clone_count_;
+  clone_time_ms_ += timer.MilliSeconds();
+  LOG(INFO) << "Target net refreshed in " << timer.MilliSeconds() << " ms ("
+            << clone_time_ms_ / clone_count_ << " ms on average)";
 }
 
 
 void Fast_DQN::InputDataIntoLayers(NetSp net,
       const FramesLayerInputData& frames_input,
-      const TargetLayerInputData& target_input,
-      const FilterLayerInputData& filter_input) {
+      const TDLayerInputData& td_input) {
 
   const auto frames_input_layer =
-      boost::dynamic_pointer_cast<caffe::MemoryDataLayer<float>>(
+      boost::dynamic_pointer_cast<caffe::ByteMemoryDataLayer<float>>(
           net->layer_by_name(frames_layer_name));
   CHECK(frames_input_layer);
 
-  frames_input_layer->Reset(const_cast<float*>(frames_input.data()),
-                            const_cast<float*>(frames_input.data()),
+  frames_input_layer->Reset(frames_input.data(),
                             frames_input_layer->batch_size());
 
   if (net == net_) { // training net?
-    const auto target_input_layer =
-        boost::dynamic_pointer_cast<caffe::MemoryDataLayer<float>>(
-            net->layer_by_name(target_layer_name));
-    CHECK(target_input_layer);
-    target_input_layer->Reset(const_cast<float*>(target_input.data()),
-                              const_cast<float*>(target_input.data()),
-                              target_input_layer->batch_size());
-    const auto filter_input_layer =
+    const auto td_input_layer =
         boost::dynamic_pointer_cast<caffe::MemoryDataLayer<float>>(
-            net->layer_by_name(filter_layer_name));
-    CHECK(filter_input_layer);
-    filter_input_layer->Reset(const_cast<float*>(filter_input.data()),
-                              const_cast<float*>(filter_input.data()),
-                              filter_input_layer->batch_size());
+            net->layer_by_name(td_layer_name));
+    CHECK(td_input_layer);
+    td_input_layer->Reset(const_cast<float*>(td_input.data()),
+                          const_cast<float*>(td_input.data()),
+                          td_input_layer->batch_size());
   }
 
 }
@@ -2,14 +2,16 @@
 #define SRC_FAST_DQN_H_
 
 #include "environment.h"
+#include "replay_memory.h"
+#include "worker_thread.h"
 #include <caffe/caffe.hpp>
+#include <caffe/net_profiler.hpp>
 #include <memory>
 #include <random>
 #include <tuple>
 #include <unordered_map>
 #include <vector>
 #include <utility>
-#include <deque>
 #include <string>
 // #include <caffe/layers/memory_data_layer.hpp>
 
@@ -27,13 +29,11 @@ constexpr auto kGamma = 0.95f;
 constexpr auto kOutputCount = 18;
 
 constexpr auto frames_layer_name = "frames_input_layer";
-constexpr auto target_layer_name = "target_input_layer";
-constexpr auto filter_layer_name = "filter_input_layer";
+constexpr auto td_layer_name     = "td_input_layer";
 
 constexpr auto train_frames_blob_name = "frames";
 constexpr auto test_frames_blob_name  = "all_frames";
-constexpr auto target_blob_name       = "target";
-constexpr auto filter_blob_name       = "filter";
+constexpr auto td_blob_name           = "td";
 constexpr auto q_values_blob_name     = "q_values";
 
 using FrameData = std::array<uint8_t, kCroppedFrameDataSize>;
@@ -42,9 +42,11 @@ using State = std::array<FrameDataSp, kInputFrameCount>;
 using InputStateBatch = std::vector<State>;
 
 
-using FramesLayerInputData = std::array<float, kMinibatchDataSize>;
-using TargetLayerInputData = std::array<float, kMinibatchSize * kOutputCount>;
-using FilterLayerInputData = std::array<float, kMinibatchSize * kOutputCount>;
+// The frames stay bytes: the first convolution widens them itself
+using FramesLayerInputData = std::array<uint8_t, kMinibatchDataSize>;
+// (action, target, weight) of each sample for the TDLoss layer
+constexpr auto kTDInputSize = 3;
+using TDLayerInputData = std::array<float, kMinibatchSize * kTDInputSize>;
 
 
 typedef struct ActionValue {
@@ -55,48 +57,20 @@ typedef struct ActionValue {
   const float q_value;
 } ActionValue;
 
-/**
-  * Transition
-  */
-class Transition {
- public:
-
-  Transition ( const State state, Environment::ActionCode action,
-                double reward, FrameDataSp next_frame ) :
-      state_ ( state ),
-      action_ ( action ),
-      reward_ ( reward ),
-      next_frame_ ( next_frame ) {
-  }
-
-  bool is_terminal() const { return next_frame_ == nullptr; } 
-  
-  const State GetNextState() const;
-  
-  const State& GetState() const { return state_; }
-  
-  Environment::ActionCode GetAction() const { return action_; }
-  
-  double GetReward() const { return reward_; }
-
- private:
-    const State state_;
-    Environment::ActionCode action_;
-    double reward_;
-    FrameDataSp next_frame_;
-};
-typedef std::shared_ptr<Transition> TransitionSp;
-
 /**
  * Deep Q-Network
  */
 class Fast_DQN {
  public:
+  using NetSp = boost::shared_ptr<caffe::Net<float>>;
+
   Fast_DQN(
       EnvironmentSp environmentSp,
       const Environment::ActionVec& legal_actions,
       const std::string& solver_param,
       const int replay_memory_capacity,
+      const int environment_count,
+      const double priority_alpha,
       const double gamma,
       const bool verbose) :
         environmentSp_(environmentSp),
@@ -104,12 +78,24 @@ class Fast_DQN {
         solver_param_(solver_param),
         replay_memory_capacity_(replay_memory_capacity),
         gamma_(gamma),
+        replay_memory_(replay_memory_capacity, environment_count,
+                       priority_alpha),
+        priority_beta_(1.0),
         verbose_(verbose),
         random_engine_(0), 
         clone_frequency_(10000), // How often (steps) the target_net_ is updated
-        last_clone_iter_(0) {   // Iteration in which the net was last cloned
+        last_clone_iter_(0),   // Iteration in which the net was last cloned
+        clone_count_(0),
+        clone_time_ms_(0.0),
+        current_minibatch_(0),
+        minibatch_prefetched_(false) {
         }
 
+  /**
+   * Waits for the snapshots the solver writes in the background.
+   */
+  ~Fast_DQN();
+
   /**
    * Initialize DQN. Must be called before calling any other method.
    */
@@ -126,9 +112,44 @@ class Fast_DQN {
   Environment::ActionCode SelectAction(const State& input_frames, double epsilon);
 
   /**
-   * Add a transition to replay memory
+   * Select an action for each of up to kMinibatchSize states by
+   * epsilon-greedy.  The greedy ones are evaluated in one forward pass.
+   */
+  Environment::ActionVec SelectActions(const InputStateBatch& frames_batch,
+                                       const double epsilon);
+
+  /**
+   * Select actions as above with the given acting net and random engine.
+   * Threads that each own their net and engine may call this concurrently.
+   */
+  Environment::ActionVec SelectActions(NetSp net,
+                                       const InputStateBatch& frames_batch,
+                                       const double epsilon,
+                                       std::mt19937& random_engine);
+
+  /**
+   * Create a private copy of the net used for acting.
+   */
+  NetSp CreateActingNet();
+
+  /**
+   * The net used for acting, i.e. the target net
+   */
+  const caffe::Net<float>& acting_net() const { return *target_net_; }
+
+  /**
+   * Add a frame observed in the given environment to replay memory.
+   * episode_start must be set on the first frame of every episode.
+   */
+  void AddFrame(const int environment, const FrameData& frame,
+                const bool episode_start);
+
+  /**
+   * Add the transition taken from the frame most recently added for the
+   * given environment to replay memory
    */
-  void AddTransition(const Transition& transition);
+  void AddTransition(const int environment, Environment::ActionCode action,
+                     double reward, bool terminal);
 
   /**
    * Update DQN using one minibatch
@@ -137,26 +158,78 @@ class Fast_DQN {
 
   int memory_size() const { return replay_memory_.size(); }
 
+  /**
+   * Set the importance-sampling exponent used by prioritized replay
+   */
+  void set_priority_beta(const double priority_beta) {
+    priority_beta_ = priority_beta;
+  }
+
   /**
    * Copy the current training net_ to the target_net_
    */
   void CloneTrainingNetToTargetNet() { CloneNet(net_); }
 
+  /**
+   * Number of target_net_ refreshes and the time spent on them
+   */
+  int clone_count() const { return clone_count_; }
+  double clone_time_ms() const { return clone_time_ms_; }
+
   /**
    * Return the current iteration of the solver
    */
   int current_iteration() const { return solver_->iter(); }
 
+  /**
+   * Write everything training continues from into the existing directory:
+   * both nets, the solver state, replay memory, the random engines and the
+   * prefetched minibatch.  Must not be called during Update.
+   */
+  void SaveCheckpoint(const std::string& directory);
+
+  /**
+   * Restore a checkpoint written by SaveCheckpoint for a DQN of the same
+   * configuration, after Initialize.
+   */
+  void LoadCheckpoint(const std::string& directory);
+
+  /**
+   * Time each layer of the training net from now on, appending every layer
+   * pass to a Chrome trace_event file unless trace_path is empty
+   */
+  void ProfileLayers(const std::string& trace_path);
+
+  /**
+   * Table of the recent cost of each layer of the training net
+   */
+  std::string LayerProfile() const { return layer_profiler_->Report(); }
+
  private:
   using SolverSp = std::shared_ptr<caffe::Solver<float>>;
-  using NetSp = boost::shared_ptr<caffe::Net<float>>;
   using BlobSp = boost::shared_ptr<caffe::Blob<float>>;
-  using MemoryDataLayerSp = boost::shared_ptr<caffe::MemoryDataLayer<float>>;
 
+  /**
+   * Everything the training net needs for one update.
+   */
+  struct Minibatch {
+    FramesLayerInputData frames;
+    TDLayerInputData td;
+    std::array<int, kMinibatchSize> transitions; // replay memory slots
+    std::array<int64_t, kMinibatchSize> generations; // of the slots
+    std::array<float, kMinibatchSize> targets; // unweighted target values
+  };
 
-  Environment::ActionVec SelectActions(const InputStateBatch& frames_batch, const double epsilon);
   ActionValue SelectActionGreedily(NetSp net, const State& last_frames);
   std::vector<ActionValue> SelectActionGreedily(NetSp, const InputStateBatch& last_frames);
+  std::vector<ActionValue> SelectActionGreedily(NetSp net,
+      const FramesLayerInputData& frames_input, const int batch_size);
+
+  /**
+   * Sample a minibatch from replay memory, compute its targets with the
+   * target_net_ and fill the input arrays of the training net.
+   */
+  void PrepareMinibatch(Minibatch* minibatch);
 
   /**
     * Clone the given net and store the result in clone_net_
@@ -164,25 +237,32 @@ class Fast_DQN {
   void CloneNet(NetSp net);
   
   /**
-   * Init the target and filter layers.
+   * Init the TD input layer.
    */
   void InitNet(NetSp net);
 
   /**
-    * Input data into the Frames/Target/Filter layers of the given
+   * Set the batch size of the input layers of the given net.  The layers
+   * below reshape on the next forward pass; blobs only shrink or regrow
+   * within their capacity, so nothing is reallocated.
+   */
+  void SetBatchSize(NetSp net, const int batch_size);
+
+  /**
+    * Input data into the Frames/TD layers of the given
     * net. This must be done before forward is called.
     */
   void InputDataIntoLayers(NetSp net,
       const FramesLayerInputData& frames_data,
-      const TargetLayerInputData& target_data,
-      const FilterLayerInputData& filter_data);
+      const TDLayerInputData& td_data);
 
   EnvironmentSp environmentSp_;
   const std::vector<int> legal_actions_; // action indices
   const int replay_memory_capacity_;
   const double gamma_;
-  std::deque<Transition> replay_memory_;
-  TargetLayerInputData dummy_input_data_;
+  ReplayMemory replay_memory_;
+  double priority_beta_;
+  TDLayerInputData dummy_input_data_;
 
   const std::string solver_param_;
   SolverSp solver_;
@@ -190,10 +270,23 @@ class Fast_DQN {
   NetSp target_net_; // Clone used to generate targets.
   const int clone_frequency_; // How often (steps) the target_net is updated
   int last_clone_iter_; // Iteration in which the net was last cloned
+  int clone_count_; // Refreshes of target_net_ after it was created
+  double clone_time_ms_; // Total time spent in those refreshes
 
   
   std::mt19937 random_engine_;
   bool verbose_;
+
+  // Double buffer: the solver reads one minibatch while the prefetcher
+  // fills the other.
+  std::array<std::unique_ptr<Minibatch>, 2> minibatches_;
+  std::unique_ptr<FramesLayerInputData> target_frames_input_;
+  int current_minibatch_;
+  bool minibatch_prefetched_;
+  // Assembles the next minibatch while the solver runs the current one
+  std::unique_ptr<WorkerThread> prefetcher_;
+  // Times the layers of net_, which it must not outlive
+  std::unique_ptr<caffe::NetProfiler<float>> layer_profiler_;
 };
 
 
@@ -1,12 +1,20 @@
 #include "fast_dqn.h"
 #include "environment.h"
+#include "vector_environment.h"
+#include "async_trainer.h"
+#include "checkpoint.h"
+#include "profiler.h"
 #include <ale_interface.hpp>
+#include <caffe/util/host_allocator.hpp>
+#include <caffe/util/signal_handler.h>
 #include <glog/logging.h>
 #include <gflags/gflags.h>
 #include <cmath>
 #include <iostream>
 #include <deque>
 #include <algorithm>
+#include <sstream>
+#include <string>
 
 DEFINE_bool(verbose, false, "verbose output");
 DEFINE_bool(gpu, true, "Use GPU to brew Caffe");
@@ -16,6 +24,17 @@ DEFINE_string(rom, "roms/breakout.bin", "Atari 2600 ROM to play");
 DEFINE_string(solver, "models/dqn_solver.prototxt", "Solver parameter"
   "file (*.prototxt)");
 DEFINE_int32(memory, 500000, "Capacity of replay memory");
+DEFINE_int32(environments, 1, "Number of environments played in parallel "
+  "during training, each with an equal share of replay memory");
+DEFINE_int32(actors, 0, "Number of actor threads playing while a learner "
+  "thread updates DQN, 0 interleaves acting and learning");
+DEFINE_double(replay_ratio, 1.0, "Updates per transition with actor threads");
+DEFINE_int32(replay_slack, 100, "Updates the learner may run ahead of or "
+  "behind the replay ratio with actor threads");
+DEFINE_double(priority_alpha, 0.0, "Prioritized replay exponent, "
+  "0 samples the replay memory uniformly");
+DEFINE_double(priority_beta, 0.4, "Initial importance sampling exponent of "
+  "prioritized replay, annealed to 1 with epsilon");
 DEFINE_int32(explore, 1000000, "Number of iterations needed for epsilon"
   "to reach 0.1");
 DEFINE_double(gamma, 0.95, "Discount factor of future rewards (0,1]");
@@ -29,6 +48,21 @@ DEFINE_bool(evaluate, false, "Evaluation mode: only playing a game, no updates")
 DEFINE_double(evaluate_with_epsilon, 0.05, "Epsilon value to be used in evaluation mode");
 DEFINE_double(repeat_games, 1, "Number of games played in evaluation mode");
 DEFINE_int32(steps_per_epoch, 5000, "Number of training steps per epoch");
+DEFINE_int32(profile_interval, 0, "Seconds between logged summaries of the "
+  "time spent in each training phase, 0 disables them");
+DEFINE_string(profile_trace, "", "Chrome trace_event JSON file to write the "
+  "timed training phases to");
+DEFINE_bool(profile_layers, false, "Time each layer of the training net and "
+  "log a table of them with every epoch");
+DEFINE_string(profile_layer_trace, "", "Chrome trace_event JSON file to write "
+  "every layer pass of the training net to");
+DEFINE_int32(cpu_threads, 1, "Threads running the CPU layers of the nets, "
+  "including the calling one");
+DEFINE_string(checkpoint, "", "Prefix of the checkpoints of the training run, "
+  "written to <prefix>_iter_<iteration> directories, empty disables them");
+DEFINE_int32(checkpoint_interval, 100000, "Iterations between checkpoints");
+DEFINE_bool(resume, false, "Continue training from the latest checkpoint "
+  "under --checkpoint");
 
 double CalculateEpsilon(const int iter) {
   if (iter < FLAGS_explore) {
@@ -38,6 +72,89 @@ double CalculateEpsilon(const int iter) {
   }
 }
 
+double CalculatePriorityBeta(const int iter) {
+  if (iter < FLAGS_explore) {
+    return FLAGS_priority_beta +
+        (1.0 - FLAGS_priority_beta) * (static_cast<double>(iter) / FLAGS_explore);
+  } else {
+    return 1.0;
+  }
+}
+
+/**
+ * Counters of the training loop, saved with every checkpoint
+ */
+struct TrainingProgress {
+  double epoch_total_score = 0.0;
+  int epoch_episode_count = 0;
+  double total_time = 0.0;
+  int next_epoch_boundry = 0;
+  double running_average = 0.0;
+  long total_frames = 0;
+  int episode = 0;
+
+  std::string Serialize() const {
+    std::ostringstream out;
+    // Enough digits for the doubles to read back exactly
+    out.precision(17);
+    out << epoch_total_score << " "
+        << epoch_episode_count << " " << total_time << " "
+        << next_epoch_boundry << " " << running_average << " "
+        << total_frames << " " << episode << std::endl;
+    return out.str();
+  }
+
+  bool Deserialize(const std::string& contents) {
+    std::istringstream in(contents);
+    in >> epoch_total_score >> epoch_episode_count
+       >> total_time >> next_epoch_boundry >> running_average
+       >> total_frames >> episode;
+    return !in.fail();
+  }
+};
+
+/**
+ * Write a checkpoint of the training run.  The environment, if given, is
+ * saved as well; it must be between episodes.
+ */
+void SaveCheckpoint(fast_dqn::Fast_DQN* dqn,
+                    fast_dqn::EnvironmentSp environmentSp,
+                    const TrainingProgress& progress) {
+  const auto directory = fast_dqn::CreateCheckpointDirectory(
+      FLAGS_checkpoint, dqn->current_iteration());
+  dqn->SaveCheckpoint(directory);
+  fast_dqn::WriteFileDurably(directory + "/training_progress",
+                             progress.Serialize());
+  if (environmentSp) {
+    fast_dqn::WriteFileDurably(directory + "/environment",
+                               environmentSp->SaveState());
+  }
+  fast_dqn::CommitCheckpoint(FLAGS_checkpoint, directory);
+}
+
+/**
+ * Restore the latest checkpoint of the training run, and the environment
+ * with it if it was saved
+ */
+void LoadCheckpoint(fast_dqn::Fast_DQN* dqn,
+                    fast_dqn::EnvironmentSp environmentSp,
+                    TrainingProgress* progress) {
+  const auto directory = fast_dqn::LatestCheckpoint(FLAGS_checkpoint);
+  CHECK(!directory.empty()) << "No checkpoint to resume from: "
+      << FLAGS_checkpoint << ".latest does not exist";
+  dqn->LoadCheckpoint(directory);
+  std::string contents;
+  CHECK(fast_dqn::ReadFile(directory + "/training_progress", &contents) &&
+        progress->Deserialize(contents))
+      << "Cannot read " << directory << "/training_progress";
+  if (fast_dqn::ReadFile(directory + "/environment", &contents)) {
+    environmentSp->RestoreState(contents);
+  } else {
+    LOG(WARNING) << "The environment was not saved with " << directory
+                 << ", its episodes start over";
+  }
+}
+
 typedef struct Result {
   Result(double score, long frames) {
     score_ = score;
@@ -53,15 +170,20 @@ typedef struct Result {
 Result PlayOneEpisode(fast_dqn::EnvironmentSp environmentSp, fast_dqn::Fast_DQN* dqn, const double epsilon, const bool update) {
   assert(!environmentSp->EpisodeOver());
   std::deque<fast_dqn::FrameDataSp> past_frames;
+  fast_dqn::FramePool frame_pool;
   auto total_score = 0.0;
   auto frame = 0;
   while (!environmentSp->EpisodeOver()) {
     ++frame;
     //if (FLAGS_verbose) LOG(INFO) << "frame: " << frame;
-    const auto current_frame = environmentSp->PreprocessScreen();
+    const auto current_frame = frame_pool.Next();
+    environmentSp->PreprocessScreen(current_frame.get());
     //if (FLAGS_show_frame) {
     //  std::cout << fast_dqn::DrawFrame(*current_frame);
     //}
+    if (update) {
+      dqn->AddFrame(0, *current_frame, frame == 1);
+    }
     past_frames.push_back(current_frame);
     if (past_frames.size() < fast_dqn::kInputFrameCount) {
       // If there are not past frames enough for DQN input, just select NOOP
@@ -86,11 +208,9 @@ Result PlayOneEpisode(fast_dqn::EnvironmentSp environmentSp, fast_dqn::Fast_DQN*
       if (update) {
         reward = immediate_score == 0 ? 0 : immediate_score /= std::abs(immediate_score);
 
-        // Add the current transition to replay memory
-        const auto transition = environmentSp->EpisodeOver() ?
-            fast_dqn::Transition(input_frames, act_idx, reward, nullptr) :
-            fast_dqn::Transition(input_frames, act_idx, reward, environmentSp->PreprocessScreen());
-        dqn->AddTransition(transition);
+        // Add the current transition to replay memory.  Its next frame is
+        // added at the top of the next iteration.
+        dqn->AddTransition(0, act_idx, reward, environmentSp->EpisodeOver());
         // If the size of replay memory is enough, update DQN
         if (dqn->memory_size() > FLAGS_memory_threshold) {
           dqn->Update();
@@ -129,6 +249,7 @@ int main(int argc, char** argv) {
   } else {
     caffe::Caffe::set_mode(caffe::Caffe::CPU);
   }
+  caffe::Caffe::set_cpu_threads(FLAGS_cpu_threads);
 
   fast_dqn::EnvironmentSp environmentSp = fast_dqn::CreateEnvironment(FLAGS_gui, FLAGS_rom);
 
@@ -151,10 +272,22 @@ int main(int argc, char** argv) {
   //}
   //return 0;
 
-  fast_dqn::Fast_DQN dqn(environmentSp, legal_actions, FLAGS_solver, FLAGS_memory, FLAGS_gamma, FLAGS_verbose);
+  CHECK_GE(FLAGS_environments, 1);
+  CHECK_GE(FLAGS_actors, 0);
+  const auto stream_count =
+      FLAGS_actors > 0 ? FLAGS_actors : FLAGS_environments;
+  fast_dqn::Fast_DQN dqn(environmentSp, legal_actions, FLAGS_solver, FLAGS_memory, stream_count, FLAGS_priority_alpha, FLAGS_gamma, FLAGS_verbose);
 
   dqn.Initialize();
 
+  if (FLAGS_profile_interval > 0 || !FLAGS_profile_trace.empty()) {
+    fast_dqn::Profiler::Get().Start(FLAGS_profile_interval,
+                                    FLAGS_profile_trace);
+  }
+  if (FLAGS_profile_layers || !FLAGS_profile_layer_trace.empty()) {
+    dqn.ProfileLayers(FLAGS_profile_layer_trace);
+  }
+
   if (!FLAGS_model.empty()) {
     // Just evaluate the given trained model
     LOG(INFO) << "Loading " << FLAGS_model;
@@ -173,61 +306,164 @@ int main(int argc, char** argv) {
     return 0;
   }
 
-  double total_score = 0.0;
-  double epoch_total_score = 0.0;
-  int epoch_episode_count = 0.0;
-  double total_time = 0.0;
-  int next_epoch_boundry = FLAGS_steps_per_epoch;
-  double running_average = 0.0;
+  TrainingProgress progress;
+  progress.next_epoch_boundry = FLAGS_steps_per_epoch;
   double plot_average_discount = 0.05;
-  long total_frames = 0;
 
-  std::ofstream training_data("./training_log.csv");
-  training_data << FLAGS_rom << "," << FLAGS_steps_per_epoch
-    << ",,," << std::endl;
-  training_data << "Epoch,Epoch avg score,Hours training,Number of episodes,Episodes in epoch,Number of frames" << std::endl;
-
-
-  for (auto episode = 0;; episode++) {
-    caffe::Timer run_timer;
-    run_timer.Start();
+  CHECK_GT(FLAGS_checkpoint_interval, 0);
+  if (!FLAGS_checkpoint.empty()) {
+    fast_dqn::CheckCheckpointWritePermissions(FLAGS_checkpoint);
+  }
+  if (FLAGS_resume) {
+    CHECK(!FLAGS_checkpoint.empty()) << "--resume needs --checkpoint";
+    CHECK(FLAGS_model.empty()) << "--resume restores the model itself";
+    LoadCheckpoint(&dqn, environmentSp, &progress);
+  }
+  auto next_checkpoint = dqn.current_iteration() + FLAGS_checkpoint_interval;
+  // Checkpoints are written between updates, and in the single-environment
+  // loop between episodes, where the environment is saved as well.
+  const auto checkpoint = [&](fast_dqn::EnvironmentSp environment) {
+    if (FLAGS_checkpoint.empty() || dqn.current_iteration() < next_checkpoint) {
+      return;
+    }
+    SaveCheckpoint(&dqn, environment, progress);
+    next_checkpoint = dqn.current_iteration() + FLAGS_checkpoint_interval;
+  };
+
+  // SIGINT stops training between two passes of the loops below, and the
+  // snapshots still being written are waited for on the way out
+  caffe::SignalHandler signal_handler(caffe::SolverAction::STOP,
+                                      caffe::SolverAction::NONE);
+  const auto requested_action = signal_handler.GetActionFunction();
+  const auto training = [&] {
+    return requested_action() != caffe::SolverAction::STOP;
+  };
+
+  // A resumed run appends to the log of the run it continues
+  std::ofstream training_data("./training_log.csv",
+      FLAGS_resume ? std::ios::app : std::ios::trunc);
+  if (!FLAGS_resume) {
+    training_data << FLAGS_rom << "," << FLAGS_steps_per_epoch
+      << ",,," << std::endl;
+    training_data << "Epoch,Epoch avg score,Hours training,Number of episodes,Episodes in epoch,Number of frames" << std::endl;
+  }
 
-    epoch_episode_count++;
-    const auto epsilon = CalculateEpsilon(dqn.current_iteration());
-    Result res = PlayOneEpisode(environmentSp, &dqn, epsilon, true);
 
-    epoch_total_score += res.score_;
-    total_frames += res.frames_;
-    if (dqn.current_iteration() > 0) {  // started training?
-      total_time += run_timer.MilliSeconds();
-    }
+  auto& episode = progress.episode;
+  const auto episode_finished = [&](const Result& res) {
+    progress.epoch_episode_count++;
+    progress.epoch_total_score += res.score_;
+    progress.total_frames += res.frames_;
     LOG(INFO) << "training score(" << episode << "): " << res.score_ << std::endl;
 
     if (episode == 0) {
-      running_average = res.score_;
+      progress.running_average = res.score_;
     }
     else {
-      running_average = res.score_ * plot_average_discount + running_average * (1.0 - plot_average_discount);
+      progress.running_average = res.score_ * plot_average_discount + progress.running_average * (1.0 - plot_average_discount);
     }
 
-    if (dqn.current_iteration() >= next_epoch_boundry) {   
-      double hours =  total_time / 1000. / 3600.;
-      int epoc_number = static_cast<int>((next_epoch_boundry)/FLAGS_steps_per_epoch);
-      LOG(INFO) << "epoch(" << epoc_number << ":" << dqn.current_iteration() << "): " << "average score " << running_average << " in " << hours << " hour(s)";
+    if (dqn.current_iteration() >= progress.next_epoch_boundry) {
+      double hours =  progress.total_time / 1000. / 3600.;
+      int epoc_number = static_cast<int>((progress.next_epoch_boundry)/FLAGS_steps_per_epoch);
+      LOG(INFO) << "epoch(" << epoc_number << ":" << dqn.current_iteration() << "): " << "average score " << progress.running_average << " in " << hours << " hour(s)";
 
       if (dqn.current_iteration()) {
         auto hours_for_million = hours / (dqn.current_iteration()/1000000.0);
         LOG(INFO) << "Estimated Time for 1 million iterations: " << hours_for_million << " hours";
       }
+      const auto host_memory = caffe::Caffe::host_allocator()->stats();
+      LOG(INFO) << "host memory: " << (host_memory.live_bytes >> 20)
+                << " MB live, " << (host_memory.peak_bytes >> 20)
+                << " MB peak, " << (host_memory.cached_bytes >> 20)
+                << " MB cached, " << host_memory.reuses << " of "
+                << host_memory.allocations << " allocations reused";
+      if (FLAGS_profile_layers) {
+        LOG(INFO) << dqn.LayerProfile();
+      }
 
-      training_data << epoc_number << ", " << running_average << ", " << hours << ", " << episode << ", " << epoch_episode_count << "," << total_frames << std::endl;
+      training_data << epoc_number << ", " << progress.running_average << ", " << hours << ", " << episode << ", " << progress.epoch_episode_count << "," << progress.total_frames << std::endl;
 
-      epoch_total_score = 0.0;
-      epoch_episode_count = 0;
+      progress.epoch_total_score = 0.0;
+      progress.epoch_episode_count = 0;
 
-      while (next_epoch_boundry < dqn.current_iteration()) {
-        next_epoch_boundry += FLAGS_steps_per_epoch;
+      while (progress.next_epoch_boundry < dqn.current_iteration()) {
+        progress.next_epoch_boundry += FLAGS_steps_per_epoch;
+      }
+    }
+    ++episode;
+  };
+
+  if (FLAGS_actors > 0) {
+    // Actor threads play while this thread learns
+    std::vector<fast_dqn::EnvironmentSp> environments{environmentSp};
+    for (auto i = 1; i < FLAGS_actors; ++i) {
+      environments.push_back(fast_dqn::CreateEnvironment(false, FLAGS_rom));
+    }
+    fast_dqn::AsyncTrainer trainer(&dqn, environments, CalculateEpsilon,
+                                   FLAGS_replay_ratio, FLAGS_replay_slack,
+                                   FLAGS_memory_threshold);
+    while (training()) {
+      caffe::Timer run_timer;
+      run_timer.Start();
+
+      dqn.set_priority_beta(CalculatePriorityBeta(dqn.current_iteration()));
+      const auto results = trainer.Learn();
+
+      if (dqn.current_iteration() > 0) {  // started training?
+        progress.total_time += run_timer.MilliSeconds();
+      }
+      for (const auto& result : results) {
+        episode_finished(Result(result.score, result.frames));
+      }
+      // The actors only hand experience over inside Learn
+      checkpoint(nullptr);
+    }
+  } else if (FLAGS_environments == 1) {
+    while (training()) {
+      caffe::Timer run_timer;
+      run_timer.Start();
+
+      const auto epsilon = CalculateEpsilon(dqn.current_iteration());
+      dqn.set_priority_beta(CalculatePriorityBeta(dqn.current_iteration()));
+      Result res = PlayOneEpisode(environmentSp, &dqn, epsilon, true);
+
+      if (dqn.current_iteration() > 0) {  // started training?
+        progress.total_time += run_timer.MilliSeconds();
+      }
+      episode_finished(res);
+      checkpoint(environmentSp);
+    }
+  } else {
+    // Play several environments at once, updating DQN once per transition
+    std::vector<fast_dqn::EnvironmentSp> environments{environmentSp};
+    for (auto i = 1; i < FLAGS_environments; ++i) {
+      environments.push_back(fast_dqn::CreateEnvironment(false, FLAGS_rom));
+    }
+    fast_dqn::VectorEnvironment vector_environment(environments);
+    while (training()) {
+      caffe::Timer run_timer;
+      run_timer.Start();
+
+      const auto epsilon = CalculateEpsilon(dqn.current_iteration());
+      dqn.set_priority_beta(CalculatePriorityBeta(dqn.current_iteration()));
+      auto transition_count = 0;
+      const auto results =
+          vector_environment.Step(&dqn, epsilon, true, &transition_count);
+      for (auto i = 0; i < transition_count; ++i) {
+        // If the size of replay memory is enough, update DQN
+        if (dqn.memory_size() > FLAGS_memory_threshold) {
+          dqn.Update();
+        }
+      }
+
+      if (dqn.current_iteration() > 0) {  // started training?
+        progress.total_time += run_timer.MilliSeconds();
+      }
+      for (const auto& result : results) {
+        episode_finished(Result(result.score, result.frames));
       }
+      checkpoint(nullptr);
     }
   }
 
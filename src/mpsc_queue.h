@@ -0,0 +1,93 @@
+#ifndef SRC_MPSC_QUEUE_H_
+#define SRC_MPSC_QUEUE_H_
+
+#include <glog/logging.h>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace fast_dqn {
+
+/**
+ * Bounded lock-free queue for many producers and one consumer.
+ *
+ * Every cell carries a sequence number telling whose turn it is: a
+ * producer claims the tail position with a compare-and-swap and publishes
+ * the cell by advancing its sequence, the consumer waits for that sequence
+ * and hands the cell back one lap ahead.  Items of one producer are popped
+ * in the order they were pushed.
+ */
+template <typename T>
+class MpscQueue {
+ public:
+  explicit MpscQueue(const size_t capacity) :
+      cells_(capacity), mask_(capacity - 1), head_(0), tail_(0) {
+    CHECK(capacity >= 2 && (capacity & (capacity - 1)) == 0)
+        << "Capacity must be a power of two";
+    for (size_t i = 0; i < capacity; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * Append item unless the queue is full.  Safe to call from any thread.
+   */
+  bool TryPush(T&& item) {
+    auto position = tail_.load(std::memory_order_relaxed);
+    for (;;) {
+      auto& cell = cells_[position & mask_];
+      const auto sequence = cell.sequence.load(std::memory_order_acquire);
+      const auto lap = static_cast<std::ptrdiff_t>(sequence - position);
+      if (lap == 0) {
+        if (tail_.compare_exchange_weak(position, position + 1,
+                                        std::memory_order_relaxed)) {
+          cell.item = std::move(item);
+          cell.sequence.store(position + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (lap < 0) {
+        return false;
+      } else {
+        position = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /**
+   * Remove the oldest item into item unless the queue is empty.  Only the
+   * consumer thread may call this.
+   */
+  bool TryPop(T* item) {
+    auto& cell = cells_[head_ & mask_];
+    const auto sequence = cell.sequence.load(std::memory_order_acquire);
+    if (sequence != head_ + 1) {
+      return false;
+    }
+    *item = std::move(cell.item);
+    cell.sequence.store(head_ + mask_ + 1, std::memory_order_release);
+    ++head_;
+    return true;
+  }
+
+  size_t capacity() const { return cells_.size(); }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T item;
+  };
+
+  std::vector<Cell> cells_;
+  const size_t mask_;
+  size_t head_;  // Only touched by the consumer
+  // Keeps the producers' position off the consumer's cache line
+  alignas(64) std::atomic<size_t> tail_;
+
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+};
+
+}  // namespace fast_dqn
+
+#endif  // SRC_MPSC_QUEUE_H_
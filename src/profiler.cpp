@@ -0,0 +1,224 @@
+#include "profiler.h"
+#include <glog/logging.h>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+namespace fast_dqn {
+
+namespace {
+
+// How often the collector drains the rings, which must not fill up meanwhile
+constexpr auto kCollectInterval = std::chrono::milliseconds(100);
+// Duration and phase share one word
+constexpr auto kPhaseBits = 8;
+
+int64_t Percentile(const std::vector<int64_t>& sorted, const double p) {
+  const auto index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+  return sorted[index];
+}
+
+}  // namespace
+
+const char* PhaseName(const Phase phase) {
+  switch (phase) {
+    case Phase::kEmulate: return "emulate";
+    case Phase::kPreprocess: return "preprocess";
+    case Phase::kSelectAction: return "select_action";
+    case Phase::kSample: return "sample";
+    case Phase::kAssemble: return "assemble";
+    case Phase::kTargetForward: return "target_forward";
+    case Phase::kSolverStep: return "solver_step";
+    case Phase::kPrefetchWait: return "prefetch_wait";
+    case Phase::kClone: return "clone";
+    default: LOG(FATAL) << "Unknown phase " << static_cast<int>(phase);
+  }
+  return "";
+}
+
+Profiler& Profiler::Get() {
+  static Profiler profiler;
+  return profiler;
+}
+
+Profiler::Profiler() :
+    enabled_(false),
+    report_seconds_(0),
+    epoch_ns_(0),
+    dropped_count_(0),
+    trace_empty_(true) {}
+
+Profiler::~Profiler() {
+  Stop();
+}
+
+int64_t Profiler::Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::Start(const int report_seconds, const std::string& trace_path) {
+  CHECK(!enabled()) << "Profiler already started";
+  CHECK_GE(report_seconds, 0);
+  report_seconds_ = report_seconds;
+  epoch_ns_ = Now();
+  if (!trace_path.empty()) {
+    trace_.open(trace_path);
+    CHECK(trace_) << "Cannot open " << trace_path;
+    // JSON array format, which viewers accept without the closing bracket
+    // should the process be killed
+    trace_ << "[";
+    trace_empty_ = true;
+  }
+  StartInternalThread();
+  enabled_.store(true, std::memory_order_relaxed);
+}
+
+void Profiler::Stop() {
+  if (!enabled()) {
+    return;
+  }
+  enabled_.store(false, std::memory_order_relaxed);
+  StopInternalThread();
+  Collect();
+  if (trace_.is_open()) {
+    trace_ << "\n]\n";
+    trace_.close();
+  }
+}
+
+Profiler::Ring* Profiler::ThreadRing() {
+  thread_local Ring* ring = nullptr;
+  if (ring == nullptr) {
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    rings_.emplace_back(new Ring);
+    ring = rings_.back().get();
+    ring->thread_id = rings_.size() - 1;
+    ring->head.store(0, std::memory_order_relaxed);
+    ring->read = 0;
+  }
+  return ring;
+}
+
+void Profiler::Record(const Phase phase, const int64_t start_ns,
+                      const int64_t end_ns) {
+  const auto ring = ThreadRing();
+  const auto head = ring->head.load(std::memory_order_relaxed);
+  const auto index = head & (kRingCapacity - 1);
+  // The collector must see head before the overwritten event
+  std::atomic_thread_fence(std::memory_order_release);
+  ring->starts[index].store(start_ns, std::memory_order_relaxed);
+  ring->durations[index].store(
+      (end_ns - start_ns) << kPhaseBits | static_cast<int64_t>(phase),
+      std::memory_order_relaxed);
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+void Profiler::Collect() {
+  std::vector<Event> events;
+  {
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    for (const auto& ring : rings_) {
+      const auto head = ring->head.load(std::memory_order_acquire);
+      auto first = std::max(ring->read,
+                            head > kRingCapacity ? head - kRingCapacity : 0);
+      const auto begin = events.size();
+      for (auto i = first; i < head; ++i) {
+        const auto index = i & (kRingCapacity - 1);
+        const auto packed =
+            ring->durations[index].load(std::memory_order_relaxed);
+        events.push_back(Event{
+            static_cast<Phase>(packed & ((1 << kPhaseBits) - 1)),
+            ring->thread_id,
+            ring->starts[index].load(std::memory_order_relaxed),
+            packed >> kPhaseBits});
+      }
+      // Events the thread overwrote while they were read are dropped
+      std::atomic_thread_fence(std::memory_order_acquire);
+      const auto written = ring->head.load(std::memory_order_relaxed);
+      if (written >= kRingCapacity && written - kRingCapacity + 1 > first) {
+        const auto valid = written - kRingCapacity + 1;
+        const auto overwritten = std::min(valid, head) - first;
+        events.erase(events.begin() + begin,
+                     events.begin() + begin + overwritten);
+        first += overwritten;
+      }
+      dropped_count_ += first - ring->read;
+      ring->read = head;
+    }
+  }
+
+  for (const auto& event : events) {
+    if (report_seconds_ > 0) {
+      durations_[static_cast<int>(event.phase)].push_back(event.duration_ns);
+    }
+    if (trace_.is_open()) {
+      WriteTrace(event);
+    }
+  }
+  if (trace_.is_open()) {
+    // Keep the file whole up to here should the process be killed
+    trace_.flush();
+  }
+}
+
+void Profiler::WriteTrace(const Event& event) {
+  trace_ << (trace_empty_ ? "\n" : ",\n") << std::fixed << std::setprecision(3)
+         << "{\"name\":\"" << PhaseName(event.phase)
+         << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.thread_id
+         << ",\"ts\":" << (event.start_ns - epoch_ns_) / 1000.0
+         << ",\"dur\":" << event.duration_ns / 1000.0 << "}";
+  trace_empty_ = false;
+}
+
+void Profiler::Report(const double interval_seconds) {
+  std::ostringstream report;
+  report << std::fixed << std::setprecision(1)
+         << "Profile of the last " << interval_seconds << " s"
+         << " (phase: count, share of wall time, p50/p90/p99/max us)";
+  for (auto i = 0; i < durations_.size(); ++i) {
+    auto& durations = durations_[i];
+    if (durations.empty()) {
+      continue;
+    }
+    std::sort(durations.begin(), durations.end());
+    int64_t total_ns = 0;
+    for (const auto duration : durations) {
+      total_ns += duration;
+    }
+    report << "\n  " << std::setw(14) << std::left
+           << PhaseName(static_cast<Phase>(i)) << std::right
+           << std::setw(8) << durations.size()
+           << std::setw(7) << 100.0 * total_ns / (interval_seconds * 1e9)
+           << "%"
+           << std::setw(10) << Percentile(durations, 0.5) / 1000.0
+           << std::setw(10) << Percentile(durations, 0.9) / 1000.0
+           << std::setw(10) << Percentile(durations, 0.99) / 1000.0
+           << std::setw(10) << durations.back() / 1000.0;
+    durations.clear();
+  }
+  if (dropped_count_ > 0) {
+    report << "\n  " << dropped_count_
+           << " phases dropped by full rings";
+    dropped_count_ = 0;
+  }
+  LOG(INFO) << report.str();
+}
+
+void Profiler::InternalThreadEntry() {
+  auto last_report_ns = Now();
+  while (!must_stop()) {
+    std::this_thread::sleep_for(kCollectInterval);
+    Collect();
+    const auto now_ns = Now();
+    if (report_seconds_ > 0 &&
+        now_ns - last_report_ns >= report_seconds_ * 1000000000LL) {
+      Report((now_ns - last_report_ns) / 1e9);
+      last_report_ns = now_ns;
+    }
+  }
+}
+
+}  // namespace fast_dqn
@@ -0,0 +1,138 @@
+#ifndef SRC_PROFILER_H_
+#define SRC_PROFILER_H_
+
+#include <caffe/internal_thread.hpp>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace fast_dqn {
+
+/**
+ * Phases of the training loop timed by the profiler
+ */
+enum class Phase {
+  kEmulate,        // Environment Act, ActNoop and Reset
+  kPreprocess,     // Environment PreprocessScreen
+  kSelectAction,   // Greedy forward pass choosing actions
+  kSample,         // Sampling transitions from replay memory
+  kAssemble,       // Copying states and targets into a minibatch
+  kTargetForward,  // Target net forward pass computing max_a Q(s',a)
+  kSolverStep,     // solver_->Step(1)
+  kPrefetchWait,   // Waiting for the next minibatch after the step
+  kClone,          // Refreshing the target net
+  kPhaseCount
+};
+
+const char* PhaseName(const Phase phase);
+
+/**
+ * Low-overhead timing of the training phases.  Every thread records the
+ * phases it runs into its own ring buffer without taking a lock; a
+ * collector thread drains the rings, logs percentiles of each phase every
+ * report interval and optionally appends every phase to a Chrome
+ * trace_event file (chrome://tracing, Perfetto).  Until Start is called
+ * recording costs one atomic load.
+ */
+class Profiler : public caffe::InternalThread {
+ public:
+  static Profiler& Get();
+
+  ~Profiler();
+
+  /**
+   * Start collecting.  Summaries are logged every report_seconds unless it
+   * is 0; phases are written to trace_path unless it is empty.
+   */
+  void Start(const int report_seconds, const std::string& trace_path);
+
+  /**
+   * Stop collecting and flush the trace.
+   */
+  void Stop();
+
+  bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  /**
+   * Record a phase of the calling thread, times from Now()
+   */
+  void Record(const Phase phase, const int64_t start_ns, const int64_t end_ns);
+
+  static int64_t Now();
+
+ protected:
+  void InternalThreadEntry();
+
+ private:
+  static constexpr auto kRingCapacity = 1 << 14;
+
+  /**
+   * Phases recorded by one thread.  The thread is the only writer; the
+   * collector reads behind head and drops what was overwritten meanwhile.
+   */
+  struct Ring {
+    int thread_id;
+    // Start and, packed with the phase, duration of each event
+    std::array<std::atomic<int64_t>, kRingCapacity> starts;
+    std::array<std::atomic<int64_t>, kRingCapacity> durations;
+    std::atomic<uint64_t> head;
+    uint64_t read;  // Collector only
+  };
+
+  struct Event {
+    Phase phase;
+    int thread_id;
+    int64_t start_ns;
+    int64_t duration_ns;
+  };
+
+  Profiler();
+
+  Ring* ThreadRing();
+  void Collect();
+  void Report(const double interval_seconds);
+  void WriteTrace(const Event& event);
+
+  std::atomic<bool> enabled_;
+  int report_seconds_;
+  int64_t epoch_ns_;
+
+  std::mutex rings_mutex_;
+  std::vector<std::unique_ptr<Ring>> rings_;
+
+  // Collector only
+  std::array<std::vector<int64_t>, static_cast<int>(Phase::kPhaseCount)>
+      durations_;
+  int64_t dropped_count_;
+  std::ofstream trace_;
+  bool trace_empty_;
+};
+
+/**
+ * Records the enclosing scope as a phase
+ */
+class ScopedPhase {
+ public:
+  explicit ScopedPhase(const Phase phase) :
+      phase_(phase),
+      start_ns_(Profiler::Get().enabled() ? Profiler::Now() : -1) {}
+
+  ~ScopedPhase() {
+    if (start_ns_ >= 0) {
+      Profiler::Get().Record(phase_, start_ns_, Profiler::Now());
+    }
+  }
+
+ private:
+  const Phase phase_;
+  const int64_t start_ns_;
+};
+
+}  // namespace fast_dqn
+
+#endif  // SRC_PROFILER_H_
@@ -0,0 +1,384 @@
+#include "replay_memory.h"
+#include "checkpoint.h"
+#include <caffe/util/io.hpp>
+#include <glog/logging.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <type_traits>
+
+namespace fast_dqn {
+
+namespace {
+
+template <typename T>
+T* AllocateAligned(const size_t count, const size_t alignment) {
+  void* ptr = nullptr;
+  if (posix_memalign(&ptr, alignment, count * sizeof(T)) != 0) {
+    throw std::bad_alloc();
+  }
+  return static_cast<T*>(ptr);
+}
+
+// Start of a file written by ReplayMemory::Save.  The arrays follow, each
+// on a page boundary.
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t frame_stride;
+  int32_t capacity;
+  int32_t stream_count;
+  int32_t transition_count;
+  int32_t prioritized;
+  double priority_alpha;
+  double max_priority;
+  uint64_t frames_offset;
+  uint64_t actions_offset;
+  uint64_t rewards_offset;
+  uint64_t flags_offset;
+  uint64_t streams_offset;
+  uint64_t priorities_offset;
+  uint64_t file_size;
+};
+
+constexpr char kFileMagic[8] = {'F', 'D', 'Q', 'N', 'R', 'P', 'L', 'Y'};
+constexpr uint32_t kFileVersion = 1;
+constexpr uint64_t kFilePageSize = 4096;
+
+uint64_t PageAlign(const uint64_t offset) {
+  return (offset + kFilePageSize - 1) / kFilePageSize * kFilePageSize;
+}
+
+// The header of a file holding a memory of this shape, without its contents
+FileHeader FileLayout(const int capacity, const int stream_count,
+                      const size_t stream_size, const bool prioritized,
+                      const size_t frame_stride) {
+  FileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kFileMagic, sizeof(kFileMagic));
+  header.version = kFileVersion;
+  header.frame_stride = frame_stride;
+  header.capacity = capacity;
+  header.stream_count = stream_count;
+  header.prioritized = prioritized;
+  header.frames_offset = PageAlign(sizeof(FileHeader));
+  header.actions_offset = PageAlign(
+      header.frames_offset + static_cast<uint64_t>(capacity) * frame_stride);
+  header.rewards_offset =
+      PageAlign(header.actions_offset + capacity * sizeof(uint8_t));
+  header.flags_offset =
+      PageAlign(header.rewards_offset + capacity * sizeof(float));
+  header.streams_offset =
+      PageAlign(header.flags_offset + capacity * sizeof(uint8_t));
+  header.priorities_offset =
+      PageAlign(header.streams_offset + stream_count * stream_size);
+  header.file_size = header.priorities_offset +
+      (prioritized ? capacity * sizeof(double) : 0);
+  return header;
+}
+
+}  // namespace
+
+ReplayMemory::ReplayMemory(const int capacity, const int stream_count,
+                           const double priority_alpha) :
+    stream_capacity_(capacity / stream_count),
+    capacity_(stream_capacity_ * stream_count),
+    frames_(nullptr),
+    actions_(nullptr),
+    rewards_(nullptr),
+    flags_(nullptr),
+    streams_(stream_count, Stream{0, 0}),
+    transition_count_(0),
+    priority_alpha_(priority_alpha),
+    max_priority_(1.0) {
+  CHECK_GT(stream_count, 0);
+  CHECK_GT(stream_capacity_, kStateFrameCount);
+  CHECK_GE(priority_alpha_, 0.0);
+  if (priority_alpha_ > 0.0) {
+    priorities_.reset(new SumTree(capacity_));
+  }
+  frames_ = AllocateAligned<uint8_t>(
+      static_cast<size_t>(capacity_) * kFrameStride, kCacheLineSize);
+  actions_ = AllocateAligned<uint8_t>(capacity_, kCacheLineSize);
+  rewards_ = AllocateAligned<float>(capacity_, kCacheLineSize);
+  flags_ = AllocateAligned<uint8_t>(capacity_, kCacheLineSize);
+  std::fill(flags_, flags_ + capacity_, 0);
+}
+
+ReplayMemory::~ReplayMemory() {
+  free(frames_);
+  free(actions_);
+  free(rewards_);
+  free(flags_);
+}
+
+void ReplayMemory::AddFrame(const int stream, const uint8_t* frame,
+                            const bool episode_start) {
+  DCHECK_GE(stream, 0);
+  DCHECK_LT(stream, stream_count());
+  auto& s = streams_[stream];
+  const auto slot = Slot(stream, s.frame_count);
+  if (flags_[slot] & kHasAction) {
+    // Overwriting the oldest transition
+    --transition_count_;
+  }
+  std::memcpy(frames_ + static_cast<size_t>(slot) * kFrameStride, frame,
+              kFrameDataSize);
+  flags_[slot] = episode_start ? kEpisodeStart : 0;
+  s.episode_frame_count = episode_start ? 1 : s.episode_frame_count + 1;
+  ++s.frame_count;
+  if (prioritized()) {
+    SetPriority(stream, s.frame_count - 1, 0.0);
+    // The state of the oldest transition lost its first frame
+    SetPriority(stream, s.frame_count - stream_capacity_ + kStateFrameCount - 2,
+                0.0);
+    // The previous transition can be replayed now its next frame is stored
+    if (!episode_start && s.frame_count >= 2 &&
+        IsValid(Slot(stream, s.frame_count - 2))) {
+      SetPriority(stream, s.frame_count - 2, max_priority_);
+    }
+  }
+}
+
+void ReplayMemory::AddTransition(const int stream,
+                                 const Environment::ActionCode action,
+                                 const float reward, const bool terminal) {
+  DCHECK_GE(stream, 0);
+  DCHECK_LT(stream, stream_count());
+  const auto& s = streams_[stream];
+  CHECK_GE(s.episode_frame_count, kStateFrameCount);
+  CHECK_GE(action, 0);
+  CHECK_LE(action, std::numeric_limits<uint8_t>::max());
+  const auto slot = Slot(stream, s.frame_count - 1);
+  CHECK(!(flags_[slot] & kHasAction)) << "Frame already has a transition";
+  actions_[slot] = static_cast<uint8_t>(action);
+  rewards_[slot] = reward;
+  flags_[slot] |= kHasAction | (terminal ? kTerminal : 0);
+  ++transition_count_;
+  if (prioritized() && terminal) {
+    SetPriority(stream, s.frame_count - 1, max_priority_);
+  }
+}
+
+void ReplayMemory::SetPriority(const int stream, const int64_t index,
+                               const double priority) {
+  if (index >= 0) {
+    priorities_->Set(Slot(stream, index), priority);
+  }
+}
+
+int64_t ReplayMemory::Index(const int slot) const {
+  // The most recent frame index stored in slot
+  const auto frame_count = streams_[StreamOf(slot)].frame_count;
+  return frame_count - 1 -
+      (frame_count - 1 - slot % stream_capacity_) % stream_capacity_;
+}
+
+bool ReplayMemory::IsValid(const int slot) const {
+  const auto flags = flags_[slot];
+  if (!(flags & kHasAction)) {
+    return false;
+  }
+  const auto stream = StreamOf(slot);
+  const auto frame_count = streams_[stream].frame_count;
+  const auto index = Index(slot);
+  if (index - (kStateFrameCount - 1) < frame_count - stream_capacity_) {
+    // The oldest frames of the state have been overwritten
+    return false;
+  }
+  if (flags & kTerminal) {
+    return true;
+  }
+  return index + 1 < frame_count &&
+      !(flags_[Slot(stream, index + 1)] & kEpisodeStart);
+}
+
+int ReplayMemory::Sample(std::mt19937& random_engine) const {
+  CHECK_GT(transition_count_, 0);
+  // Draw among the filled slots of every stream
+  auto stored = 0;
+  for (const auto& s : streams_) {
+    stored += std::min<int64_t>(s.frame_count, stream_capacity_);
+  }
+  std::uniform_int_distribution<int> position_distribution(0, stored - 1);
+  // Nearly every slot holds a valid transition, so rejection is cheap.
+  for (auto attempt = 0; attempt < 100 * stored; ++attempt) {
+    auto position = position_distribution(random_engine);
+    auto stream = 0;
+    for (;; ++stream) {
+      const auto filled = static_cast<int>(
+          std::min<int64_t>(streams_[stream].frame_count, stream_capacity_));
+      if (position < filled) {
+        break;
+      }
+      position -= filled;
+    }
+    const auto slot = stream * stream_capacity_ + position;
+    if (IsValid(slot)) {
+      return slot;
+    }
+  }
+  LOG(FATAL) << "No replayable transition among " << stored << " frames";
+  return -1;
+}
+
+void ReplayMemory::SampleBatch(const int batch_size,
+                               const double priority_beta,
+                               std::mt19937& random_engine,
+                               int* slots, float* weights) const {
+  if (!prioritized()) {
+    for (auto i = 0; i < batch_size; ++i) {
+      slots[i] = Sample(random_engine);
+      weights[i] = 1.0f;
+    }
+    return;
+  }
+  const auto total = priorities_->total();
+  CHECK_GT(total, 0.0) << "No replayable transition";
+  // w_i = (N * P(i))^-beta / max_j w_j = (p_i / p_min)^-beta
+  const auto min_priority = priorities_->min();
+  const auto segment = total / batch_size;
+  std::uniform_real_distribution<double> mass_distribution(0.0, segment);
+  for (auto i = 0; i < batch_size; ++i) {
+    const auto mass = std::min(i * segment + mass_distribution(random_engine),
+                               std::nextafter(total, 0.0));
+    auto slot = priorities_->Find(mass);
+    if (priorities_->Get(slot) == 0.0) {
+      // Rounding at a range boundary landed on an empty leaf
+      slot = priorities_->Find(
+          std::uniform_real_distribution<double>(0.0, total)(random_engine));
+    }
+    DCHECK(IsValid(slot));
+    slots[i] = slot;
+    weights[i] = std::pow(priorities_->Get(slot) / min_priority,
+                          -priority_beta);
+  }
+}
+
+void ReplayMemory::UpdatePriorities(const int batch_size, const int* slots,
+                                    const int64_t* generations,
+                                    const float* td_errors) {
+  if (!prioritized()) {
+    return;
+  }
+  for (auto i = 0; i < batch_size; ++i) {
+    if (generation(slots[i]) != generations[i] ||
+        priorities_->Get(slots[i]) == 0.0) {
+      // Evicted since it was sampled
+      continue;
+    }
+    const auto priority = std::pow(std::abs(td_errors[i]) + kPriorityEpsilon,
+                                   priority_alpha_);
+    priorities_->Set(slots[i], priority);
+    max_priority_ = std::max(max_priority_, priority);
+  }
+}
+
+void ReplayMemory::CopyFrames(const int stream, const int64_t first_index,
+                              uint8_t* state) const {
+  for (auto i = 0; i < kStateFrameCount; ++i) {
+    const auto src = frame(stream, first_index + i);
+    std::copy(src, src + kFrameDataSize, state + i * kFrameDataSize);
+  }
+}
+
+void ReplayMemory::GetState(const int slot, uint8_t* state) const {
+  DCHECK(IsValid(slot));
+  CopyFrames(StreamOf(slot), Index(slot) - (kStateFrameCount - 1), state);
+}
+
+void ReplayMemory::GetNextState(const int slot, uint8_t* state) const {
+  DCHECK(IsValid(slot));
+  DCHECK(!is_terminal(slot));
+  CopyFrames(StreamOf(slot), Index(slot) - (kStateFrameCount - 2), state);
+}
+
+void ReplayMemory::Save(const std::string& path) const {
+  static_assert(std::is_trivially_copyable<Stream>::value,
+                "Streams are saved as raw bytes");
+  auto header = FileLayout(capacity_, stream_count(), sizeof(Stream),
+                           prioritized(), kFrameStride);
+  header.transition_count = transition_count_;
+  header.priority_alpha = priority_alpha_;
+  header.max_priority = max_priority_;
+
+  // Written aside and renamed, so that path always holds a whole memory
+  caffe::WriteFileDurably(path, [&](int fd) {
+    return ftruncate(fd, header.file_size) == 0 &&
+        WriteAt(fd, &header, sizeof(header), 0) &&
+        WriteAt(fd, frames_, static_cast<size_t>(capacity_) * kFrameStride,
+                header.frames_offset) &&
+        WriteAt(fd, actions_, capacity_ * sizeof(uint8_t),
+                header.actions_offset) &&
+        WriteAt(fd, rewards_, capacity_ * sizeof(float),
+                header.rewards_offset) &&
+        WriteAt(fd, flags_, capacity_ * sizeof(uint8_t),
+                header.flags_offset) &&
+        WriteAt(fd, streams_.data(), streams_.size() * sizeof(Stream),
+                header.streams_offset) &&
+        (!prioritized() ||
+         WriteAt(fd, priorities_->leaves(), capacity_ * sizeof(double),
+                 header.priorities_offset));
+  });
+}
+
+void ReplayMemory::Load(const std::string& path) {
+  const auto fd = open(path.c_str(), O_RDONLY);
+  PCHECK(fd >= 0) << "Cannot open " << path;
+  struct stat file_stat;
+  PCHECK(fstat(fd, &file_stat) == 0) << "Cannot stat " << path;
+  const auto file_size = static_cast<size_t>(file_stat.st_size);
+  CHECK_GE(file_size, sizeof(FileHeader))
+      << path << " is not a replay memory file";
+  // Read through the page cache instead of copying into a buffer first
+  const auto map = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  PCHECK(map != MAP_FAILED) << "Cannot map " << path;
+  close(fd);
+  madvise(map, file_size, MADV_SEQUENTIAL);
+  const auto data = static_cast<const uint8_t*>(map);
+
+  FileHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  CHECK(std::equal(kFileMagic, kFileMagic + sizeof(kFileMagic), header.magic))
+      << path << " is not a replay memory file";
+  CHECK_EQ(header.version, kFileVersion)
+      << "Unsupported replay memory file version in " << path;
+  CHECK_EQ(header.capacity, capacity_)
+      << path << " holds a replay memory of another capacity";
+  CHECK_EQ(header.stream_count, stream_count())
+      << path << " holds a replay memory of another stream count";
+  CHECK_EQ(header.priority_alpha, priority_alpha_)
+      << path << " holds a replay memory of another priority exponent";
+  const auto layout = FileLayout(capacity_, stream_count(), sizeof(Stream),
+                                 prioritized(), kFrameStride);
+  CHECK_EQ(header.frame_stride, layout.frame_stride);
+  CHECK_EQ(header.file_size, layout.file_size)
+      << path << " was written by an incompatible build";
+  CHECK_EQ(file_size, layout.file_size) << path << " is truncated";
+
+  std::memcpy(frames_, data + layout.frames_offset,
+              static_cast<size_t>(capacity_) * kFrameStride);
+  std::memcpy(actions_, data + layout.actions_offset,
+              capacity_ * sizeof(uint8_t));
+  std::memcpy(rewards_, data + layout.rewards_offset,
+              capacity_ * sizeof(float));
+  std::memcpy(flags_, data + layout.flags_offset, capacity_ * sizeof(uint8_t));
+  std::memcpy(streams_.data(), data + layout.streams_offset,
+              streams_.size() * sizeof(Stream));
+  if (prioritized()) {
+    priorities_->Assign(
+        reinterpret_cast<const double*>(data + layout.priorities_offset));
+  }
+  transition_count_ = header.transition_count;
+  max_priority_ = header.max_priority;
+  munmap(map, file_size);
+}
+
+}  // namespace fast_dqn
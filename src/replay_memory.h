@@ -0,0 +1,187 @@
+#ifndef SRC_REPLAY_MEMORY_H_
+#define SRC_REPLAY_MEMORY_H_
+
+#include "environment.h"
+#include "sum_tree.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fast_dqn {
+
+/**
+ * Replay memory backed by one preallocated ring of preprocessed frames.
+ *
+ * Every slot of the ring holds one frame plus the action taken on it, the
+ * reward that followed and a few flag bits.  A transition is identified by
+ * the slot of the last frame of its state; the state is made of that frame
+ * and the kInputFrameCount - 1 frames before it, the next state is shifted
+ * one slot forward.  Each observed frame is therefore stored exactly once.
+ *
+ * Environments played side by side each write to their own stream, an
+ * equal share of the ring, so that the frames of an episode stay
+ * consecutive.
+ *
+ * With a positive priority_alpha, transitions are sampled proportionally
+ * to priority^alpha (prioritized experience replay) using a sum-tree
+ * over the slots; replayable slots hold their priority and all others 0.
+ */
+class ReplayMemory {
+ public:
+  static constexpr auto kFrameDataSize = Environment::kCroppedFrameDataSize;
+  static constexpr auto kStateFrameCount = Environment::kInputFrameCount;
+  static constexpr auto kStateDataSize = Environment::kInputDataSize;
+  // Frames are padded so that every one of them starts on a cache line.
+  static constexpr auto kCacheLineSize = 64;
+  static constexpr auto kFrameStride =
+      (kFrameDataSize + kCacheLineSize - 1) / kCacheLineSize * kCacheLineSize;
+  // Keeps transitions with a zero TD error replayable.
+  static constexpr auto kPriorityEpsilon = 1e-6;
+
+  ReplayMemory(const int capacity, const int stream_count,
+               const double priority_alpha);
+  ~ReplayMemory();
+
+  /**
+   * Store a preprocessed frame as the newest frame of a stream.
+   * episode_start must be set on the first frame of every episode.
+   */
+  void AddFrame(const int stream, const uint8_t* frame,
+                const bool episode_start);
+
+  /**
+   * Record the action taken on the newest frame of a stream and its
+   * outcome.  The newest frame must be at least the kInputFrameCount-th
+   * one of its episode.
+   */
+  void AddTransition(const int stream, const Environment::ActionCode action,
+                     const float reward, const bool terminal);
+
+  /**
+   * Uniformly sample the slot of a transition that can be replayed.
+   */
+  int Sample(std::mt19937& random_engine) const;
+
+  /**
+   * Sample batch_size transitions into slots.  Prioritized memories
+   * sample one transition from each of batch_size equal ranges of the
+   * priority mass and write the importance-sampling weights, normalized
+   * so the largest possible weight is 1; uniform memories write 1.
+   */
+  void SampleBatch(const int batch_size, const double priority_beta,
+                   std::mt19937& random_engine,
+                   int* slots, float* weights) const;
+
+  /**
+   * Set the priorities of sampled transitions from their TD errors.
+   * Slots whose generation changed since they were sampled hold a newer
+   * transition by now and keep their priority.
+   */
+  void UpdatePriorities(const int batch_size, const int* slots,
+                        const int64_t* generations, const float* td_errors);
+
+  bool prioritized() const { return priorities_ != nullptr; }
+
+  /**
+   * True if the transition ending at slot can be replayed, i.e. its
+   * whole state and (unless terminal) its next frame are still stored.
+   */
+  bool IsValid(const int slot) const;
+
+  /**
+   * Write the kInputDataSize bytes of the state ending at slot.
+   */
+  void GetState(const int slot, uint8_t* state) const;
+
+  /**
+   * Write the kInputDataSize bytes of the state following slot.
+   */
+  void GetNextState(const int slot, uint8_t* state) const;
+
+  Environment::ActionCode action(const int slot) const {
+    return actions_[slot];
+  }
+  float reward(const int slot) const { return rewards_[slot]; }
+  bool is_terminal(const int slot) const { return flags_[slot] & kTerminal; }
+
+  /**
+   * Changes whenever slot is overwritten by a new frame.
+   */
+  int64_t generation(const int slot) const { return Index(slot); }
+
+  /**
+   * Number of stored transitions.
+   */
+  int size() const { return transition_count_; }
+  int capacity() const { return capacity_; }
+  int stream_count() const { return streams_.size(); }
+
+  /**
+   * Write the whole memory to path, replacing the file atomically.  Every
+   * array is stored raw at a page-aligned offset, so that each section of
+   * the file can be mapped as it is.
+   */
+  void Save(const std::string& path) const;
+
+  /**
+   * Restore the memory from a file written by Save for the same capacity,
+   * stream count and priority exponent.
+   */
+  void Load(const std::string& path);
+
+  /**
+   * Bytes of memory used per stored transition.
+   */
+  size_t bytes_per_transition() const {
+    return kFrameStride + sizeof(uint8_t) + sizeof(float) + sizeof(uint8_t) +
+        (prioritized() ? priorities_->bytes() / capacity_ : 0);
+  }
+
+ private:
+  enum Flags : uint8_t {
+    kHasAction = 1 << 0,
+    kTerminal = 1 << 1,
+    kEpisodeStart = 1 << 2
+  };
+
+  struct Stream {
+    int64_t frame_count;  // Frames added since construction
+    int episode_frame_count;  // Frames added since the episode started
+  };
+
+  // Frames of a stream are numbered by index, slots number the whole ring
+  int Slot(const int stream, const int64_t index) const {
+    return stream * stream_capacity_ + index % stream_capacity_;
+  }
+  int StreamOf(const int slot) const { return slot / stream_capacity_; }
+  int64_t Index(const int slot) const;
+  const uint8_t* frame(const int stream, const int64_t index) const {
+    return frames_ + static_cast<size_t>(Slot(stream, index)) * kFrameStride;
+  }
+  void CopyFrames(const int stream, const int64_t first_index,
+                  uint8_t* state) const;
+  void SetPriority(const int stream, const int64_t index,
+                   const double priority);
+
+  const int stream_capacity_;
+  const int capacity_;
+  uint8_t* frames_;
+  uint8_t* actions_;
+  float* rewards_;
+  uint8_t* flags_;
+  std::vector<Stream> streams_;
+  int transition_count_;
+  const double priority_alpha_;
+  double max_priority_;  // Largest priority^alpha given so far
+  std::unique_ptr<SumTree> priorities_;
+
+  ReplayMemory(const ReplayMemory&) = delete;
+  ReplayMemory& operator=(const ReplayMemory&) = delete;
+};
+
+}  // namespace fast_dqn
+
+#endif  // SRC_REPLAY_MEMORY_H_
@@ -0,0 +1,59 @@
+#include "sum_tree.h"
+#include <glog/logging.h>
+#include <algorithm>
+#include <limits>
+
+namespace fast_dqn {
+
+SumTree::SumTree(const int size) : size_(size), leaf_count_(1) {
+  CHECK_GT(size_, 0);
+  while (leaf_count_ < size_) {
+    leaf_count_ *= 2;
+  }
+  sum_.assign(2 * leaf_count_, 0.0);
+  min_.assign(2 * leaf_count_, std::numeric_limits<double>::infinity());
+}
+
+void SumTree::Set(const int index, const double priority) {
+  DCHECK_GE(index, 0);
+  DCHECK_LT(index, size_);
+  DCHECK_GE(priority, 0.0);
+  auto node = leaf_count_ + index;
+  sum_[node] = priority;
+  min_[node] = priority > 0.0 ?
+      priority : std::numeric_limits<double>::infinity();
+  for (node /= 2; node >= 1; node /= 2) {
+    sum_[node] = sum_[2 * node] + sum_[2 * node + 1];
+    min_[node] = std::min(min_[2 * node], min_[2 * node + 1]);
+  }
+}
+
+void SumTree::Assign(const double* priorities) {
+  for (auto index = 0; index < size_; ++index) {
+    DCHECK_GE(priorities[index], 0.0);
+    const auto node = leaf_count_ + index;
+    sum_[node] = priorities[index];
+    min_[node] = priorities[index] > 0.0 ?
+        priorities[index] : std::numeric_limits<double>::infinity();
+  }
+  for (auto node = leaf_count_ - 1; node >= 1; --node) {
+    sum_[node] = sum_[2 * node] + sum_[2 * node + 1];
+    min_[node] = std::min(min_[2 * node], min_[2 * node + 1]);
+  }
+}
+
+int SumTree::Find(double mass) const {
+  auto node = 1;
+  while (node < leaf_count_) {
+    const auto left = 2 * node;
+    if (mass < sum_[left] || sum_[left + 1] == 0.0) {
+      node = left;
+    } else {
+      mass -= sum_[left];
+      node = left + 1;
+    }
+  }
+  return node - leaf_count_;
+}
+
+}  // namespace fast_dqn
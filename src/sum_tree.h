@@ -0,0 +1,69 @@
+#ifndef SRC_SUM_TREE_H_
+#define SRC_SUM_TREE_H_
+
+#include <cstddef>
+#include <vector>
+
+namespace fast_dqn {
+
+/**
+ * Sum-tree and min-tree over a fixed number of non-negative priorities,
+ * stored as flat arrays.  Updates and prefix-sum searches are O(log n)
+ * and never allocate.
+ */
+class SumTree {
+ public:
+  explicit SumTree(const int size);
+
+  /**
+   * Set the priority of a leaf.  A priority of 0 excludes the leaf from
+   * sampling and from min().
+   */
+  void Set(const int index, const double priority);
+
+  double Get(const int index) const { return sum_[leaf_count_ + index]; }
+
+  /**
+   * Sum of all priorities.
+   */
+  double total() const { return sum_[1]; }
+
+  /**
+   * Smallest non-zero priority, or infinity if all are 0.
+   */
+  double min() const { return min_[1]; }
+
+  /**
+   * Index of the leaf in which the prefix sum reaches mass,
+   * for 0 <= mass < total().
+   */
+  int Find(double mass) const;
+
+  int size() const { return size_; }
+
+  /**
+   * The size() leaf priorities, in index order.
+   */
+  const double* leaves() const { return &sum_[leaf_count_]; }
+
+  /**
+   * Set the priorities of all leaves at once in O(n); the trees end up
+   * exactly as after setting them one by one.
+   */
+  void Assign(const double* priorities);
+
+  /**
+   * Bytes used by both trees.
+   */
+  size_t bytes() const { return (sum_.size() + min_.size()) * sizeof(double); }
+
+ private:
+  const int size_;
+  int leaf_count_;  // size_ rounded up to a power of two
+  std::vector<double> sum_;  // Node i has children 2i and 2i + 1
+  std::vector<double> min_;
+};
+
+}  // namespace fast_dqn
+
+#endif  // SRC_SUM_TREE_H_
@@ -0,0 +1,119 @@
+#include "vector_environment.h"
+#include <glog/logging.h>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace fast_dqn {
+
+VectorEnvironment::VectorEnvironment(
+    const std::vector<EnvironmentSp>& environments) {
+  CHECK(!environments.empty());
+  for (const auto& environment : environments) {
+    CHECK(!environment->EpisodeOver());
+    Actor actor;
+    actor.environment = environment;
+    actor.acting = false;
+    actor.action = 0;
+    actor.immediate_score = 0.0;
+    actor.episode_over = false;
+    actor.score = 0.0;
+    actor.frames = 0;
+    actors_.push_back(std::move(actor));
+    workers_.emplace_back(new WorkerThread);
+  }
+}
+
+void VectorEnvironment::RunOnWorkers(const std::function<void(int)>& job) {
+  for (auto i = 0; i < size(); ++i) {
+    workers_[i]->Start([&job, i] { job(i); });
+  }
+  for (auto& worker : workers_) {
+    worker->Wait();
+  }
+}
+
+std::vector<EpisodeResult> VectorEnvironment::Step(
+    Fast_DQN* dqn, const double epsilon, const bool update,
+    int* transition_count) {
+  // Observe every environment, resetting the ones that finished
+  RunOnWorkers([this](int i) {
+    auto& actor = actors_[i];
+    if (actor.episode_over) {
+      actor.environment->Reset();
+      actor.episode_over = false;
+    }
+    actor.current_frame = actor.frame_pool.Next();
+    actor.environment->PreprocessScreen(actor.current_frame.get());
+  });
+
+  InputStateBatch states;
+  std::vector<int> acting_indices;
+  for (auto i = 0; i < size(); ++i) {
+    auto& actor = actors_[i];
+    ++actor.frames;
+    if (update) {
+      dqn->AddFrame(i, *actor.current_frame, actor.frames == 1);
+    }
+    actor.past_frames.push_back(actor.current_frame);
+    if (actor.past_frames.size() > kInputFrameCount) {
+      actor.past_frames.pop_front();
+    }
+    // If there are not past frames enough for DQN input, just select NOOP
+    actor.acting = actor.past_frames.size() == kInputFrameCount;
+    if (actor.acting) {
+      State state;
+      std::copy(actor.past_frames.begin(), actor.past_frames.end(),
+                state.begin());
+      states.push_back(state);
+      acting_indices.push_back(i);
+    }
+  }
+
+  // Select the actions of all environments, kMinibatchSize at a time
+  for (auto first = 0; first < states.size(); first += kMinibatchSize) {
+    const auto last = std::min<int>(first + kMinibatchSize, states.size());
+    const auto actions = dqn->SelectActions(
+        InputStateBatch(states.begin() + first, states.begin() + last),
+        epsilon);
+    for (auto j = first; j < last; ++j) {
+      actors_[acting_indices[j]].action = actions[j - first];
+    }
+  }
+
+  RunOnWorkers([this](int i) {
+    auto& actor = actors_[i];
+    if (actor.acting) {
+      actor.immediate_score = actor.environment->Act(actor.action);
+    } else {
+      actor.environment->ActNoop();
+    }
+    actor.episode_over = actor.environment->EpisodeOver();
+  });
+
+  std::vector<EpisodeResult> results;
+  *transition_count = 0;
+  for (auto i = 0; i < size(); ++i) {
+    auto& actor = actors_[i];
+    if (actor.acting) {
+      actor.score += actor.immediate_score;
+      if (update) {
+        // Rewards for DQN are normalized as follows:
+        // 1 for any positive score, -1 for any negative score, otherwise 0
+        const auto reward = actor.immediate_score == 0 ? 0 :
+            actor.immediate_score / std::abs(actor.immediate_score);
+        dqn->AddTransition(i, actor.action, reward, actor.episode_over);
+        ++*transition_count;
+      }
+    }
+    if (actor.episode_over) {
+      results.push_back(EpisodeResult{actor.score, actor.frames});
+      actor.past_frames.clear();
+      actor.score = 0.0;
+      actor.frames = 0;
+    }
+  }
+  return results;
+}
+
+}  // namespace fast_dqn
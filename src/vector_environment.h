@@ -0,0 +1,61 @@
+#ifndef SRC_VECTOR_ENVIRONMENT_H_
+#define SRC_VECTOR_ENVIRONMENT_H_
+
+#include "environment.h"
+#include "fast_dqn.h"
+#include "worker_thread.h"
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace fast_dqn {
+
+/**
+ * Plays several environments side by side.  Emulation and preprocessing
+ * run on worker threads, one environment per thread, while the actions
+ * of all environments are selected with one batched forward pass.
+ * Environment i writes to replay memory as environment i of the DQN.
+ */
+class VectorEnvironment {
+ public:
+  explicit VectorEnvironment(const std::vector<EnvironmentSp>& environments);
+
+  /**
+   * Advance every environment by one step and return the episodes that
+   * finished in it.  Finished environments are reset before their next
+   * step.  With update set, the observed frames and transitions are added
+   * to the replay memory of dqn; the number of transitions added is
+   * written to transition_count.
+   */
+  std::vector<EpisodeResult> Step(Fast_DQN* dqn, const double epsilon,
+                                  const bool update, int* transition_count);
+
+  int size() const { return actors_.size(); }
+
+ private:
+  struct Actor {
+    EnvironmentSp environment;
+    std::deque<FrameDataSp> past_frames;
+    FramePool frame_pool;
+    FrameDataSp current_frame;
+    bool acting;  // Whether past_frames hold a whole state
+    Environment::ActionCode action;
+    double immediate_score;
+    bool episode_over;
+    double score;
+    long frames;
+  };
+
+  /**
+   * Run job(i) for every environment i on the workers and wait for it
+   */
+  void RunOnWorkers(const std::function<void(int)>& job);
+
+  std::vector<Actor> actors_;
+  std::vector<std::unique_ptr<WorkerThread>> workers_;
+};
+
+}  // namespace fast_dqn
+
+#endif  // SRC_VECTOR_ENVIRONMENT_H_
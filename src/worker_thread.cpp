@@ -0,0 +1,47 @@
+#include "worker_thread.h"
+#include <glog/logging.h>
+
+namespace fast_dqn {
+
+WorkerThread::WorkerThread() : busy_(false), stop_(false) {
+  StartInternalThread();
+}
+
+WorkerThread::~WorkerThread() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  condition_.notify_all();
+  StopInternalThread();
+}
+
+void WorkerThread::Start(const std::function<void()>& job) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  CHECK(!busy_) << "Previous job still running";
+  job_ = job;
+  busy_ = true;
+  condition_.notify_all();
+}
+
+void WorkerThread::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  condition_.wait(lock, [this] { return !busy_; });
+}
+
+void WorkerThread::InternalThreadEntry() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    condition_.wait(lock, [this] { return stop_ || busy_; });
+    if (stop_) {
+      return;
+    }
+    lock.unlock();
+    job_();
+    lock.lock();
+    busy_ = false;
+    condition_.notify_all();
+  }
+}
+
+}  // namespace fast_dqn
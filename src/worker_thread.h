@@ -0,0 +1,44 @@
+#ifndef SRC_WORKER_THREAD_H_
+#define SRC_WORKER_THREAD_H_
+
+#include <caffe/internal_thread.hpp>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+namespace fast_dqn {
+
+/**
+ * Thread that runs one job at a time in the background.  Caffe's thread
+ * local state (mode, device) is copied from the thread that created it,
+ * so jobs may run nets.
+ */
+class WorkerThread : public caffe::InternalThread {
+ public:
+  WorkerThread();
+  ~WorkerThread();
+
+  /**
+   * Run job in the background.  The previous job must have been waited for.
+   */
+  void Start(const std::function<void()>& job);
+
+  /**
+   * Wait until the job given to Start has finished.
+   */
+  void Wait();
+
+ protected:
+  void InternalThreadEntry();
+
+ private:
+  std::function<void()> job_;
+  bool busy_;
+  bool stop_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+};
+
+}  // namespace fast_dqn
+
+#endif  // SRC_WORKER_THREAD_H_